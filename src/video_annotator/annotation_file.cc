@@ -0,0 +1,708 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "annotation_file.h"
+#include "video_annotation.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Identifies an annotation file.
+  static const char kMagic[4] = {'T', 'A', 'N', 'N'};
+
+  /// Current version of the annotation file format.
+  static const quint32 kVersion = 1;
+
+  /// Number of detections after which a block ends with its frame.
+  static const quint32 kBlockDetections = 1 << 16;
+
+  /// Size at which output is written to the file.
+  static const std::size_t kBufferBytes = 1 << 20;
+
+  /// Track flag indicating that the track has a track annotation.
+  static const quint32 kTrackAnnotated = 1;
+
+  /// Bits of the detection flags holding the annotation type.
+  static const quint8 kTypeMask = 3;
+
+  /// Detection flag indicating that a species index follows.
+  static const quint8 kHasSpecies = 4;
+
+  /// Detection flag indicating that a probability follows.
+  static const quint8 kHasProb = 8;
+
+  /// Global state value types.
+  static const quint8 kStateBool = 0;
+  static const quint8 kStateString = 1;
+
+  /// Header of an annotation file.
+  struct FileHeader {
+    char magic[4]; ///< Must equal kMagic.
+    quint32 version; ///< File format version.
+    qint64 source_size; ///< Size of the source JSON file, -1 if none.
+    qint64 source_modified; ///< Modification time of the source JSON file.
+  };
+
+  /// Entry of the track table.
+  struct TrackRecord {
+    quint64 id; ///< Track ID.
+    quint64 frame_added; ///< Frame that the track was added.
+    quint64 first; ///< First frame with a detection.
+    quint64 last; ///< Last frame with a detection.
+    quint64 count; ///< Number of detections.
+    quint32 species; ///< Index of the species in the string table.
+    quint32 subspecies; ///< Index of the subspecies in the string table.
+    quint32 count_label; ///< How the track contributes to counts.
+    quint32 flags; ///< Combination of track flags.
+  };
+
+  /// Footer of an annotation file, locating its sections.
+  ///
+  /// Sections follow the header in the order blocks of detections,
+  /// string table, track table, global state timeline and block index.
+  struct FileFooter {
+    quint64 strings_offset; ///< Offset of the string table.
+    quint64 string_count; ///< Number of strings.
+    quint64 tracks_offset; ///< Offset of the track table.
+    quint64 track_count; ///< Number of tracks.
+    quint64 states_offset; ///< Offset of the global state timeline.
+    quint64 states_bytes; ///< Size of the global state timeline.
+    quint64 state_count; ///< Number of frames with global states.
+    quint64 index_offset; ///< Offset of the block index.
+    quint64 block_count; ///< Number of blocks.
+    quint64 detection_count; ///< Number of detections.
+    char magic[4]; ///< Must equal kMagic.
+    quint32 version; ///< File format version.
+  };
+
+  /// Previous detection of a track within a block.
+  struct Previous {
+    quint64 x; ///< Horizontal coordinate.
+    quint64 y; ///< Vertical coordinate.
+    quint64 w; ///< Width.
+    quint64 h; ///< Height.
+    quint64 species; ///< Index of the species in the string table.
+    double prob; ///< Detection probability.
+  };
+
+  /// Appends an unsigned integer in seven bit groups.
+  void putVarint(std::string &out, quint64 value) {
+    while(value >= 0x80) {
+      out.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  /// Reads an unsigned integer written by putVarint.
+  bool getVarint(const uchar *&pos, const uchar *end, quint64 &value) {
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+      if(pos == end) {
+        return false;
+      }
+      const uchar byte = *pos++;
+      value |= static_cast<quint64>(byte & 0x7f) << shift;
+      if((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Appends the difference of two coordinates, small in either
+  /// direction, as a varint.
+  void putDelta(std::string &out, int64_t value, quint64 &previous) {
+    const quint64 delta = static_cast<quint64>(value) - previous;
+    const quint64 sign = (delta >> 63) != 0 ? ~quint64(0) : 0;
+    putVarint(out, (delta << 1) ^ sign);
+    previous = static_cast<quint64>(value);
+  }
+
+  /// Reads a difference written by putDelta and applies it.
+  bool getDelta(const uchar *&pos, const uchar *end, quint64 &previous) {
+    quint64 value = 0;
+    if(getVarint(pos, end, value) == false) {
+      return false;
+    }
+    previous += (value >> 1) ^ (0 - (value & 1));
+    return true;
+  }
+
+  /// Assigns indices to distinct strings.
+  class StringTable {
+  public:
+    /// Returns the index of a string, adding it if needed.
+    quint64 index(const std::string &value) {
+      auto it = index_.find(value);
+      if(it == index_.end()) {
+        it = index_.emplace(value, strings_.size()).first;
+        strings_.push_back(value);
+      }
+      return it->second;
+    }
+
+    /// Returns the strings by index.
+    const std::vector<std::string> &strings() const {
+      return strings_;
+    }
+  private:
+    std::unordered_map<std::string, quint64> index_;
+    std::vector<std::string> strings_;
+  };
+
+  /// Gets the size and modification time of a JSON file.
+  void sourceOf(const QString &json_path, qint64 &size, qint64 &modified) {
+    QFileInfo info(json_path);
+    if(json_path.isEmpty() == true || info.exists() == false) {
+      size = -1;
+      modified = -1;
+      return;
+    }
+    size = info.size();
+    modified = info.lastModified().toMSecsSinceEpoch();
+  }
+
+  /// Converts an annotation type to its code in the file.
+  quint8 typeCode(AnnotationType type) {
+    switch(type) {
+      case kLine: return 1;
+      case kDot: return 2;
+      default: return 0;
+    }
+  }
+} // namespace
+
+AnnotationFile::AnnotationFile()
+  : file_(nullptr)
+  , data_(nullptr)
+  , source_size_(-1)
+  , source_modified_(-1)
+  , strings_()
+  , tracks_(nullptr)
+  , track_ids_()
+  , states_(nullptr)
+  , states_bytes_(0)
+  , state_count_(0)
+  , blocks_()
+  , detection_count_(0) {
+}
+
+AnnotationFile::~AnnotationFile() {
+  close();
+}
+
+bool AnnotationFile::save(
+    const QString &path,
+    const QString &json_path,
+    const std::vector<const TrackAnnotation*> &tracks,
+    const DetectionStore &detections,
+    const std::map<uint64_t, GlobalStateAnnotation> &states) {
+  QDir().mkpath(QFileInfo(path).absolutePath());
+  QSaveFile file(path);
+  if(file.open(QIODevice::WriteOnly) == false) {
+    return false;
+  }
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  sourceOf(json_path, header.source_size, header.source_modified);
+  std::string buffer;
+  buffer.reserve(kBufferBytes + 4096);
+  buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  quint64 written = 0;
+  auto flush = [&]() {
+    file.write(buffer.data(), static_cast<qint64>(buffer.size()));
+    written += buffer.size();
+    buffer.clear();
+  };
+  // Tracks with annotations come first in the track table, in order of
+  // ID, followed by tracks that only have detections.
+  StringTable strings;
+  std::vector<TrackRecord> records;
+  std::unordered_map<uint64_t, quint64> track_index;
+  records.reserve(tracks.size());
+  for(const TrackAnnotation *track : tracks) {
+    TrackRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.id = track->id_;
+    record.frame_added = track->frame_added_;
+    record.species = static_cast<quint32>(strings.index(track->species_));
+    record.subspecies = static_cast<quint32>(
+        strings.index(track->subspecies_));
+    record.count_label = static_cast<quint32>(track->count_label_);
+    record.flags = kTrackAnnotated;
+    track_index.emplace(record.id, records.size());
+    records.push_back(record);
+  }
+  // Blocks of detections.
+  std::vector<Block> blocks;
+  std::unordered_map<quint64, Previous> previous;
+  Block block;
+  std::memset(&block, 0, sizeof(block));
+  bool in_block = false;
+  quint64 detection_count = 0;
+  auto endBlock = [&]() {
+    block.bytes = static_cast<quint32>(written + buffer.size() - block.offset);
+    blocks.push_back(block);
+    previous.clear();
+    in_block = false;
+  };
+  detections.forEach([&](const DetectionAnnotation &d) -> bool {
+    // Blocks hold whole frames, so that a frame is in a single block.
+    if(in_block == true && block.count >= kBlockDetections &&
+        d.frame_ != block.last) {
+      endBlock();
+    }
+    if(in_block == false) {
+      block.offset = written + buffer.size();
+      block.first = d.frame_;
+      block.last = d.frame_;
+      block.count = 0;
+      in_block = true;
+    }
+    auto it = track_index.find(d.id_);
+    if(it == track_index.end()) {
+      TrackRecord record;
+      std::memset(&record, 0, sizeof(record));
+      record.id = d.id_;
+      it = track_index.emplace(d.id_, records.size()).first;
+      records.push_back(record);
+    }
+    const quint64 index = it->second;
+    TrackRecord &record = records[index];
+    if(record.count == 0) {
+      record.first = d.frame_;
+    }
+    record.last = d.frame_;
+    ++record.count;
+    const quint64 species = strings.index(d.species_);
+    auto prev_it = previous.find(index);
+    const bool seen = prev_it != previous.end();
+    Previous prev = seen ? prev_it->second : Previous{0, 0, 0, 0, 0, 0.0};
+    quint8 flags = typeCode(d.type_);
+    if(seen == false || species != prev.species) {
+      flags |= kHasSpecies;
+    }
+    if(seen == false ||
+        std::memcmp(&d.prob_, &prev.prob, sizeof(double)) != 0) {
+      flags |= kHasProb;
+    }
+    putVarint(buffer, d.frame_ - block.last);
+    putVarint(buffer, index);
+    buffer.push_back(static_cast<char>(flags));
+    putDelta(buffer, d.area_.x, prev.x);
+    putDelta(buffer, d.area_.y, prev.y);
+    putDelta(buffer, d.area_.w, prev.w);
+    putDelta(buffer, d.area_.h, prev.h);
+    if((flags & kHasSpecies) != 0) {
+      putVarint(buffer, species);
+      prev.species = species;
+    }
+    if((flags & kHasProb) != 0) {
+      buffer.append(reinterpret_cast<const char*>(&d.prob_), sizeof(double));
+      prev.prob = d.prob_;
+    }
+    previous[index] = prev;
+    block.last = d.frame_;
+    ++block.count;
+    ++detection_count;
+    if(buffer.size() >= kBufferBytes) {
+      flush();
+    }
+    return true;
+  });
+  if(in_block == true) {
+    endBlock();
+  }
+  // Global state timeline, encoded before the string table so that its
+  // strings are in the table.
+  std::string timeline;
+  uint64_t prev_frame = 0;
+  for(const auto &s : states) {
+    putVarint(timeline, s.first - prev_frame);
+    prev_frame = s.first;
+    putVarint(timeline, s.second.states_.size());
+    for(const auto &state : s.second.states_) {
+      auto header_it = s.second.headers_.find(state.first);
+      putVarint(timeline, strings.index(state.first));
+      putVarint(timeline, strings.index(
+            header_it != s.second.headers_.end() ? header_it->second : ""));
+      if(const bool *value = boost::get<bool>(&state.second)) {
+        timeline.push_back(static_cast<char>(kStateBool));
+        putVarint(timeline, *value ? 1 : 0);
+      }
+      else {
+        timeline.push_back(static_cast<char>(kStateString));
+        putVarint(timeline, strings.index(
+              boost::get<std::string>(state.second)));
+      }
+    }
+  }
+  FileFooter footer;
+  std::memset(&footer, 0, sizeof(footer));
+  // String table, offsets of each string followed by their text.
+  footer.strings_offset = written + buffer.size();
+  footer.string_count = strings.strings().size();
+  quint64 string_offset = 0;
+  buffer.append(
+      reinterpret_cast<const char*>(&string_offset), sizeof(quint64));
+  for(const std::string &value : strings.strings()) {
+    string_offset += value.size();
+    buffer.append(
+        reinterpret_cast<const char*>(&string_offset), sizeof(quint64));
+  }
+  for(const std::string &value : strings.strings()) {
+    buffer.append(value);
+  }
+  flush();
+  // Track table.
+  footer.tracks_offset = written;
+  footer.track_count = records.size();
+  file.write(
+      reinterpret_cast<const char*>(records.data()),
+      static_cast<qint64>(records.size() * sizeof(TrackRecord)));
+  written += records.size() * sizeof(TrackRecord);
+  // Global state timeline.
+  footer.states_offset = written;
+  footer.states_bytes = timeline.size();
+  footer.state_count = states.size();
+  file.write(timeline.data(), static_cast<qint64>(timeline.size()));
+  written += timeline.size();
+  // Block index and footer.
+  footer.index_offset = written;
+  footer.block_count = blocks.size();
+  footer.detection_count = detection_count;
+  std::memcpy(footer.magic, kMagic, sizeof(kMagic));
+  footer.version = kVersion;
+  file.write(
+      reinterpret_cast<const char*>(blocks.data()),
+      static_cast<qint64>(blocks.size() * sizeof(Block)));
+  file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+  return file.commit();
+}
+
+bool AnnotationFile::open(const QString &path) {
+  close();
+  std::unique_ptr<QFile> file(new QFile(path));
+  if(file->open(QIODevice::ReadOnly) == false) {
+    return false;
+  }
+  const qint64 file_size = file->size();
+  if(file_size < static_cast<qint64>(sizeof(FileHeader) + sizeof(FileFooter))) {
+    return false;
+  }
+  const uchar *map = file->map(0, file_size);
+  if(map == nullptr) {
+    return false;
+  }
+  FileHeader header;
+  FileFooter footer;
+  std::memcpy(&header, map, sizeof(header));
+  std::memcpy(&footer, map + file_size - sizeof(footer), sizeof(footer));
+  if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      std::memcmp(footer.magic, kMagic, sizeof(kMagic)) != 0 ||
+      footer.version != kVersion) {
+    return false;
+  }
+  // Checks that a section lies between the header and the footer.
+  const quint64 body_end = file_size - sizeof(FileFooter);
+  auto fits = [body_end](quint64 offset, quint64 count, quint64 size) {
+    return offset >= sizeof(FileHeader) && offset <= body_end &&
+      count <= (body_end - offset) / size;
+  };
+  if(footer.string_count >= body_end ||
+      fits(footer.strings_offset, footer.string_count + 1, 8) == false ||
+      fits(footer.tracks_offset, footer.track_count,
+        sizeof(TrackRecord)) == false ||
+      fits(footer.states_offset, footer.states_bytes, 1) == false ||
+      fits(footer.index_offset, footer.block_count, sizeof(Block)) == false) {
+    return false;
+  }
+  // String table.
+  const uchar *offsets = map + footer.strings_offset;
+  const quint64 text_offset =
+    footer.strings_offset + (footer.string_count + 1) * sizeof(quint64);
+  std::vector<std::string> strings;
+  strings.reserve(footer.string_count);
+  quint64 begin = 0;
+  std::memcpy(&begin, offsets, sizeof(quint64));
+  if(begin != 0) {
+    return false;
+  }
+  for(quint64 i = 0; i < footer.string_count; ++i) {
+    quint64 end = 0;
+    std::memcpy(&end, offsets + (i + 1) * sizeof(quint64), sizeof(quint64));
+    if(end < begin || end > body_end - text_offset) {
+      return false;
+    }
+    strings.emplace_back(
+        reinterpret_cast<const char*>(map + text_offset + begin),
+        end - begin);
+    begin = end;
+  }
+  // Track IDs.
+  const uchar *tracks = map + footer.tracks_offset;
+  std::vector<uint64_t> track_ids(footer.track_count);
+  for(quint64 i = 0; i < footer.track_count; ++i) {
+    TrackRecord record;
+    std::memcpy(&record, tracks + i * sizeof(TrackRecord), sizeof(record));
+    track_ids[i] = record.id;
+  }
+  // Block index.
+  std::vector<Block> blocks(footer.block_count);
+  quint64 detection_count = 0;
+  for(quint64 i = 0; i < footer.block_count; ++i) {
+    Block &block = blocks[i];
+    std::memcpy(
+        &block, map + footer.index_offset + i * sizeof(Block), sizeof(Block));
+    // Every detection takes at least one byte.
+    if(fits(block.offset, block.bytes, 1) == false ||
+        block.count > block.bytes ||
+        block.first > block.last ||
+        (i > 0 && block.first <= blocks[i - 1].last)) {
+      return false;
+    }
+    detection_count += block.count;
+  }
+  if(detection_count != footer.detection_count) {
+    return false;
+  }
+  data_ = map;
+  source_size_ = header.source_size;
+  source_modified_ = header.source_modified;
+  strings_.swap(strings);
+  tracks_ = tracks;
+  track_ids_.swap(track_ids);
+  states_ = map + footer.states_offset;
+  states_bytes_ = footer.states_bytes;
+  state_count_ = footer.state_count;
+  blocks_.swap(blocks);
+  detection_count_ = detection_count;
+  file_ = std::move(file);
+  return true;
+}
+
+void AnnotationFile::close() {
+  file_.reset();
+  data_ = nullptr;
+  source_size_ = -1;
+  source_modified_ = -1;
+  strings_.clear();
+  tracks_ = nullptr;
+  track_ids_.clear();
+  states_ = nullptr;
+  states_bytes_ = 0;
+  state_count_ = 0;
+  blocks_.clear();
+  detection_count_ = 0;
+}
+
+bool AnnotationFile::isStale(const QString &json_path) const {
+  if(file_ == nullptr || source_size_ < 0) {
+    return true;
+  }
+  qint64 size = 0;
+  qint64 modified = 0;
+  sourceOf(json_path, size, modified);
+  return size != source_size_ || modified != source_modified_;
+}
+
+bool AnnotationFile::readTracks(std::vector<Track> &tracks) const {
+  tracks.reserve(tracks.size() + track_ids_.size());
+  for(std::size_t i = 0; i < track_ids_.size(); ++i) {
+    TrackRecord record;
+    std::memcpy(&record, tracks_ + i * sizeof(TrackRecord), sizeof(record));
+    Track track;
+    track.id = record.id;
+    track.first = record.first;
+    track.last = record.last;
+    track.count = record.count;
+    if((record.flags & kTrackAnnotated) != 0) {
+      if(record.species >= strings_.size() ||
+          record.subspecies >= strings_.size() ||
+          record.count_label > kExiting) {
+        return false;
+      }
+      track.annotation = std::make_shared<TrackAnnotation>(
+          record.id,
+          strings_[record.species],
+          strings_[record.subspecies],
+          record.frame_added,
+          static_cast<CountLabel>(record.count_label));
+    }
+    tracks.push_back(track);
+  }
+  return true;
+}
+
+bool AnnotationFile::readGlobalStates(
+    std::map<uint64_t, GlobalStateAnnotation> &states) const {
+  const uchar *pos = states_;
+  const uchar *end = states_ + states_bytes_;
+  quint64 frame = 0;
+  for(quint64 i = 0; i < state_count_; ++i) {
+    quint64 delta = 0;
+    quint64 count = 0;
+    if(getVarint(pos, end, delta) == false ||
+        getVarint(pos, end, count) == false) {
+      return false;
+    }
+    frame += delta;
+    GlobalStateAnnotation annotation;
+    for(quint64 j = 0; j < count; ++j) {
+      quint64 name = 0;
+      quint64 header = 0;
+      quint64 value = 0;
+      if(getVarint(pos, end, name) == false ||
+          getVarint(pos, end, header) == false ||
+          pos == end) {
+        return false;
+      }
+      const quint8 type = *pos++;
+      if(getVarint(pos, end, value) == false ||
+          name >= strings_.size() ||
+          header >= strings_.size()) {
+        return false;
+      }
+      if(type == kStateBool) {
+        annotation.states_[strings_[name]] = value != 0;
+      }
+      else if(type == kStateString && value < strings_.size()) {
+        annotation.states_[strings_[name]] = strings_[value];
+      }
+      else {
+        return false;
+      }
+      annotation.headers_[strings_[name]] = strings_[header];
+    }
+    states[frame] = annotation;
+  }
+  return pos == end;
+}
+
+uint64_t AnnotationFile::detectionCount() const {
+  return detection_count_;
+}
+
+std::size_t AnnotationFile::blockCount() const {
+  return blocks_.size();
+}
+
+void AnnotationFile::blockFrames(
+    std::size_t block,
+    uint64_t &first,
+    uint64_t &last) const {
+  first = blocks_[block].first;
+  last = blocks_[block].last;
+}
+
+void AnnotationFile::findBlocks(
+    uint64_t first,
+    uint64_t last,
+    std::size_t &begin,
+    std::size_t &end) const {
+  auto lower = std::lower_bound(blocks_.begin(), blocks_.end(), first,
+      [](const Block &block, uint64_t frame) {
+        return block.last < frame;
+      });
+  auto upper = std::upper_bound(lower, blocks_.end(), last,
+      [](uint64_t frame, const Block &block) {
+        return frame < block.first;
+      });
+  begin = lower - blocks_.begin();
+  end = upper - blocks_.begin();
+}
+
+bool AnnotationFile::readBlock(
+    std::size_t block,
+    std::vector<DetectionAnnotation> &detections) const {
+  const Block &entry = blocks_[block];
+  const uchar *pos = data_ + entry.offset;
+  const uchar *end = pos + entry.bytes;
+  std::unordered_map<quint64, Previous> previous;
+  quint64 frame = entry.first;
+  if(detections.empty() == true) {
+    detections.reserve(entry.count);
+  }
+  for(quint32 i = 0; i < entry.count; ++i) {
+    quint64 delta = 0;
+    quint64 index = 0;
+    if(getVarint(pos, end, delta) == false ||
+        getVarint(pos, end, index) == false ||
+        index >= track_ids_.size() ||
+        pos == end) {
+      return false;
+    }
+    frame += delta;
+    const quint8 flags = *pos++;
+    auto prev_it = previous.find(index);
+    if(prev_it == previous.end()) {
+      // The first detection of a track in a block has every field.
+      if((flags & kHasSpecies) == 0 || (flags & kHasProb) == 0) {
+        return false;
+      }
+      prev_it = previous.emplace(index, Previous{0, 0, 0, 0, 0, 0.0}).first;
+    }
+    Previous &prev = prev_it->second;
+    if(getDelta(pos, end, prev.x) == false ||
+        getDelta(pos, end, prev.y) == false ||
+        getDelta(pos, end, prev.w) == false ||
+        getDelta(pos, end, prev.h) == false) {
+      return false;
+    }
+    if((flags & kHasSpecies) != 0 &&
+        (getVarint(pos, end, prev.species) == false ||
+         prev.species >= strings_.size())) {
+      return false;
+    }
+    if((flags & kHasProb) != 0) {
+      if(end - pos < static_cast<std::ptrdiff_t>(sizeof(double))) {
+        return false;
+      }
+      std::memcpy(&prev.prob, pos, sizeof(double));
+      pos += sizeof(double);
+    }
+    detections.emplace_back();
+    DetectionAnnotation &d = detections.back();
+    d.frame_ = frame;
+    d.id_ = track_ids_[index];
+    d.area_ = Rect(
+        static_cast<int64_t>(prev.x),
+        static_cast<int64_t>(prev.y),
+        static_cast<int64_t>(prev.w),
+        static_cast<int64_t>(prev.h));
+    switch(flags & kTypeMask) {
+      case 0: d.type_ = kBox; break;
+      case 1: d.type_ = kLine; break;
+      case 2: d.type_ = kDot; break;
+      default: return false;
+    }
+    d.species_ = strings_[prev.species];
+    d.prob_ = prev.prob;
+  }
+  return pos == end;
+}
+
+QString AnnotationFile::cachePath(const QString &json_path) {
+  // Keyed on the path alone so each save replaces the previous copy,
+  // which isStale tells apart from the current file.
+  QString key = QFileInfo(json_path).absoluteFilePath();
+  QString hash = QCryptographicHash::hash(
+      key.toUtf8(), QCryptographicHash::Sha1).toHex();
+  QString cache_dir = QStandardPaths::writableLocation(
+      QStandardPaths::CacheLocation);
+  return cache_dir + QStringLiteral("/annotations/") + hash +
+    QStringLiteral(".tann");
+}
+
+}} // namespace tator::video_annotator
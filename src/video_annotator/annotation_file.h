@@ -0,0 +1,204 @@
+/// @file
+/// @brief Defines a compact binary file for video annotations.
+
+#ifndef VIDEO_ANNOTATOR_ANNOTATION_FILE_H
+#define VIDEO_ANNOTATOR_ANNOTATION_FILE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QString>
+#include <QFile>
+
+#include "global_state_annotation.h"
+
+namespace tator { namespace video_annotator {
+
+struct DetectionAnnotation;
+struct TrackAnnotation;
+class DetectionStore;
+
+/// Binary file holding the annotations of a video.
+///
+/// The file starts with a header and ends with a footer that locates
+/// each section: a table of distinct strings, a table of tracks, blocks
+/// of detections, a timeline of global states and an index of the
+/// blocks.  Detections are sorted by frame and then track, and split
+/// into blocks of whole frames.  Within a block each detection is
+/// stored as differences from the previous detection of its track, so
+/// that a block can be decoded on its own.
+///
+/// The file is memory mapped when opened.  Tracks and global states are
+/// read at once, while blocks of detections are decoded only for the
+/// frames that are needed.
+///
+/// JSON remains the format for exchanging annotations.  A binary file
+/// made from a JSON file records the size and modification time of the
+/// JSON file, so that it may be used as a cache of it.
+class AnnotationFile {
+public:
+  /// Track stored in a file.
+  struct Track {
+    uint64_t id; ///< Track ID.
+    std::shared_ptr<TrackAnnotation> annotation; ///< Null if none.
+    uint64_t first; ///< First frame with a detection of the track.
+    uint64_t last; ///< Last frame with a detection of the track.
+    uint64_t count; ///< Number of detections of the track.
+  };
+
+  /// Constructor.
+  AnnotationFile();
+
+  /// Destructor.
+  ~AnnotationFile();
+
+  /// Saves annotations to a binary file.
+  ///
+  /// @param path Path to output file.
+  /// @param json_path Path to the JSON file holding the same
+  ///   annotations, empty if none.
+  /// @param tracks Tracks in order of ID.
+  /// @param detections Detections.
+  /// @param states Global states by frame.
+  /// @return True if successful, false otherwise.
+  static bool save(
+    const QString &path,
+    const QString &json_path,
+    const std::vector<const TrackAnnotation*> &tracks,
+    const DetectionStore &detections,
+    const std::map<uint64_t, GlobalStateAnnotation> &states);
+
+  /// Opens a binary file by memory mapping it.
+  ///
+  /// Checks that the sections of the file are consistent, but decodes
+  /// only the string table and the block index.
+  ///
+  /// @param path Path to input file.
+  /// @return True if successful, false otherwise.
+  bool open(const QString &path);
+
+  /// Releases the mapped file.
+  void close();
+
+  /// Checks whether a JSON file has changed since this file was made
+  /// from it.
+  ///
+  /// @param json_path Path to the JSON file.
+  /// @return True if the JSON file differs in size or modification
+  ///   time, or this file was not made from a JSON file.
+  bool isStale(const QString &json_path) const;
+
+  /// Reads the tracks, in order of ID.
+  ///
+  /// Includes tracks that have detections but no track annotation.
+  ///
+  /// @param tracks Receives the tracks.
+  /// @return True if successful, false if the file is invalid.
+  bool readTracks(std::vector<Track> &tracks) const;
+
+  /// Reads the global states.
+  ///
+  /// @param states Receives global states by frame.
+  /// @return True if successful, false if the file is invalid.
+  bool readGlobalStates(
+    std::map<uint64_t, GlobalStateAnnotation> &states) const;
+
+  /// Returns the number of detections.
+  uint64_t detectionCount() const;
+
+  /// Returns the number of blocks of detections.
+  std::size_t blockCount() const;
+
+  /// Gets the range of frames in a block.
+  ///
+  /// @param block Index of the block.
+  /// @param first Receives the first frame in the block.
+  /// @param last Receives the last frame in the block.
+  void blockFrames(std::size_t block, uint64_t &first, uint64_t &last) const;
+
+  /// Finds the blocks holding a range of frames.
+  ///
+  /// @param first First frame of the range.
+  /// @param last Last frame of the range, inclusive.
+  /// @param begin Receives the first block in the range.
+  /// @param end Receives one past the last block in the range.
+  void findBlocks(
+    uint64_t first,
+    uint64_t last,
+    std::size_t &begin,
+    std::size_t &end) const;
+
+  /// Decodes the detections of a block, in order of frame and track.
+  ///
+  /// @param block Index of the block.
+  /// @param detections Detections are appended to this vector.
+  /// @return True if successful, false if the block is invalid.
+  bool readBlock(
+    std::size_t block,
+    std::vector<DetectionAnnotation> &detections) const;
+
+  /// Gets path to the cached binary file for a JSON file.
+  ///
+  /// The cache lives in the per user cache directory and is keyed by
+  /// the absolute path of the JSON file, so there is one copy per file.
+  /// Use isStale to check that the copy is current.
+  ///
+  /// @param json_path Path to JSON file.
+  /// @return Path to binary file.
+  static QString cachePath(const QString &json_path);
+private:
+  /// Index entry for a block of detections.
+  struct Block {
+    quint64 offset; ///< Offset of the block in the file.
+    quint64 first; ///< First frame in the block.
+    quint64 last; ///< Last frame in the block.
+    quint32 bytes; ///< Size of the block.
+    quint32 count; ///< Number of detections in the block.
+  };
+
+  /// Memory mapped file.
+  std::unique_ptr<QFile> file_;
+
+  /// Start of the mapped file.
+  const uchar *data_;
+
+  /// Size of the JSON file this file was made from, -1 if none.
+  qint64 source_size_;
+
+  /// Modification time of the JSON file in milliseconds since epoch.
+  qint64 source_modified_;
+
+  /// Distinct strings.
+  std::vector<std::string> strings_;
+
+  /// Start of the track table.
+  const uchar *tracks_;
+
+  /// Track IDs by index in the track table.
+  std::vector<uint64_t> track_ids_;
+
+  /// Start of the global state timeline.
+  const uchar *states_;
+
+  /// Size of the global state timeline.
+  uint64_t states_bytes_;
+
+  /// Number of frames in the global state timeline.
+  uint64_t state_count_;
+
+  /// Index of the blocks of detections, in order of frame.
+  std::vector<Block> blocks_;
+
+  /// Number of detections.
+  uint64_t detection_count_;
+
+  AnnotationFile(const AnnotationFile&) = delete;
+  AnnotationFile& operator=(const AnnotationFile&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_ANNOTATION_FILE_H
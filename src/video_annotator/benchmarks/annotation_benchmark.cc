@@ -0,0 +1,224 @@
+/// @file
+/// @brief Measures loading and saving annotation files.
+///
+/// Annotation files with a given number of synthetic detections are
+/// written in the format of VideoAnnotation::write, then loaded and
+/// saved through a property tree as the annotator used to and by
+/// VideoAnnotation::read and VideoAnnotation::write.  Reading the file
+/// again is timed separately, as it then opens the binary cache, along
+/// with the first lookup of a frame and the decoding of all detections.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "annotation_file.h"
+#include "video_annotation.h"
+
+namespace {
+
+using namespace tator::video_annotator;
+
+/// Number of detections in each track.
+static const uint64_t kTrackLength = 100;
+
+/// Frames between the starts of consecutive tracks.
+static const uint64_t kTrackSpacing = 10;
+
+/// Number of detections above which the property tree is not timed.
+static const uint64_t kMaxTreeDetections = 1000000;
+
+/// Returns the number of frames spanned by a number of tracks.
+uint64_t frameCount(uint64_t tracks) {
+  return tracks * kTrackSpacing + kTrackLength;
+}
+
+/// Writes an annotation file with tracks that overlap in time.
+bool writeFile(const QString &path, uint64_t tracks) {
+  FILE *out = std::fopen(path.toLocal8Bit().constData(), "wb");
+  if(out == nullptr) {
+    return false;
+  }
+  std::fprintf(out, "{\n    \"tracks\": [\n");
+  for(uint64_t t = 0; t < tracks; ++t) {
+    std::fprintf(out,
+        "        {\n"
+        "            \"id\": \"%llu\",\n"
+        "            \"species\": \"species %llu\",\n"
+        "            \"subspecies\": \"\",\n"
+        "            \"frame_added\": \"%llu\",\n"
+        "            \"count_label\": \"ignore\"\n"
+        "        }%s\n",
+        static_cast<unsigned long long>(t),
+        static_cast<unsigned long long>(t % 8),
+        static_cast<unsigned long long>(t * kTrackSpacing),
+        t + 1 < tracks ? "," : "");
+  }
+  std::fprintf(out, "    ],\n    \"detections\": [\n");
+  const uint64_t frames = frameCount(tracks);
+  bool first = true;
+  for(uint64_t f = 0; f < frames; ++f) {
+    uint64_t t = 0;
+    if(f >= kTrackLength) {
+      t = (f - kTrackLength) / kTrackSpacing + 1;
+    }
+    for(; t < tracks && t * kTrackSpacing <= f; ++t) {
+      std::fprintf(out,
+          "%s"
+          "        {\n"
+          "            \"frame\": \"%llu\",\n"
+          "            \"id\": \"%llu\",\n"
+          "            \"x\": \"%llu\",\n"
+          "            \"y\": \"%llu\",\n"
+          "            \"w\": \"64\",\n"
+          "            \"h\": \"48\",\n"
+          "            \"type\": \"box\",\n"
+          "            \"species\": \"species %llu\",\n"
+          "            \"prob\": \"0.%llu\"\n"
+          "        }",
+          first == true ? "" : ",\n",
+          static_cast<unsigned long long>(f),
+          static_cast<unsigned long long>(t),
+          static_cast<unsigned long long>((f - t * kTrackSpacing) * 8),
+          static_cast<unsigned long long>(t % 720),
+          static_cast<unsigned long long>(t % 8),
+          static_cast<unsigned long long>(f % 1000));
+      first = false;
+    }
+  }
+  std::fprintf(out, "\n    ],\n    \"global_state\": \"\"\n}\n");
+  return std::fclose(out) == 0;
+}
+
+/// Loads a file through a property tree and inserts each detection.
+void readTree(const QString &path, VideoAnnotation &annotation) {
+  pt::ptree tree;
+  pt::read_json(path.toStdString(), tree);
+  for(auto &t : tree.get_child("tracks")) {
+    std::shared_ptr<TrackAnnotation> track(new TrackAnnotation);
+    track->read(t.second);
+    annotation.insert(track);
+  }
+  for(auto &d : tree.get_child("detections")) {
+    std::shared_ptr<DetectionAnnotation> detection(new DetectionAnnotation);
+    detection->read(d.second);
+    annotation.insert(detection);
+  }
+}
+
+/// Saves annotations through a property tree.
+void writeTree(
+    const QString &path,
+    uint64_t frames,
+    VideoAnnotation &annotation) {
+  pt::ptree tree;
+  pt::ptree tracks;
+  pt::ptree detections;
+  for(uint64_t id : annotation.getTrackIDs()) {
+    tracks.push_back(std::make_pair("", annotation.findTrack(id)->write()));
+  }
+  for(uint64_t f = 0; f < frames; ++f) {
+    for(const auto &d : annotation.getDetectionAnnotationsByFrame(f)) {
+      detections.push_back(std::make_pair("", d->write()));
+    }
+  }
+  tree.add_child("tracks", tracks);
+  tree.add_child("detections", detections);
+  tree.add_child("global_state", pt::ptree());
+  pt::write_json(path.toStdString(), tree);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  QApplication app(argc, argv);
+  std::vector<uint64_t> sizes;
+  for(int i = 1; i < argc; ++i) {
+    sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+  }
+  if(sizes.empty() == true) {
+    sizes = {100000, 1000000, 10000000};
+  }
+  const QString path = QDir::temp().filePath("annotation_benchmark.json");
+  const QString saved = QDir::temp().filePath("annotation_saved.json");
+  std::printf("%12s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+      "detections", "size (MB)", "tree load", "read", "tree save", "write",
+      "cached", "frame", "all");
+  for(uint64_t size : sizes) {
+    const uint64_t tracks = std::max<uint64_t>(size / kTrackLength, 1);
+    const uint64_t frames = frameCount(tracks);
+    if(writeFile(path, tracks) == false) {
+      std::fprintf(stderr, "Could not write %s!\n", path.toUtf8().constData());
+      return 1;
+    }
+    const double megabytes = QFileInfo(path).size() / 1.0e6;
+    const bool with_tree = tracks * kTrackLength <= kMaxTreeDetections;
+    QElapsedTimer timer;
+    double tree_load_ms = 0.0;
+    double tree_save_ms = 0.0;
+    std::unique_ptr<VideoAnnotation> expected;
+    if(with_tree == true) {
+      expected.reset(new VideoAnnotation);
+      expected->setVideoLength(frames);
+      timer.start();
+      readTree(path, *expected);
+      tree_load_ms = timer.nsecsElapsed() / 1.0e6;
+      timer.start();
+      writeTree(saved, frames, *expected);
+      tree_save_ms = timer.nsecsElapsed() / 1.0e6;
+    }
+    VideoAnnotation annotation;
+    annotation.setVideoLength(frames);
+    timer.start();
+    annotation.read(path.toStdString());
+    const double read_ms = timer.nsecsElapsed() / 1.0e6;
+    if(expected != nullptr && *expected != annotation) {
+      std::fprintf(stderr, "Loaded annotations differ!\n");
+      return 1;
+    }
+    timer.start();
+    annotation.write(saved.toStdString(), "1", "1", "benchmark", "Open",
+        30.0, true);
+    const double write_ms = timer.nsecsElapsed() / 1.0e6;
+    VideoAnnotation reloaded;
+    reloaded.setVideoLength(frames);
+    timer.start();
+    reloaded.read(saved.toStdString());
+    const double cached_ms = timer.nsecsElapsed() / 1.0e6;
+    timer.start();
+    reloaded.getDetectionAnnotationsByFrame(frames / 2);
+    const double frame_ms = timer.nsecsElapsed() / 1.0e6;
+    timer.start();
+    if(reloaded != annotation) {
+      std::fprintf(stderr, "Saved annotations differ!\n");
+      return 1;
+    }
+    const double all_ms = timer.nsecsElapsed() / 1.0e6;
+    QFile::remove(AnnotationFile::cachePath(path));
+    QFile::remove(AnnotationFile::cachePath(saved));
+    if(with_tree == true) {
+      std::printf("%12llu %10.1f %10.1f %10.1f %10.1f %10.1f",
+          static_cast<unsigned long long>(tracks * kTrackLength),
+          megabytes, tree_load_ms, read_ms, tree_save_ms, write_ms);
+    }
+    else {
+      std::printf("%12llu %10.1f %10s %10.1f %10s %10.1f",
+          static_cast<unsigned long long>(tracks * kTrackLength),
+          megabytes, "-", read_ms, "-", write_ms);
+    }
+    std::printf(" %10.1f %10.3f %10.1f\n", cached_ms, frame_ms, all_ms);
+  }
+  QFile::remove(saved);
+  QFile::remove(QDir::temp().filePath("annotation_saved.csv"));
+  QFile::remove(path);
+  return 0;
+}
@@ -0,0 +1,273 @@
+/// @file
+/// @brief Measures per frame cost of converting decoded frames to images.
+///
+/// Compares the previous conversion (swscale to an intermediate RGB24
+/// frame followed by a per pixel copy into the image) against swscale
+/// directly into the image buffer and each kernel the CPU supports, the
+/// fastest of which FrameConverter uses for unscaled frames.
+///
+/// With --check, instead verifies every supported kernel against the
+/// scalar kernel (exact) and against swscale (within kTolerance levels)
+/// over odd and even frame sizes, returning non-zero on a mismatch.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QImage>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libswscale/swscale.h>
+}
+
+#include "yuv_convert.h"
+
+namespace {
+
+using namespace tator::video_annotator;
+
+/// Largest allowed difference from swscale per channel.  swscale rounds
+/// its coefficients differently, so results are close but not equal.
+static const int kTolerance = 3;
+
+/// Kernels in order of preference.
+static const YuvKernel kKernels[] = {
+  kScalarKernel, kSse41Kernel, kAvx2Kernel};
+
+/// Allocates a frame filled with a gradient, or with noise if random is
+/// true so every combination of luma and chroma gets exercised.
+AVFrame *makeFrame(
+    int width,
+    int height,
+    AVPixelFormat format = AV_PIX_FMT_YUV420P,
+    bool random = false) {
+  AVFrame *frame = av_frame_alloc();
+  frame->format = format;
+  frame->width = width;
+  frame->height = height;
+  av_frame_get_buffer(frame, 32);
+  std::srand(width * 31 + height);
+  for(int y = 0; y < height; ++y) {
+    uint8_t *row = frame->data[0] + y * frame->linesize[0];
+    for(int x = 0; x < width; ++x) {
+      row[x] = static_cast<uint8_t>(random ? std::rand() : x + y);
+    }
+  }
+  const int chroma_width = (width + 1) / 2;
+  const int chroma_height = (height + 1) / 2;
+  const int planes = format == AV_PIX_FMT_NV12 ? 1 : 2;
+  const int step = format == AV_PIX_FMT_NV12 ? 2 : 1;
+  for(int p = 1; p <= planes; ++p) {
+    for(int y = 0; y < chroma_height; ++y) {
+      uint8_t *row = frame->data[p] + y * frame->linesize[p];
+      for(int x = 0; x < chroma_width * step; ++x) {
+        row[x] = static_cast<uint8_t>(random ? std::rand() : p * 64 + x);
+      }
+    }
+  }
+  return frame;
+}
+
+/// Previous conversion path, returns milliseconds per frame.
+double legacyConvert(const AVFrame *frame, int iterations) {
+  const int width = frame->width;
+  const int height = frame->height;
+  SwsContext *sws_context = sws_getContext(
+    width, height, AV_PIX_FMT_YUV420P,
+    width, height, AV_PIX_FMT_RGB24,
+    SWS_BICUBIC, nullptr, nullptr, nullptr);
+  AVFrame *frame_rgb = av_frame_alloc();
+  av_image_alloc(
+      frame_rgb->data,
+      frame_rgb->linesize,
+      width,
+      height,
+      AV_PIX_FMT_RGB24,
+      1);
+  QImage image(width, height, QImage::Format_RGB32);
+  QElapsedTimer timer;
+  timer.start();
+  for(int i = 0; i < iterations; ++i) {
+    sws_scale(
+        sws_context,
+        frame->data,
+        frame->linesize,
+        0,
+        height,
+        frame_rgb->data,
+        frame_rgb->linesize);
+    uint8_t *src = (uint8_t*)(frame_rgb->data[0]);
+    for(int y = 0; y < height; ++y) {
+      QRgb *scan_line = (QRgb*)image.scanLine(y);
+      for(int x = 0; x < width; ++x) {
+        scan_line[x] = qRgb(src[3*x], src[3*x+1], src[3*x+2]);
+      }
+      src += frame_rgb->linesize[0];
+    }
+  }
+  double elapsed = timer.nsecsElapsed() / 1.0e6 / iterations;
+  av_freep(&frame_rgb->data[0]);
+  av_frame_free(&frame_rgb);
+  sws_freeContext(sws_context);
+  return elapsed;
+}
+
+/// Converts a frame with swscale directly into an image.
+QImage swscaleImage(const AVFrame *frame) {
+  SwsContext *sws_context = sws_getContext(
+    frame->width, frame->height,
+    static_cast<AVPixelFormat>(frame->format),
+    frame->width, frame->height, AV_PIX_FMT_RGB32,
+    SWS_BICUBIC, nullptr, nullptr, nullptr);
+  QImage image(frame->width, frame->height, QImage::Format_RGB32);
+  uint8_t *dst[4] = {image.bits(), nullptr, nullptr, nullptr};
+  int dst_linesize[4] = {image.bytesPerLine(), 0, 0, 0};
+  sws_scale(
+      sws_context,
+      frame->data,
+      frame->linesize,
+      0,
+      frame->height,
+      dst,
+      dst_linesize);
+  sws_freeContext(sws_context);
+  return image;
+}
+
+/// Converts a frame with a kernel.
+QImage kernelImage(const AVFrame *frame, YuvKernel kernel) {
+  QImage image(frame->width, frame->height, QImage::Format_RGB32);
+  convertYuv(frame, image.bits(), image.bytesPerLine(), kernel);
+  return image;
+}
+
+/// Swscale conversion into the image, returns milliseconds per frame.
+double swscaleConvert(const AVFrame *frame, int iterations) {
+  SwsContext *sws_context = sws_getContext(
+    frame->width, frame->height,
+    static_cast<AVPixelFormat>(frame->format),
+    frame->width, frame->height, AV_PIX_FMT_RGB32,
+    SWS_BICUBIC, nullptr, nullptr, nullptr);
+  QElapsedTimer timer;
+  timer.start();
+  for(int i = 0; i < iterations; ++i) {
+    QImage image(frame->width, frame->height, QImage::Format_RGB32);
+    uint8_t *dst[4] = {image.bits(), nullptr, nullptr, nullptr};
+    int dst_linesize[4] = {image.bytesPerLine(), 0, 0, 0};
+    sws_scale(
+        sws_context,
+        frame->data,
+        frame->linesize,
+        0,
+        frame->height,
+        dst,
+        dst_linesize);
+  }
+  double elapsed = timer.nsecsElapsed() / 1.0e6 / iterations;
+  sws_freeContext(sws_context);
+  return elapsed;
+}
+
+/// Kernel conversion into the image, returns milliseconds per frame.
+double kernelConvert(const AVFrame *frame, YuvKernel kernel, int iterations) {
+  QElapsedTimer timer;
+  timer.start();
+  for(int i = 0; i < iterations; ++i) {
+    QImage image = kernelImage(frame, kernel);
+  }
+  return timer.nsecsElapsed() / 1.0e6 / iterations;
+}
+
+/// Returns the largest channel difference between two images.
+int maxDifference(const QImage &a, const QImage &b) {
+  int max_diff = 0;
+  for(int y = 0; y < a.height(); ++y) {
+    const uint8_t *row_a = a.constScanLine(y);
+    const uint8_t *row_b = b.constScanLine(y);
+    for(int x = 0; x < 4 * a.width(); ++x) {
+      const int diff = std::abs(row_a[x] - row_b[x]);
+      max_diff = diff > max_diff ? diff : max_diff;
+    }
+  }
+  return max_diff;
+}
+
+/// Checks kernels against swscale and the scalar kernel.
+bool check() {
+  const int sizes[][2] = {
+    {1920, 1080}, {3840, 2160}, {642, 362}, {33, 17}, {1, 1}};
+  const AVPixelFormat formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12};
+  bool ok = true;
+  std::printf("%-10s %-8s %-7s %10s %10s\n",
+      "size", "format", "kernel", "vs scalar", "vs sws");
+  for(const auto &size : sizes) {
+    for(AVPixelFormat format : formats) {
+      AVFrame *frame = makeFrame(size[0], size[1], format, true);
+      const QImage reference = swscaleImage(frame);
+      const QImage scalar = kernelImage(frame, kScalarKernel);
+      for(YuvKernel kernel : kKernels) {
+        if(yuvKernelSupported(kernel) == false) {
+          continue;
+        }
+        const QImage image = kernelImage(frame, kernel);
+        const int exact = maxDifference(image, scalar);
+        const int close = maxDifference(image, reference);
+        const bool pass = exact == 0 && close <= kTolerance;
+        ok = ok && pass;
+        std::printf("%4dx%-5d %-8s %-7s %10d %10d%s\n",
+            size[0], size[1],
+            format == AV_PIX_FMT_NV12 ? "nv12" : "yuv420p",
+            yuvKernelName(kernel),
+            exact, close,
+            pass ? "" : "  FAIL");
+      }
+      av_frame_free(&frame);
+    }
+  }
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if(argc > 1 && std::strcmp(argv[1], "--check") == 0) {
+    return check() ? 0 : 1;
+  }
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 50;
+  if(iterations <= 0) {
+    std::fprintf(stderr, "Usage: %s [iterations | --check]\n", argv[0]);
+    return 1;
+  }
+  const int sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  std::printf("%-10s %-8s %-7s %10s %8s\n",
+      "size", "format", "path", "ms/frame", "speedup");
+  for(const auto &size : sizes) {
+    AVFrame *frame = makeFrame(size[0], size[1]);
+    double legacy = legacyConvert(frame, iterations);
+    std::printf("%4dx%-5d %-8s %-7s %10.3f %7.2fx\n",
+        size[0], size[1], "yuv420p", "legacy", legacy, 1.0);
+    av_frame_free(&frame);
+    for(AVPixelFormat format : {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12}) {
+      frame = makeFrame(size[0], size[1], format);
+      const char *name = format == AV_PIX_FMT_NV12 ? "nv12" : "yuv420p";
+      double sws = swscaleConvert(frame, iterations);
+      std::printf("%4dx%-5d %-8s %-7s %10.3f %7.2fx\n",
+          size[0], size[1], name, "swscale", sws, legacy / sws);
+      for(YuvKernel kernel : kKernels) {
+        if(yuvKernelSupported(kernel) == false) {
+          continue;
+        }
+        double ms = kernelConvert(frame, kernel, iterations);
+        std::printf("%4dx%-5d %-8s %-7s %10.3f %7.2fx\n",
+            size[0], size[1], name, yuvKernelName(kernel), ms, legacy / ms);
+      }
+      av_frame_free(&frame);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,158 @@
+/// @file
+/// @brief Measures decode throughput and seek latency per thread count.
+///
+/// Frame threading raises throughput but delays the first picture after
+/// a seek by one packet per extra thread, so both are reported.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <QElapsedTimer>
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+}
+
+#include "decoder_threads.h"
+
+namespace {
+
+using namespace tator::video_annotator;
+
+/// Results for one thread count.
+struct Result {
+  int threads; ///< Threads used by the decoder.
+  int delay; ///< Frame threading delay in packets.
+  qint64 frames; ///< Number of frames decoded.
+  double fps; ///< Frames decoded per second.
+  double seek_ms; ///< Milliseconds from seek to first picture.
+  int seek_packets; ///< Packets sent from seek to first picture.
+};
+
+/// Decodes up to max_frames frames, then seeks to the middle of the
+/// video and times the first picture.
+bool run(const char *filename, int threads, qint64 max_frames, Result &result) {
+  AVFormatContext *format_context = nullptr;
+  if(avformat_open_input(&format_context, filename, nullptr, nullptr) != 0) {
+    return false;
+  }
+  if(avformat_find_stream_info(format_context, nullptr) < 0) {
+    avformat_close_input(&format_context);
+    return false;
+  }
+  int stream_index = av_find_best_stream(
+      format_context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  if(stream_index < 0) {
+    avformat_close_input(&format_context);
+    return false;
+  }
+  AVStream *stream = format_context->streams[stream_index];
+  AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+  AVCodecContext *codec_context = avcodec_alloc_context3(codec);
+  avcodec_parameters_to_context(codec_context, stream->codecpar);
+  setDecoderThreads(threads);
+  configureDecoderThreads(codec_context);
+  if(avcodec_open2(codec_context, codec, nullptr) < 0) {
+    avcodec_free_context(&codec_context);
+    avformat_close_input(&format_context);
+    return false;
+  }
+  result.threads = codec_context->thread_count;
+  result.delay = frameThreadDelay(codec_context);
+  AVFrame *frame = av_frame_alloc();
+  AVPacket packet;
+  av_init_packet(&packet);
+  packet.data = nullptr;
+  packet.size = 0;
+  result.frames = 0;
+  QElapsedTimer timer;
+  timer.start();
+  qint64 last_dts = 0;
+  while(result.frames < max_frames) {
+    av_packet_unref(&packet);
+    if(av_read_frame(format_context, &packet) < 0) {
+      break;
+    }
+    if(packet.stream_index != stream_index) {
+      continue;
+    }
+    last_dts = packet.dts;
+    avcodec_send_packet(codec_context, &packet);
+    while(avcodec_receive_frame(codec_context, frame) == 0) {
+      ++result.frames;
+    }
+  }
+  result.fps = result.frames * 1.0e9 / timer.nsecsElapsed();
+  // Seek latency, measured from the middle of the decoded range.
+  av_seek_frame(
+      format_context,
+      stream_index,
+      last_dts / 2,
+      AVSEEK_FLAG_BACKWARD);
+  avcodec_flush_buffers(codec_context);
+  result.seek_packets = 0;
+  timer.restart();
+  bool got_frame = false;
+  while(got_frame == false) {
+    av_packet_unref(&packet);
+    if(av_read_frame(format_context, &packet) < 0) {
+      break;
+    }
+    if(packet.stream_index != stream_index) {
+      continue;
+    }
+    ++result.seek_packets;
+    avcodec_send_packet(codec_context, &packet);
+    got_frame = avcodec_receive_frame(codec_context, frame) == 0;
+  }
+  result.seek_ms = timer.nsecsElapsed() / 1.0e6;
+  av_packet_unref(&packet);
+  av_frame_free(&frame);
+  avcodec_free_context(&codec_context);
+  avformat_close_input(&format_context);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if(argc < 2) {
+    std::fprintf(stderr,
+        "Usage: %s video [frames] [threads...]\n"
+        "Thread count 0 picks a count based on available cores.\n",
+        argv[0]);
+    return 1;
+  }
+  av_register_all();
+  qint64 max_frames = argc > 2 ? std::atoll(argv[2]) : 1000;
+  std::vector<int> thread_counts;
+  for(int i = 3; i < argc; ++i) {
+    thread_counts.push_back(std::atoi(argv[i]));
+  }
+  if(thread_counts.empty()) {
+    thread_counts = {1, 2, 4, 8, 0};
+  }
+  std::printf("%8s %6s %8s %10s %10s %13s\n",
+      "threads", "delay", "frames", "fps", "seek (ms)", "seek packets");
+  for(int threads : thread_counts) {
+    Result result;
+    if(run(argv[1], threads, max_frames, result) == false) {
+      std::fprintf(stderr, "Could not decode %s!\n", argv[1]);
+      return 1;
+    }
+    std::printf("%8d %6d %8lld %10.1f %10.2f %13d\n",
+        result.threads,
+        result.delay,
+        static_cast<long long>(result.frames),
+        result.fps,
+        result.seek_ms,
+        result.seek_packets);
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+/// @file
+/// @brief Measures demuxing from a simulated network mount.
+///
+/// A local video is read through a source that delays every read by a
+/// fixed latency, as on an SMB or NFS share.  The demuxer is run with
+/// reads passed straight to the source and with read-ahead, timing open,
+/// a sequential pass over the packets and random seeks.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <QElapsedTimer>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "block_source.h"
+#include "read_ahead_io.h"
+
+namespace {
+
+using namespace tator::video_annotator;
+
+/// Results for one input mode.
+struct Result {
+  double open_ms; ///< Milliseconds to open and find stream info.
+  qint64 packets; ///< Number of packets read.
+  double read_ms; ///< Milliseconds to read the packets.
+  double seek_ms; ///< Mean milliseconds from seek to first packet.
+  qint64 stalls; ///< Reads that waited for a block.
+};
+
+/// Demuxes a video through a delayed source.
+bool run(
+    const char *filename,
+    int latency,
+    bool read_ahead,
+    qint64 max_packets,
+    int seeks,
+    Result &result) {
+  MappedSource *mapped = new MappedSource;
+  std::unique_ptr<BlockSource> source(mapped);
+  if(mapped->open(filename) == false) {
+    return false;
+  }
+  source.reset(new LatencySource(std::move(source), latency));
+  ReadAheadIO io;
+  if(io.open(std::move(source), read_ahead) == false) {
+    return false;
+  }
+  AVFormatContext *format_context = avformat_alloc_context();
+  format_context->pb = io.context();
+  format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+  QElapsedTimer timer;
+  timer.start();
+  if(avformat_open_input(&format_context, filename, nullptr, nullptr) != 0) {
+    return false;
+  }
+  if(avformat_find_stream_info(format_context, nullptr) < 0) {
+    avformat_close_input(&format_context);
+    return false;
+  }
+  result.open_ms = timer.nsecsElapsed() / 1.0e6;
+  const int stream_index = av_find_best_stream(
+      format_context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  if(stream_index < 0) {
+    avformat_close_input(&format_context);
+    return false;
+  }
+  AVPacket packet;
+  av_init_packet(&packet);
+  packet.data = nullptr;
+  packet.size = 0;
+  qint64 first_dts = AV_NOPTS_VALUE;
+  qint64 last_dts = 0;
+  result.packets = 0;
+  timer.restart();
+  while(result.packets < max_packets) {
+    av_packet_unref(&packet);
+    if(av_read_frame(format_context, &packet) < 0) {
+      break;
+    }
+    if(packet.stream_index != stream_index) {
+      continue;
+    }
+    if(packet.dts != AV_NOPTS_VALUE) {
+      first_dts = first_dts == AV_NOPTS_VALUE ? packet.dts : first_dts;
+      last_dts = packet.dts;
+    }
+    ++result.packets;
+  }
+  result.read_ms = timer.nsecsElapsed() / 1.0e6;
+  first_dts = first_dts == AV_NOPTS_VALUE ? 0 : first_dts;
+  std::srand(1);
+  timer.restart();
+  for(int i = 0; i < seeks; ++i) {
+    const qint64 target = first_dts + static_cast<qint64>(
+        (last_dts - first_dts) * (std::rand() / static_cast<double>(RAND_MAX)));
+    av_seek_frame(format_context, stream_index, target, AVSEEK_FLAG_BACKWARD);
+    while(true) {
+      av_packet_unref(&packet);
+      if(av_read_frame(format_context, &packet) < 0 ||
+          packet.stream_index == stream_index) {
+        break;
+      }
+    }
+  }
+  result.seek_ms = seeks > 0 ? timer.nsecsElapsed() / 1.0e6 / seeks : 0.0;
+  result.stalls = io.stalls();
+  av_packet_unref(&packet);
+  avformat_close_input(&format_context);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if(argc < 2) {
+    std::fprintf(stderr,
+        "Usage: %s video [latency ms] [packets] [seeks]\n", argv[0]);
+    return 1;
+  }
+  av_register_all();
+  const int latency = argc > 2 ? std::atoi(argv[2]) : 20;
+  const qint64 max_packets = argc > 3 ? std::atoll(argv[3]) : 2000;
+  const int seeks = argc > 4 ? std::atoi(argv[4]) : 20;
+  std::printf("%-11s %10s %8s %10s %10s %8s\n",
+      "input", "open (ms)", "packets", "read (ms)", "seek (ms)", "stalls");
+  for(bool read_ahead : {false, true}) {
+    Result result;
+    if(run(argv[1], latency, read_ahead, max_packets, seeks, result) == false) {
+      std::fprintf(stderr, "Could not demux %s!\n", argv[1]);
+      return 1;
+    }
+    std::printf("%-11s %10.1f %8lld %10.1f %10.1f %8lld\n",
+        read_ahead ? "read-ahead" : "direct",
+        result.open_ms,
+        static_cast<long long>(result.packets),
+        result.read_ms,
+        result.seek_ms,
+        static_cast<long long>(result.stalls));
+  }
+  return 0;
+}
@@ -0,0 +1,387 @@
+/// @file
+/// @brief Measures Player load, seek, step and playback performance.
+///
+/// Encodes synthetic test videos with different resolutions, GOP lengths
+/// and B-frame settings, then drives Player without a display and writes
+/// the timings to a JSON file so results can be compared across releases.
+/// Videos are encoded with the MPEG-4 part 2 encoder, which is built into
+/// every libavcodec and supports both GOP length and B-frames.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+}
+
+#include "decoder_threads.h"
+#include "frame_index.h"
+#include "player.h"
+
+namespace {
+
+using namespace tator::video_annotator;
+
+/// Parameters of a synthetic test video.
+struct VideoConfig {
+  const char *name; ///< Name used for the file and in the results.
+  int width; ///< Frame width.
+  int height; ///< Frame height.
+  int gop; ///< Frames between keyframes.
+  int b_frames; ///< Maximum consecutive B-frames.
+  int frames; ///< Number of frames.
+};
+
+/// Test videos.
+static const VideoConfig kConfigs[] = {
+  {"360p_gop12_b0", 640, 360, 12, 0, 600},
+  {"720p_gop30_b2", 1280, 720, 30, 2, 600},
+  {"1080p_gop60_b2", 1920, 1080, 60, 2, 600},
+  {"1080p_gop250_b3", 1920, 1080, 250, 3, 600}
+};
+
+/// Frame rate of the test videos.
+static const int kFrameRate = 30;
+
+/// Number of random seeks per video.
+static const int kSeeks = 100;
+
+/// Number of single steps per direction per video.
+static const int kSteps = 50;
+
+/// Longest time to wait for a signal in milliseconds.
+static const int kTimeoutMsec = 120000;
+
+/// Fills a YUV420P frame with a pattern that moves with the frame number.
+void fillFrame(AVFrame *frame, int index) {
+  for(int y = 0; y < frame->height; ++y) {
+    uint8_t *row = frame->data[0] + y * frame->linesize[0];
+    for(int x = 0; x < frame->width; ++x) {
+      row[x] = static_cast<uint8_t>(x + y + index * 3);
+    }
+  }
+  for(int p = 1; p < 3; ++p) {
+    for(int y = 0; y < frame->height / 2; ++y) {
+      uint8_t *row = frame->data[p] + y * frame->linesize[p];
+      for(int x = 0; x < frame->width / 2; ++x) {
+        row[x] = static_cast<uint8_t>(128 + p * y + index);
+      }
+    }
+  }
+}
+
+/// Writes all packets the encoder has ready to the output.
+bool writePackets(
+    AVCodecContext *codec_context,
+    AVFormatContext *format_context,
+    AVStream *stream) {
+  AVPacket packet;
+  av_init_packet(&packet);
+  packet.data = nullptr;
+  packet.size = 0;
+  while(true) {
+    int status = avcodec_receive_packet(codec_context, &packet);
+    if(status == AVERROR(EAGAIN) || status == AVERROR_EOF) {
+      return true;
+    }
+    if(status < 0) {
+      return false;
+    }
+    av_packet_rescale_ts(
+        &packet, codec_context->time_base, stream->time_base);
+    packet.stream_index = stream->index;
+    status = av_interleaved_write_frame(format_context, &packet);
+    av_packet_unref(&packet);
+    if(status < 0) {
+      return false;
+    }
+  }
+}
+
+/// Encodes a test video.
+bool generateVideo(const QString &path, const VideoConfig &config) {
+  const std::string filename = path.toStdString();
+  AVFormatContext *format_context = nullptr;
+  avformat_alloc_output_context2(
+      &format_context, nullptr, nullptr, filename.c_str());
+  if(format_context == nullptr) {
+    return false;
+  }
+  AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+  AVStream *stream = avformat_new_stream(format_context, nullptr);
+  AVCodecContext *codec_context = avcodec_alloc_context3(codec);
+  codec_context->width = config.width;
+  codec_context->height = config.height;
+  codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
+  codec_context->time_base = {1, kFrameRate};
+  codec_context->framerate = {kFrameRate, 1};
+  codec_context->gop_size = config.gop;
+  codec_context->max_b_frames = config.b_frames;
+  codec_context->bit_rate = 8LL * config.width * config.height;
+  if(format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+    codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  }
+  bool ok =
+    avcodec_open2(codec_context, codec, nullptr) == 0 &&
+    avcodec_parameters_from_context(stream->codecpar, codec_context) >= 0;
+  stream->time_base = codec_context->time_base;
+  stream->avg_frame_rate = codec_context->framerate;
+  ok = ok && avio_open(
+      &format_context->pb, filename.c_str(), AVIO_FLAG_WRITE) >= 0;
+  ok = ok && avformat_write_header(format_context, nullptr) >= 0;
+  AVFrame *frame = av_frame_alloc();
+  frame->format = codec_context->pix_fmt;
+  frame->width = config.width;
+  frame->height = config.height;
+  ok = ok && av_frame_get_buffer(frame, 32) == 0;
+  for(int i = 0; ok == true && i < config.frames; ++i) {
+    ok = av_frame_make_writable(frame) == 0;
+    fillFrame(frame, i);
+    frame->pts = i;
+    ok = ok &&
+      avcodec_send_frame(codec_context, frame) == 0 &&
+      writePackets(codec_context, format_context, stream);
+  }
+  ok = ok &&
+    avcodec_send_frame(codec_context, nullptr) == 0 &&
+    writePackets(codec_context, format_context, stream) &&
+    av_write_trailer(format_context) == 0;
+  av_frame_free(&frame);
+  avcodec_free_context(&codec_context);
+  if(format_context->pb != nullptr) {
+    avio_closep(&format_context->pb);
+  }
+  avformat_free_context(format_context);
+  return ok;
+}
+
+/// Runs the event loop until a player signal is emitted.
+///
+/// The signal may also be emitted directly from within start.
+///
+/// @param start Called after the loop is set up, starts the operation.
+/// @return Milliseconds until the signal, negative on timeout.
+template<typename Signal, typename Start>
+double waitFor(Player &player, Signal signal, Start start) {
+  QEventLoop loop;
+  QTimer timeout;
+  timeout.setSingleShot(true);
+  QElapsedTimer timer;
+  double msec = -1.0;
+  QMetaObject::Connection done = QObject::connect(&player, signal, [&]() {
+    if(msec < 0.0) {
+      msec = timer.nsecsElapsed() / 1.0e6;
+    }
+    loop.quit();
+  });
+  QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+  timeout.start(kTimeoutMsec);
+  timer.start();
+  start();
+  if(msec < 0.0) {
+    loop.exec();
+  }
+  QObject::disconnect(done);
+  return msec;
+}
+
+/// Returns a percentile of a set of samples.
+double percentile(std::vector<double> samples, double p) {
+  if(samples.empty()) {
+    return 0.0;
+  }
+  std::sort(samples.begin(), samples.end());
+  std::size_t rank = static_cast<std::size_t>(p * samples.size());
+  return samples[std::min(rank, samples.size() - 1)];
+}
+
+/// Benchmarks the player on one video.
+bool run(const QString &path, const VideoConfig &config, QJsonObject &out) {
+  Player player;
+  bool failed = false;
+  QObject::connect(&player, &Player::error, [&](QString err) {
+    std::fprintf(stderr, "%s\n", err.toStdString().c_str());
+    failed = true;
+  });
+  QFile::remove(FrameIndex::cachePath(path));
+
+  // Index build time covers the whole background scan, first frame
+  // latency is measured while the scan is still running.
+  QElapsedTimer load_timer;
+  double index_ms = -1.0;
+  QObject::connect(&player, &Player::mediaIndexed, [&]() {
+    index_ms = load_timer.nsecsElapsed() / 1.0e6;
+  });
+  load_timer.start();
+  player.loadVideo(path);
+  if(failed == true) {
+    return false;
+  }
+  const double load_ms = load_timer.nsecsElapsed() / 1.0e6;
+  const double first_frame = waitFor(
+      player, &Player::processedImage, [&]() { player.setFrame(0); });
+  if(first_frame < 0.0) {
+    return false;
+  }
+  if(index_ms < 0.0 &&
+      waitFor(player, &Player::mediaIndexed, []() {}) < 0.0) {
+    return false;
+  }
+
+  // Cold random seeks, the frame cache is disabled so every seek decodes,
+  // backward ones included.
+  std::mt19937 random(1234);
+  std::uniform_int_distribution<int> uniform(0, config.frames - 1);
+  player.setFrameCacheBudget(0);
+  std::vector<double> seeks;
+  for(int i = 0; i < kSeeks; ++i) {
+    const qint64 frame = uniform(random);
+    seeks.push_back(waitFor(player, &Player::processedImage, [&]() {
+      player.setFrame(frame);
+    }));
+  }
+  player.setFrameCacheBudget(512LL * 1024 * 1024);
+
+  // Single steps from the middle of the video.
+  player.setFrame(config.frames / 2);
+  std::vector<double> forward;
+  for(int i = 0; i < kSteps; ++i) {
+    forward.push_back(waitFor(player, &Player::processedImage, [&]() {
+      player.nextFrame();
+    }));
+  }
+  std::vector<double> backward;
+  for(int i = 0; i < kSteps; ++i) {
+    backward.push_back(waitFor(player, &Player::processedImage, [&]() {
+      player.prevFrame();
+    }));
+  }
+
+  // Sustained playback from the start at a rate no decoder keeps up
+  // with, without trick play.  Dropped frames were decoded but not
+  // presented in time, so they count toward throughput.
+  player.setFrame(0);
+  player.setTrickPlaySpeed(0.0);
+  for(int i = 0; i < 5; ++i) {
+    player.speedUp();
+  }
+  qint64 presented = 0;
+  qint64 dropped = 0;
+  qint64 late = 0;
+  QMetaObject::Connection count = QObject::connect(
+      &player, &Player::processedImage, [&]() { ++presented; });
+  QObject::connect(&player, &Player::playbackStats,
+      [&](qint64 d, qint64 l) { dropped = d; late = l; });
+  double playback_ms = waitFor(player, &Player::playbackStats, [&]() {
+    player.play();
+  });
+  QObject::disconnect(count);
+  if(failed == true || playback_ms < 0.0) {
+    return false;
+  }
+
+  // Frame cache counts cover every phase since the video was loaded.
+  QJsonObject cache;
+  QObject::connect(&player, &Player::frameCacheStats,
+    [&](qint64 hits, qint64 misses, qint64 evictions, qint64 frames,
+        qint64 bytes) {
+      cache["hits"] = hits;
+      cache["misses"] = misses;
+      cache["evictions"] = evictions;
+      cache["frames"] = frames;
+      cache["bytes"] = bytes;
+    });
+  player.reportFrameCacheStats();
+
+  out["name"] = QString(config.name);
+  out["width"] = config.width;
+  out["height"] = config.height;
+  out["gop"] = config.gop;
+  out["b_frames"] = config.b_frames;
+  out["frames"] = config.frames;
+  out["index_ms"] = index_ms;
+  out["first_frame_ms"] = load_ms + first_frame;
+  out["seek_p50_ms"] = percentile(seeks, 0.5);
+  out["seek_p99_ms"] = percentile(seeks, 0.99);
+  out["step_forward_p50_ms"] = percentile(forward, 0.5);
+  out["step_forward_p99_ms"] = percentile(forward, 0.99);
+  out["step_backward_p50_ms"] = percentile(backward, 0.5);
+  out["step_backward_p99_ms"] = percentile(backward, 0.99);
+  out["playback_fps"] = (presented + dropped) * 1000.0 / playback_ms;
+  out["playback_presented"] = presented;
+  out["playback_dropped"] = dropped;
+  out["playback_late"] = late;
+  out["frame_cache"] = cache;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  // Keep frame index caches apart from the annotator's.
+  QCoreApplication::setOrganizationName("CVision AI");
+  QCoreApplication::setApplicationName("Video Annotator Benchmark");
+  if(argc < 2) {
+    std::fprintf(stderr,
+        "Usage: %s output.json [video directory]\n"
+        "Test videos are written to the video directory, by default the\n"
+        "system temporary directory.\n",
+        argv[0]);
+    return 1;
+  }
+  av_register_all();
+  QDir dir(argc > 2 ? QString(argv[2]) : QDir::tempPath());
+  QJsonArray results;
+  for(const VideoConfig &config : kConfigs) {
+    QString path = dir.filePath(QString("%1.mp4").arg(config.name));
+    if(generateVideo(path, config) == false) {
+      std::fprintf(stderr, "Could not encode %s!\n", config.name);
+      return 1;
+    }
+    QJsonObject result;
+    bool ok = run(path, config, result);
+    QFile::remove(FrameIndex::cachePath(path));
+    QFile::remove(path);
+    if(ok == false) {
+      std::fprintf(stderr, "Benchmark failed for %s!\n", config.name);
+      return 1;
+    }
+    std::printf("%-18s seek p50 %7.2f ms  p99 %7.2f ms  %7.1f fps\n",
+        config.name,
+        result["seek_p50_ms"].toDouble(),
+        result["seek_p99_ms"].toDouble(),
+        result["playback_fps"].toDouble());
+    results.append(result);
+  }
+  QJsonObject root;
+  root["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  root["decoder_threads"] = decoderThreads();
+  root["libavcodec_version"] = static_cast<int>(avcodec_version());
+  root["results"] = results;
+  QFile file(argv[1]);
+  if(file.open(QIODevice::WriteOnly) == false) {
+    std::fprintf(stderr, "Could not write %s!\n", argv[1]);
+    return 1;
+  }
+  file.write(QJsonDocument(root).toJson());
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <QStorageInfo>
+#include <QThread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "block_source.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Simulated latency in milliseconds, 0 to disable.
+  std::atomic<int> simulated_latency(0);
+
+  /// File system types of network mounts as reported by QStorageInfo.
+  static const char *kRemoteTypes[] = {
+    "cifs", "smb", "smb2", "smb3", "smbfs", "nfs", "nfs4", "afpfs",
+    "fuse.sshfs", "9p", "webdav", "davfs"};
+}
+
+MappedSource::MappedSource()
+  : file_()
+  , map_(nullptr)
+  , size_(0) {
+}
+
+bool MappedSource::open(const QString &path) {
+  file_.setFileName(path);
+  if(file_.open(QIODevice::ReadOnly) == false) {
+    return false;
+  }
+  size_ = file_.size();
+  map_ = size_ > 0 ? file_.map(0, size_) : nullptr;
+  return map_ != nullptr;
+}
+
+qint64 MappedSource::size() const {
+  return size_;
+}
+
+qint64 MappedSource::read(qint64 offset, char *data, qint64 size) {
+  if(offset < 0 || offset >= size_) {
+    return 0;
+  }
+  size = std::min(size, size_ - offset);
+  std::memcpy(data, map_ + offset, size);
+  return size;
+}
+
+FileSource::FileSource()
+  : handle_(-1)
+  , size_(0) {
+}
+
+FileSource::~FileSource() {
+  if(handle_ != -1) {
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(handle_));
+#else
+    ::close(static_cast<int>(handle_));
+#endif
+  }
+}
+
+bool FileSource::open(const QString &path) {
+#ifdef _WIN32
+  HANDLE handle = CreateFileW(
+      reinterpret_cast<const wchar_t*>(path.utf16()),
+      GENERIC_READ,
+      FILE_SHARE_READ | FILE_SHARE_WRITE,
+      nullptr,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      nullptr);
+  if(handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if(GetFileSizeEx(handle, &size) == 0) {
+    CloseHandle(handle);
+    return false;
+  }
+  handle_ = reinterpret_cast<qintptr>(handle);
+  size_ = size.QuadPart;
+#else
+  int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if(fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+  handle_ = fd;
+  size_ = info.st_size;
+#endif
+  return true;
+}
+
+qint64 FileSource::size() const {
+  return size_;
+}
+
+qint64 FileSource::read(qint64 offset, char *data, qint64 size) {
+  if(handle_ == -1) {
+    return -1;
+  }
+  qint64 total = 0;
+  while(total < size && offset + total < size_) {
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    std::memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = static_cast<DWORD>(offset + total);
+    overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+    DWORD count = 0;
+    if(ReadFile(
+          reinterpret_cast<HANDLE>(handle_),
+          data + total,
+          static_cast<DWORD>(std::min<qint64>(size - total, 1 << 30)),
+          &count,
+          &overlapped) == 0) {
+      return -1;
+    }
+#else
+    ssize_t count = pread(
+        static_cast<int>(handle_),
+        data + total,
+        size - total,
+        offset + total);
+    if(count < 0) {
+      return -1;
+    }
+#endif
+    if(count == 0) {
+      break;
+    }
+    total += count;
+  }
+  return total;
+}
+
+LatencySource::LatencySource(std::unique_ptr<BlockSource> source, int latency)
+  : source_(std::move(source))
+  , latency_(latency) {
+}
+
+qint64 LatencySource::size() const {
+  return source_->size();
+}
+
+qint64 LatencySource::read(qint64 offset, char *data, qint64 size) {
+  QThread::msleep(latency_);
+  return source_->read(offset, data, size);
+}
+
+bool isRemotePath(const QString &path) {
+  // UNC paths such as //server/share or \\server\share.
+  if(path.startsWith("//") || path.startsWith("\\\\")) {
+    return true;
+  }
+  const QByteArray type = QStorageInfo(path).fileSystemType().toLower();
+  for(const char *remote : kRemoteTypes) {
+    if(type == remote) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void setSimulatedLatency(int latency) {
+  simulated_latency = latency < 0 ? 0 : latency;
+}
+
+int simulatedLatency() {
+  return simulated_latency;
+}
+
+}} // namespace tator::video_annotator
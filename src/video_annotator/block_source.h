@@ -0,0 +1,127 @@
+/// @file
+/// @brief Defines random access byte sources for reading videos.
+
+#ifndef VIDEO_ANNOTATOR_BLOCK_SOURCE_H
+#define VIDEO_ANNOTATOR_BLOCK_SOURCE_H
+
+#include <memory>
+
+#include <QFile>
+#include <QString>
+
+namespace tator { namespace video_annotator {
+
+/// Random access source of bytes.
+///
+/// Reads are positional and safe to issue from several threads at once,
+/// so a slow source can have several reads in flight.
+class BlockSource {
+public:
+  /// Destructor.
+  virtual ~BlockSource() {}
+
+  /// Returns the size in bytes.
+  virtual qint64 size() const = 0;
+
+  /// Reads bytes at an offset.
+  ///
+  /// @param offset Offset of the first byte.
+  /// @param data Destination of the bytes.
+  /// @param size Number of bytes to read.
+  /// @return Number of bytes read, negative on error.
+  virtual qint64 read(qint64 offset, char *data, qint64 size) = 0;
+};
+
+/// Local file mapped into memory.
+class MappedSource : public BlockSource {
+public:
+  /// Constructor.
+  MappedSource();
+
+  /// Maps a file.
+  ///
+  /// @param path Path to the file.
+  /// @return True if successful, false otherwise.
+  bool open(const QString &path);
+
+  qint64 size() const override;
+  qint64 read(qint64 offset, char *data, qint64 size) override;
+private:
+  /// Mapped file.
+  QFile file_;
+
+  /// Start of the mapping.
+  const uchar *map_;
+
+  /// Size of the mapping.
+  qint64 size_;
+};
+
+/// File read with positional reads, suited to network mounts where each
+/// read pays a round trip.
+class FileSource : public BlockSource {
+public:
+  /// Constructor.
+  FileSource();
+
+  /// Destructor.
+  ~FileSource();
+
+  /// Opens a file.
+  ///
+  /// @param path Path to the file.
+  /// @return True if successful, false otherwise.
+  bool open(const QString &path);
+
+  qint64 size() const override;
+  qint64 read(qint64 offset, char *data, qint64 size) override;
+private:
+  /// Native file handle or descriptor, -1 if not open.
+  qintptr handle_;
+
+  /// Size of the file.
+  qint64 size_;
+
+  FileSource(const FileSource&) = delete;
+  FileSource& operator=(const FileSource&) = delete;
+};
+
+/// Adds a fixed delay to every read of another source, simulating a high
+/// latency network mount on a local file.
+class LatencySource : public BlockSource {
+public:
+  /// Constructor.
+  ///
+  /// @param source Source to delay.
+  /// @param latency Delay per read in milliseconds.
+  LatencySource(std::unique_ptr<BlockSource> source, int latency);
+
+  qint64 size() const override;
+  qint64 read(qint64 offset, char *data, qint64 size) override;
+private:
+  /// Delayed source.
+  std::unique_ptr<BlockSource> source_;
+
+  /// Delay per read in milliseconds.
+  int latency_;
+};
+
+/// Returns true if a path is on a network mount.
+///
+/// @param path Path to a file.
+bool isRemotePath(const QString &path);
+
+/// Sets a latency added to every read of videos opened afterward.
+///
+/// Every video is then read as if it were on a network mount.  Used to
+/// reproduce network stalls with local files.
+///
+/// @param latency Delay per read in milliseconds, 0 to disable.
+void setSimulatedLatency(int latency);
+
+/// Returns the simulated latency in milliseconds.
+int simulatedLatency();
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_BLOCK_SOURCE_H
@@ -0,0 +1,32 @@
+#include <atomic>
+
+#include "decoder_threads.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Number of decoder threads, 0 for automatic.
+  std::atomic<int> decoder_threads(0);
+}
+
+void setDecoderThreads(int threads) {
+  decoder_threads = threads < 0 ? 0 : threads;
+}
+
+int decoderThreads() {
+  return decoder_threads;
+}
+
+void configureDecoderThreads(AVCodecContext *codec_context) {
+  codec_context->thread_count = decoder_threads;
+  codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+}
+
+int frameThreadDelay(const AVCodecContext *codec_context) {
+  if((codec_context->active_thread_type & FF_THREAD_FRAME) == 0) {
+    return 0;
+  }
+  return codec_context->thread_count > 1 ? codec_context->thread_count - 1 : 0;
+}
+
+}} // namespace tator::video_annotator
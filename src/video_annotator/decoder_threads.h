@@ -0,0 +1,44 @@
+/// @file
+/// @brief Defines functions for configuring multithreaded decoding.
+
+#ifndef VIDEO_ANNOTATOR_DECODER_THREADS_H
+#define VIDEO_ANNOTATOR_DECODER_THREADS_H
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavcodec/avcodec.h>
+}
+
+namespace tator { namespace video_annotator {
+
+/// Sets the number of threads used by each video decoder.
+///
+/// Applies to codec contexts configured afterward.
+///
+/// @param threads Number of threads, 0 to pick based on available cores.
+void setDecoderThreads(int threads);
+
+/// Returns the number of threads used by each video decoder.
+int decoderThreads();
+
+/// Enables frame and slice threading on a codec context.
+///
+/// Must be called before avcodec_open2.
+///
+/// @param codec_context Codec context to configure.
+void configureDecoderThreads(AVCodecContext *codec_context);
+
+/// Returns the number of packets by which frame threading delays output.
+///
+/// With frame threading, this many packets are in flight before the
+/// first frame is returned, which adds to the latency of every seek.
+/// Must be called after avcodec_open2.
+///
+/// @param codec_context Opened codec context.
+int frameThreadDelay(const AVCodecContext *codec_context);
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_DECODER_THREADS_H
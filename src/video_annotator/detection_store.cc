@@ -0,0 +1,673 @@
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
+#include "detection_store.h"
+#include "video_annotation.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Annotation type of a removed row.
+  static const uint8_t kRemoved = 0xff;
+
+  /// Pending and removed rows that are never worth a merge.
+  static const uint64_t kMinChanges = 4096;
+
+  /// Merge once pending and removed rows exceed this fraction of rows.
+  static const uint64_t kChangeFraction = 8;
+
+  /// Reorders the end of a column.
+  ///
+  /// @param column Column to reorder.
+  /// @param order Index in the column of each row of the result from
+  ///   begin on.
+  /// @param begin First row to reorder.
+  template<typename T>
+  void gather(
+      std::vector<T> &column,
+      const std::vector<uint32_t> &order,
+      std::size_t begin) {
+    std::vector<T> gathered;
+    gathered.reserve(order.size());
+    for(uint32_t index : order) {
+      gathered.push_back(column[index]);
+    }
+    column.resize(begin);
+    column.insert(column.end(), gathered.begin(), gathered.end());
+  }
+} // namespace
+
+std::size_t DetectionStore::Columns::size() const {
+  return frame.size();
+}
+
+void DetectionStore::Columns::reserve(std::size_t size) {
+  frame.reserve(size);
+  track.reserve(size);
+  x.reserve(size);
+  y.reserve(size);
+  w.reserve(size);
+  h.reserve(size);
+  species.reserve(size);
+  type.reserve(size);
+  prob.reserve(size);
+}
+
+DetectionStore::Row DetectionStore::Columns::get(std::size_t index) const {
+  Row row;
+  row.frame = frame[index];
+  row.track = track[index];
+  row.x = x[index];
+  row.y = y[index];
+  row.w = w[index];
+  row.h = h[index];
+  row.species = species[index];
+  row.type = type[index];
+  row.prob = prob[index];
+  return row;
+}
+
+void DetectionStore::Columns::set(std::size_t index, const Row &row) {
+  frame[index] = row.frame;
+  track[index] = row.track;
+  x[index] = row.x;
+  y[index] = row.y;
+  w[index] = row.w;
+  h[index] = row.h;
+  species[index] = row.species;
+  type[index] = row.type;
+  prob[index] = row.prob;
+}
+
+void DetectionStore::Columns::append(const Row &row) {
+  frame.push_back(row.frame);
+  track.push_back(row.track);
+  x.push_back(row.x);
+  y.push_back(row.y);
+  w.push_back(row.w);
+  h.push_back(row.h);
+  species.push_back(row.species);
+  type.push_back(row.type);
+  prob.push_back(row.prob);
+}
+
+void DetectionStore::Columns::gather(
+    const std::vector<uint32_t> &order,
+    std::size_t begin) {
+  video_annotator::gather(frame, order, begin);
+  video_annotator::gather(track, order, begin);
+  video_annotator::gather(x, order, begin);
+  video_annotator::gather(y, order, begin);
+  video_annotator::gather(w, order, begin);
+  video_annotator::gather(h, order, begin);
+  video_annotator::gather(species, order, begin);
+  video_annotator::gather(type, order, begin);
+  video_annotator::gather(prob, order, begin);
+}
+
+void DetectionStore::Release::operator()(
+    DetectionAnnotation *annotation) const {
+  if(link->store != nullptr) {
+    link->store->writeBack(link->key, *annotation);
+  }
+  delete annotation;
+}
+
+DetectionStore::DetectionStore()
+  : columns_()
+  , frame_offsets_()
+  , track_rows_()
+  , track_begin_()
+  , track_end_()
+  , removed_(0)
+  , pending_()
+  , pending_by_track_()
+  , track_ids_()
+  , track_index_()
+  , track_sizes_()
+  , species_names_()
+  , species_index_()
+  , handles_() {
+}
+
+DetectionStore::~DetectionStore() {
+  for(auto &h : handles_) {
+    h.second.link->store = nullptr;
+  }
+}
+
+void DetectionStore::insert(const DetectionAnnotation &annotation) {
+  remove(annotation.frame_, annotation.id_);
+  Row row = makeRow(annotation);
+  pending_[Key(annotation.frame_, annotation.id_)] = row;
+  pending_by_track_.insert(TrackKey(annotation.id_, annotation.frame_));
+  ++track_sizes_[row.track];
+  maybeCompact();
+}
+
+void DetectionStore::insert(
+    const std::function<bool(DetectionAnnotation&)> &next) {
+  const std::size_t sorted = columns_.size();
+  DetectionAnnotation annotation;
+  while(next(annotation) == true) {
+    erase(annotation.frame_, annotation.id_);
+    Row row = makeRow(annotation);
+    columns_.append(row);
+    ++track_sizes_[row.track];
+  }
+  if(columns_.size() == sorted) {
+    return;
+  }
+  // Sort the new rows, keeping the last of any with the same key.
+  std::vector<uint32_t> order(columns_.size() - sorted);
+  std::iota(order.begin(), order.end(), static_cast<uint32_t>(sorted));
+  auto less = [this](uint32_t lhs, uint32_t rhs) {
+    return columnKey(lhs) < columnKey(rhs);
+  };
+  std::stable_sort(order.begin(), order.end(), less);
+  for(std::size_t i = 1; i < order.size(); ++i) {
+    if(columnKey(order[i - 1]) == columnKey(order[i])) {
+      columns_.type[order[i - 1]] = kRemoved;
+      --track_sizes_[columns_.track[order[i - 1]]];
+    }
+  }
+  // New rows that all come after the sorted rows, as when a file is
+  // loaded in order, are appended.  Otherwise they are merged with the
+  // sorted rows, dropping removed rows on the way.
+  std::size_t begin = sorted;
+  if(sorted > 0 &&
+      columns_.frame[order.front()] <= columns_.frame[sorted - 1]) {
+    std::vector<uint32_t> merged(sorted);
+    std::iota(merged.begin(), merged.end(), 0);
+    merged.insert(merged.end(), order.begin(), order.end());
+    std::inplace_merge(
+        merged.begin(), merged.begin() + sorted, merged.end(), less);
+    order.swap(merged);
+    begin = 0;
+    removed_ = 0;
+  }
+  order.erase(std::remove_if(order.begin(), order.end(),
+    [this](uint32_t index) {
+      return columns_.type[index] == kRemoved;
+    }), order.end());
+  columns_.gather(order, begin);
+  if(begin == 0) {
+    reindex();
+  }
+  else {
+    index(begin);
+  }
+}
+
+bool DetectionStore::remove(uint64_t frame, uint64_t id) {
+  const bool found = erase(frame, id);
+  maybeCompact();
+  return found;
+}
+
+bool DetectionStore::erase(uint64_t frame, uint64_t id) {
+  Key k(frame, id);
+  detach(k);
+  auto it = pending_.find(k);
+  if(it != pending_.end()) {
+    --track_sizes_[it->second.track];
+    pending_.erase(it);
+    pending_by_track_.erase(TrackKey(id, frame));
+    return true;
+  }
+  int64_t index = findColumn(frame, id);
+  if(index < 0) {
+    return false;
+  }
+  columns_.type[index] = kRemoved;
+  --track_sizes_[columns_.track[index]];
+  ++removed_;
+  return true;
+}
+
+void DetectionStore::removeTrack(uint64_t id) {
+  for(auto it = handles_.begin(); it != handles_.end();) {
+    if(it->first.second == id) {
+      it->second.link->store = nullptr;
+      it = handles_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  auto begin = pending_by_track_.lower_bound(TrackKey(id, 0));
+  auto end = pending_by_track_.upper_bound(TrackKey(id, UINT64_MAX));
+  for(auto it = begin; it != end; ++it) {
+    pending_.erase(Key(it->second, id));
+  }
+  pending_by_track_.erase(begin, end);
+  uint32_t t = 0;
+  if(trackColumns(id, t) == true) {
+    for(uint32_t i = track_begin_[t]; i < track_end_[t]; ++i) {
+      uint32_t column = track_rows_[t][i];
+      if(columns_.type[column] != kRemoved) {
+        columns_.type[column] = kRemoved;
+        ++removed_;
+      }
+    }
+    track_begin_[t] = track_end_[t];
+  }
+  auto index = track_index_.find(id);
+  if(index != track_index_.end()) {
+    track_sizes_[index->second] = 0;
+  }
+  maybeCompact();
+}
+
+void DetectionStore::clear() {
+  for(auto &h : handles_) {
+    h.second.link->store = nullptr;
+  }
+  handles_.clear();
+  columns_ = Columns();
+  frame_offsets_.clear();
+  track_rows_.clear();
+  track_begin_.clear();
+  track_end_.clear();
+  removed_ = 0;
+  pending_.clear();
+  pending_by_track_.clear();
+  track_ids_.clear();
+  track_index_.clear();
+  track_sizes_.clear();
+  species_names_.clear();
+  species_index_.clear();
+}
+
+uint64_t DetectionStore::size() const {
+  return columns_.size() - removed_ + pending_.size();
+}
+
+std::vector<std::shared_ptr<DetectionAnnotation>>
+DetectionStore::byFrame(uint64_t frame) {
+  std::vector<std::shared_ptr<DetectionAnnotation>> annotations;
+  if(frame + 1 < frame_offsets_.size()) {
+    for(uint32_t i = frame_offsets_[frame]; i < frame_offsets_[frame + 1];
+        ++i) {
+      if(columns_.type[i] != kRemoved) {
+        annotations.push_back(handle(columns_.get(i)));
+      }
+    }
+  }
+  auto begin = pending_.lower_bound(Key(frame, 0));
+  auto end = pending_.lower_bound(Key(frame + 1, 0));
+  for(auto it = begin; it != end; ++it) {
+    annotations.push_back(handle(it->second));
+  }
+  std::sort(annotations.begin(), annotations.end(),
+    [](const std::shared_ptr<DetectionAnnotation> &lhs,
+       const std::shared_ptr<DetectionAnnotation> &rhs) {
+      return lhs->id_ < rhs->id_;
+    });
+  return annotations;
+}
+
+std::vector<std::shared_ptr<DetectionAnnotation>>
+DetectionStore::byTrack(uint64_t id, uint64_t first, uint64_t last) {
+  std::vector<std::shared_ptr<DetectionAnnotation>> annotations;
+  uint32_t t = 0;
+  if(trackColumns(id, t) == true) {
+    auto begin = track_rows_[t].begin() + track_begin_[t];
+    auto end = track_rows_[t].begin() + track_end_[t];
+    auto it = std::lower_bound(begin, end, first,
+      [this](uint32_t column, uint64_t frame) {
+        return columns_.frame[column] < frame;
+      });
+    for(; it != end && columns_.frame[*it] <= last; ++it) {
+      if(columns_.type[*it] != kRemoved) {
+        annotations.push_back(handle(columns_.get(*it)));
+      }
+    }
+  }
+  auto begin = pending_by_track_.lower_bound(TrackKey(id, first));
+  auto end = pending_by_track_.upper_bound(TrackKey(id, last));
+  for(auto it = begin; it != end; ++it) {
+    annotations.push_back(handle(pending_.at(Key(it->second, id))));
+  }
+  std::sort(annotations.begin(), annotations.end(),
+    [](const std::shared_ptr<DetectionAnnotation> &lhs,
+       const std::shared_ptr<DetectionAnnotation> &rhs) {
+      return lhs->frame_ < rhs->frame_;
+    });
+  return annotations;
+}
+
+std::shared_ptr<DetectionAnnotation>
+DetectionStore::find(uint64_t frame, uint64_t id) {
+  auto it = pending_.find(Key(frame, id));
+  if(it != pending_.end()) {
+    return handle(it->second);
+  }
+  int64_t index = findColumn(frame, id);
+  if(index >= 0) {
+    return handle(columns_.get(index));
+  }
+  return std::shared_ptr<DetectionAnnotation>(nullptr);
+}
+
+uint64_t DetectionStore::trackSize(uint64_t id) const {
+  auto index = track_index_.find(id);
+  if(index == track_index_.end()) {
+    return 0;
+  }
+  return track_sizes_[index->second];
+}
+
+bool DetectionStore::trackFrames(
+    uint64_t id,
+    uint64_t &first,
+    uint64_t &last) {
+  bool found = false;
+  uint32_t t = 0;
+  if(trackColumns(id, t) == true) {
+    // Removed rows never come back, so skipping them for good keeps this
+    // amortized constant time.
+    const std::vector<uint32_t> &rows = track_rows_[t];
+    uint32_t &begin = track_begin_[t];
+    uint32_t &end = track_end_[t];
+    while(begin < end && columns_.type[rows[begin]] == kRemoved) {
+      ++begin;
+    }
+    while(end > begin && columns_.type[rows[end - 1]] == kRemoved) {
+      --end;
+    }
+    if(begin < end) {
+      first = columns_.frame[rows[begin]];
+      last = columns_.frame[rows[end - 1]];
+      found = true;
+    }
+  }
+  auto begin = pending_by_track_.lower_bound(TrackKey(id, 0));
+  auto end = pending_by_track_.upper_bound(TrackKey(id, UINT64_MAX));
+  if(begin != end) {
+    uint64_t pending_first = begin->second;
+    uint64_t pending_last = std::prev(end)->second;
+    first = found == true ? std::min(first, pending_first) : pending_first;
+    last = found == true ? std::max(last, pending_last) : pending_last;
+    found = true;
+  }
+  return found;
+}
+
+void DetectionStore::forEach(
+    const std::function<bool(const DetectionAnnotation&)> &visit) const {
+  DetectionAnnotation annotation;
+  std::size_t i = 0;
+  auto pending = pending_.begin();
+  while(i < columns_.size() || pending != pending_.end()) {
+    if(i < columns_.size() && columns_.type[i] == kRemoved) {
+      ++i;
+      continue;
+    }
+    Row row;
+    if(pending == pending_.end() ||
+        (i < columns_.size() && columnKey(i) < pending->first)) {
+      row = columns_.get(i++);
+    }
+    else {
+      row = pending->second;
+      ++pending;
+    }
+    // Objects held by callers may have unsaved changes.
+    std::shared_ptr<DetectionAnnotation> held;
+    if(handles_.empty() == false) {
+      auto h = handles_.find(key(row));
+      if(h != handles_.end()) {
+        held = h->second.annotation.lock();
+      }
+    }
+    if(held == nullptr) {
+      fill(row, annotation);
+    }
+    if(visit(held != nullptr ? *held : annotation) == false) {
+      return;
+    }
+  }
+}
+
+bool DetectionStore::operator==(DetectionStore &rhs) {
+  if(size() != rhs.size()) return false;
+  sync();
+  compact();
+  rhs.sync();
+  rhs.compact();
+  for(std::size_t i = 0; i < columns_.size(); ++i) {
+    if(columns_.frame[i] != rhs.columns_.frame[i]) return false;
+    if(track_ids_[columns_.track[i]] !=
+        rhs.track_ids_[rhs.columns_.track[i]]) return false;
+    if(columns_.x[i] != rhs.columns_.x[i]) return false;
+    if(columns_.y[i] != rhs.columns_.y[i]) return false;
+    if(columns_.w[i] != rhs.columns_.w[i]) return false;
+    if(columns_.h[i] != rhs.columns_.h[i]) return false;
+    if(columns_.type[i] != rhs.columns_.type[i]) return false;
+  }
+  return true;
+}
+
+bool DetectionStore::operator!=(DetectionStore &rhs) {
+  return !operator==(rhs);
+}
+
+DetectionStore::Row DetectionStore::makeRow(
+    const DetectionAnnotation &annotation) {
+  Row row;
+  row.frame = static_cast<uint32_t>(annotation.frame_);
+  row.track = trackIndex(annotation.id_);
+  setEditable(annotation, row);
+  return row;
+}
+
+void DetectionStore::setEditable(
+    const DetectionAnnotation &annotation,
+    Row &row) {
+  row.x = static_cast<int32_t>(annotation.area_.x);
+  row.y = static_cast<int32_t>(annotation.area_.y);
+  row.w = static_cast<int32_t>(annotation.area_.w);
+  row.h = static_cast<int32_t>(annotation.area_.h);
+  row.type = static_cast<uint8_t>(annotation.type_);
+  row.prob = annotation.prob_;
+  auto it = species_index_.find(annotation.species_);
+  if(it == species_index_.end()) {
+    row.species = static_cast<uint32_t>(species_names_.size());
+    species_index_.insert({annotation.species_, row.species});
+    species_names_.push_back(annotation.species_);
+  }
+  else {
+    row.species = it->second;
+  }
+}
+
+void DetectionStore::fill(
+    const Row &row,
+    DetectionAnnotation &annotation) const {
+  annotation.frame_ = row.frame;
+  annotation.id_ = track_ids_[row.track];
+  annotation.area_.x = row.x;
+  annotation.area_.y = row.y;
+  annotation.area_.w = row.w;
+  annotation.area_.h = row.h;
+  annotation.type_ = static_cast<AnnotationType>(row.type);
+  annotation.species_ = species_names_[row.species];
+  annotation.prob_ = row.prob;
+}
+
+DetectionStore::Key DetectionStore::key(const Row &row) const {
+  return Key(row.frame, track_ids_[row.track]);
+}
+
+DetectionStore::Key DetectionStore::columnKey(std::size_t index) const {
+  return Key(columns_.frame[index], track_ids_[columns_.track[index]]);
+}
+
+uint32_t DetectionStore::trackIndex(uint64_t id) {
+  auto it = track_index_.find(id);
+  if(it != track_index_.end()) {
+    return it->second;
+  }
+  uint32_t index = static_cast<uint32_t>(track_ids_.size());
+  track_index_.insert({id, index});
+  track_ids_.push_back(id);
+  track_sizes_.push_back(0);
+  return index;
+}
+
+bool DetectionStore::trackColumns(uint64_t id, uint32_t &index) const {
+  auto it = track_index_.find(id);
+  if(it == track_index_.end() || it->second >= track_rows_.size()) {
+    return false;
+  }
+  index = it->second;
+  return true;
+}
+
+int64_t DetectionStore::findColumn(uint64_t frame, uint64_t id) const {
+  if(frame + 1 >= frame_offsets_.size()) {
+    return -1;
+  }
+  auto it = track_index_.find(id);
+  if(it == track_index_.end()) {
+    return -1;
+  }
+  for(uint32_t i = frame_offsets_[frame]; i < frame_offsets_[frame + 1];
+      ++i) {
+    if(columns_.track[i] == it->second && columns_.type[i] != kRemoved) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+std::shared_ptr<DetectionAnnotation> DetectionStore::handle(const Row &row) {
+  Key k = key(row);
+  auto it = handles_.find(k);
+  if(it != handles_.end()) {
+    auto held = it->second.annotation.lock();
+    if(held != nullptr) {
+      return held;
+    }
+    it->second.link->store = nullptr;
+  }
+  DetectionAnnotation *annotation = new DetectionAnnotation;
+  fill(row, *annotation);
+  auto link = std::make_shared<Link>(Link{this, k});
+  std::shared_ptr<DetectionAnnotation> held(annotation, Release{link});
+  handles_[k] = Handle{held, link};
+  return held;
+}
+
+void DetectionStore::detach(const Key &key) {
+  auto it = handles_.find(key);
+  if(it != handles_.end()) {
+    it->second.link->store = nullptr;
+    handles_.erase(it);
+  }
+}
+
+void DetectionStore::update(
+    const Key &key,
+    const DetectionAnnotation &annotation) {
+  auto it = pending_.find(key);
+  if(it != pending_.end()) {
+    setEditable(annotation, it->second);
+    return;
+  }
+  int64_t index = findColumn(key.first, key.second);
+  if(index >= 0) {
+    Row row = columns_.get(index);
+    setEditable(annotation, row);
+    columns_.set(index, row);
+  }
+}
+
+void DetectionStore::writeBack(
+    const Key &key,
+    const DetectionAnnotation &annotation) {
+  handles_.erase(key);
+  update(key, annotation);
+}
+
+void DetectionStore::sync() {
+  for(const auto &h : handles_) {
+    auto held = h.second.annotation.lock();
+    if(held != nullptr) {
+      update(h.first, *held);
+    }
+  }
+}
+
+void DetectionStore::maybeCompact() {
+  uint64_t changes = pending_.size() + removed_;
+  uint64_t limit = std::max<uint64_t>(
+      kMinChanges, columns_.size() / kChangeFraction);
+  if(changes > limit) {
+    compact();
+  }
+}
+
+void DetectionStore::compact() {
+  if(pending_.empty() == true && removed_ == 0) {
+    return;
+  }
+  Columns merged;
+  merged.reserve(size());
+  std::size_t i = 0;
+  auto pending = pending_.begin();
+  while(i < columns_.size() || pending != pending_.end()) {
+    if(i < columns_.size() && columns_.type[i] == kRemoved) {
+      ++i;
+    }
+    else if(pending == pending_.end() ||
+        (i < columns_.size() && columnKey(i) < pending->first)) {
+      merged.append(columns_.get(i++));
+    }
+    else {
+      merged.append(pending->second);
+      ++pending;
+    }
+  }
+  columns_ = std::move(merged);
+  removed_ = 0;
+  pending_.clear();
+  pending_by_track_.clear();
+  reindex();
+}
+
+void DetectionStore::reindex() {
+  frame_offsets_.clear();
+  track_rows_.clear();
+  track_begin_.clear();
+  track_end_.clear();
+  index(0);
+}
+
+void DetectionStore::index(std::size_t begin) {
+  if(begin == columns_.size()) {
+    return;
+  }
+  // Rows are sorted by frame, so each frame starts after the rows of all
+  // frames before it.  The end of the last frame becomes the start of
+  // the frames after it.
+  if(frame_offsets_.empty() == false) {
+    frame_offsets_.pop_back();
+  }
+  track_rows_.resize(track_ids_.size());
+  track_begin_.resize(track_ids_.size(), 0);
+  track_end_.resize(track_ids_.size(), 0);
+  for(std::size_t row = begin; row < columns_.size(); ++row) {
+    while(frame_offsets_.size() <= columns_.frame[row]) {
+      frame_offsets_.push_back(static_cast<uint32_t>(row));
+    }
+    const uint32_t track = columns_.track[row];
+    track_rows_[track].push_back(static_cast<uint32_t>(row));
+    track_end_[track] = static_cast<uint32_t>(track_rows_[track].size());
+  }
+  frame_offsets_.push_back(static_cast<uint32_t>(columns_.size()));
+}
+
+}} // namespace tator::video_annotator
@@ -0,0 +1,324 @@
+/// @file
+/// @brief Defines compact storage for the detections of a video.
+
+#ifndef VIDEO_ANNOTATOR_DETECTION_STORE_H
+#define VIDEO_ANNOTATOR_DETECTION_STORE_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace tator { namespace video_annotator {
+
+struct DetectionAnnotation;
+
+/// Stores detections as columns sorted by frame and then track ID.
+///
+/// Each detection is a fixed-size row, with its track ID and species
+/// replaced by indices into tables of distinct values.  A table of
+/// offsets by frame finds the rows of a frame and a list of rows per
+/// track, in frame order, finds the rows of a track and its extent.
+/// Edits go to a small sorted map of
+/// pending rows and removed rows are only marked, both are merged into
+/// the columns once they make up a fraction of the store, so loading
+/// millions of detections costs amortized constant time per detection.
+///
+/// Frames and coordinates are stored in 32 bits.
+///
+/// Queries return DetectionAnnotation objects made from rows.  While a
+/// returned object is held, the same object is returned for its row and
+/// changes made to it are written back to the row.
+class DetectionStore {
+public:
+  /// Constructor.
+  DetectionStore();
+
+  /// Destructor.
+  ///
+  /// Objects still held by callers are detached from the store.
+  ~DetectionStore();
+
+  /// Inserts a detection, replacing any with the same frame and ID.
+  ///
+  /// The detection is copied, later changes to it are not stored.
+  ///
+  /// @param annotation Detection to insert.
+  void insert(const DetectionAnnotation &annotation);
+
+  /// Inserts detections in bulk.
+  ///
+  /// Has the same result as inserting each detection in turn, but sorts
+  /// them into the columns once at the end.  Detections that all come
+  /// after the frames already stored are appended in time linear in
+  /// their number, otherwise all rows are merged.
+  ///
+  /// @param next Fills in the next detection, returns false when there
+  ///   are no more.
+  void insert(const std::function<bool(DetectionAnnotation&)> &next);
+
+  /// Removes a detection.
+  ///
+  /// @param frame Frame of the detection.
+  /// @param id Track ID of the detection.
+  /// @return True if the detection was found, false otherwise.
+  bool remove(uint64_t frame, uint64_t id);
+
+  /// Removes all detections of a track.
+  ///
+  /// @param id Track ID.
+  void removeTrack(uint64_t id);
+
+  /// Removes all detections.
+  void clear();
+
+  /// Returns the number of detections.
+  uint64_t size() const;
+
+  /// Gets detections in a frame, in order of track ID.
+  ///
+  /// @param frame Frame in the video.
+  /// @return Detections in the frame.
+  std::vector<std::shared_ptr<DetectionAnnotation>> byFrame(uint64_t frame);
+
+  /// Gets detections of a track in a range of frames, in order of frame.
+  ///
+  /// @param id Track ID.
+  /// @param first First frame of the range.
+  /// @param last Last frame of the range, inclusive.
+  /// @return Detections of the track in the range.
+  std::vector<std::shared_ptr<DetectionAnnotation>> byTrack(
+    uint64_t id,
+    uint64_t first,
+    uint64_t last);
+
+  /// Finds the detection of a track in a frame.
+  ///
+  /// @param frame Frame in the video.
+  /// @param id Track ID.
+  /// @return Detection, nullptr if not found.
+  std::shared_ptr<DetectionAnnotation> find(uint64_t frame, uint64_t id);
+
+  /// Returns the number of detections of a track.
+  ///
+  /// @param id Track ID.
+  uint64_t trackSize(uint64_t id) const;
+
+  /// Gets the first and last frame of a track.
+  ///
+  /// Takes logarithmic time in the number of pending rows.
+  ///
+  /// @param id Track ID.
+  /// @param first Receives the first frame with a detection of the track.
+  /// @param last Receives the last frame with a detection of the track.
+  /// @return True if the track has detections, false otherwise.
+  bool trackFrames(uint64_t id, uint64_t &first, uint64_t &last);
+
+  /// Visits all detections in order of frame and then track ID.
+  ///
+  /// @param visit Called for each detection, returns false to stop.
+  void forEach(
+    const std::function<bool(const DetectionAnnotation&)> &visit) const;
+
+  /// Equality operator.
+  ///
+  /// Compares the same fields as DetectionAnnotation::operator==.
+  ///
+  /// @param rhs Right hand side argument.
+  /// @return Whether the stores hold equal detections.
+  bool operator==(DetectionStore &rhs);
+
+  /// Inequality operator.
+  ///
+  /// @param rhs Right hand side argument.
+  /// @return Whether the stores do not hold equal detections.
+  bool operator!=(DetectionStore &rhs);
+private:
+  /// Frame and track ID of a detection.
+  typedef std::pair<uint64_t, uint64_t> Key;
+
+  /// Track ID and frame of a detection.
+  typedef std::pair<uint64_t, uint64_t> TrackKey;
+
+  /// One detection in compact form.
+  struct Row {
+    uint32_t frame; ///< Frame of the detection.
+    uint32_t track; ///< Index into track_ids_.
+    int32_t x; ///< Horizontal coordinate of the area.
+    int32_t y; ///< Vertical coordinate of the area.
+    int32_t w; ///< Width of the area.
+    int32_t h; ///< Height of the area.
+    uint32_t species; ///< Index into species_names_.
+    uint8_t type; ///< Annotation type.
+    double prob; ///< Detection probability.
+  };
+
+  /// Ties an object returned by a query to its row.
+  struct Link {
+    DetectionStore *store; ///< Store of the row, null once detached.
+    Key key; ///< Key of the row.
+  };
+
+  /// Object returned by a query that may still be held by a caller.
+  struct Handle {
+    std::weak_ptr<DetectionAnnotation> annotation; ///< Returned object.
+    std::shared_ptr<Link> link; ///< Link shared with the deleter.
+  };
+
+  /// Deleter of returned objects that writes their changes back.
+  struct Release {
+    std::shared_ptr<Link> link; ///< Link to the row.
+
+    /// Writes the object back to its row if attached, then deletes it.
+    void operator()(DetectionAnnotation *annotation) const;
+  };
+
+  /// Rows stored as one vector per field.
+  struct Columns {
+    std::vector<uint32_t> frame; ///< Frames.
+    std::vector<uint32_t> track; ///< Track indices.
+    std::vector<int32_t> x; ///< Horizontal coordinates.
+    std::vector<int32_t> y; ///< Vertical coordinates.
+    std::vector<int32_t> w; ///< Widths.
+    std::vector<int32_t> h; ///< Heights.
+    std::vector<uint32_t> species; ///< Species indices.
+    std::vector<uint8_t> type; ///< Annotation types, kRemoved if removed.
+    std::vector<double> prob; ///< Detection probabilities.
+
+    /// Returns the number of rows, including removed rows.
+    std::size_t size() const;
+
+    /// Reserves space for rows.
+    void reserve(std::size_t size);
+
+    /// Returns a row.
+    Row get(std::size_t index) const;
+
+    /// Replaces a row.
+    void set(std::size_t index, const Row &row);
+
+    /// Appends a row.
+    void append(const Row &row);
+
+    /// Reorders the rows from begin on.
+    ///
+    /// @param order Index of each row of the result from begin on.
+    /// @param begin First row to reorder.
+    void gather(const std::vector<uint32_t> &order, std::size_t begin);
+  };
+
+  /// Converts a detection to a row.
+  Row makeRow(const DetectionAnnotation &annotation);
+
+  /// Copies the fields of a detection that callers may edit into a row,
+  /// adding its species to the table if needed.
+  void setEditable(const DetectionAnnotation &annotation, Row &row);
+
+  /// Copies the fields of a row into a detection.
+  void fill(const Row &row, DetectionAnnotation &annotation) const;
+
+  /// Returns the key of a row.
+  Key key(const Row &row) const;
+
+  /// Returns the key of a row in the columns.
+  Key columnKey(std::size_t index) const;
+
+  /// Returns the track index of a track ID, adding it if needed.
+  uint32_t trackIndex(uint64_t id);
+
+  /// Returns true if a track has rows in the columns, and gives its
+  /// index.
+  bool trackColumns(uint64_t id, uint32_t &index) const;
+
+  /// Removes a detection without merging changes into the columns.
+  bool erase(uint64_t frame, uint64_t id);
+
+  /// Returns the column index of a detection, or -1 if it is not in the
+  /// columns.
+  int64_t findColumn(uint64_t frame, uint64_t id) const;
+
+  /// Returns the object for a row, reusing it if still held.
+  std::shared_ptr<DetectionAnnotation> handle(const Row &row);
+
+  /// Detaches the object for a detection, if any.
+  void detach(const Key &key);
+
+  /// Copies the editable fields of a detection into its row.
+  void update(const Key &key, const DetectionAnnotation &annotation);
+
+  /// Writes a released object back to its row.
+  void writeBack(const Key &key, const DetectionAnnotation &annotation);
+
+  /// Writes all held objects back to their rows.
+  void sync();
+
+  /// Merges pending rows into the columns when worthwhile.
+  void maybeCompact();
+
+  /// Merges pending rows into the columns, drops removed rows and
+  /// rebuilds the frame and track tables.
+  void compact();
+
+  /// Rebuilds the frame and track tables from the columns.
+  void reindex();
+
+  /// Adds rows to the frame and track tables.
+  ///
+  /// @param begin First column index to add, all rows before it must
+  ///   already be in the tables and have earlier frames.
+  void index(std::size_t begin);
+
+  /// Rows sorted by frame and then track ID.
+  Columns columns_;
+
+  /// Column index of the first row of each frame, plus one past the end.
+  std::vector<uint32_t> frame_offsets_;
+
+  /// Column indices of each track, in order of frame.
+  std::vector<std::vector<uint32_t>> track_rows_;
+
+  /// Start of each track in track_rows_ past its leading removed rows.
+  std::vector<uint32_t> track_begin_;
+
+  /// End of each track in track_rows_ before its trailing removed rows.
+  std::vector<uint32_t> track_end_;
+
+  /// Number of rows in the columns marked as removed.
+  uint64_t removed_;
+
+  /// Rows inserted since the last merge.
+  std::map<Key, Row> pending_;
+
+  /// Keys of pending rows by track.
+  std::set<TrackKey> pending_by_track_;
+
+  /// Track ID by track index.
+  std::vector<uint64_t> track_ids_;
+
+  /// Track index by track ID.
+  std::unordered_map<uint64_t, uint32_t> track_index_;
+
+  /// Number of detections by track index.
+  std::vector<uint64_t> track_sizes_;
+
+  /// Species by species index.
+  std::vector<std::string> species_names_;
+
+  /// Species index by species.
+  std::unordered_map<std::string, uint32_t> species_index_;
+
+  /// Objects returned by queries.
+  std::map<Key, Handle> handles_;
+
+  DetectionStore(const DetectionStore&) = delete;
+  DetectionStore& operator=(const DetectionStore&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_DETECTION_STORE_H
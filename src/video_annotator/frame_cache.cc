@@ -0,0 +1,127 @@
+#include <iterator>
+
+#include <QtGlobal>
+
+#include "frame_cache.h"
+#include "pipeline_stats.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Returns the size of the buffers referenced by a frame.
+  qint64 frameBytes(const AVFrame *frame) {
+    qint64 bytes = 0;
+    for(int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i] != nullptr; ++i) {
+      bytes += frame->buf[i]->size;
+    }
+    return bytes;
+  }
+}
+
+FrameCache::FrameCache(qint64 budget, qint64 window)
+  : budget_(budget)
+  , window_(window)
+  , playhead_(0)
+  , entries_()
+  , lookup_()
+  , stats_({0, 0, 0, 0, 0}) {
+}
+
+FrameCache::~FrameCache() {
+  clear();
+}
+
+void FrameCache::setBudget(qint64 budget) {
+  budget_ = budget;
+  evict();
+}
+
+qint64 FrameCache::budget() const {
+  return budget_;
+}
+
+void FrameCache::setPlayhead(qint64 frame) {
+  playhead_ = frame;
+}
+
+const AVFrame *FrameCache::find(qint64 frame) {
+  StageTimer timer(kCacheStage);
+  auto it = lookup_.find(frame);
+  if(it == lookup_.end()) {
+    ++stats_.misses;
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  ++stats_.hits;
+  return it->second->decoded;
+}
+
+bool FrameCache::contains(qint64 frame) const {
+  return lookup_.find(frame) != lookup_.end();
+}
+
+void FrameCache::insert(qint64 frame, const AVFrame *decoded) {
+  AVFrame *ref = av_frame_clone(decoded);
+  if(ref == nullptr) {
+    return;
+  }
+  const qint64 bytes = frameBytes(ref);
+  auto it = lookup_.find(frame);
+  if(it != lookup_.end()) {
+    stats_.bytes += bytes - it->second->bytes;
+    av_frame_free(&it->second->decoded);
+    it->second->decoded = ref;
+    it->second->bytes = bytes;
+    entries_.splice(entries_.begin(), entries_, it->second);
+  }
+  else {
+    entries_.push_front({frame, ref, bytes});
+    lookup_[frame] = entries_.begin();
+    stats_.bytes += bytes;
+    ++stats_.frames;
+  }
+  evict();
+}
+
+void FrameCache::clear() {
+  for(Entry &entry : entries_) {
+    av_frame_free(&entry.decoded);
+  }
+  entries_.clear();
+  lookup_.clear();
+  stats_.frames = 0;
+  stats_.bytes = 0;
+}
+
+FrameCache::Stats FrameCache::stats() const {
+  return stats_;
+}
+
+void FrameCache::resetStats() {
+  stats_.hits = 0;
+  stats_.misses = 0;
+  stats_.evictions = 0;
+}
+
+void FrameCache::evict() {
+  // Frames near the playhead are moved to the front instead of evicted.
+  // Each frame is passed over at most once, so if the window alone is
+  // over budget the least recently used frames go regardless.
+  qint64 skips = stats_.frames;
+  while(stats_.bytes > budget_ && entries_.empty() == false) {
+    auto last = std::prev(entries_.end());
+    if(skips > 0 && qAbs(last->frame - playhead_) <= window_) {
+      entries_.splice(entries_.begin(), entries_, last);
+      --skips;
+      continue;
+    }
+    stats_.bytes -= last->bytes;
+    --stats_.frames;
+    ++stats_.evictions;
+    lookup_.erase(last->frame);
+    av_frame_free(&last->decoded);
+    entries_.erase(last);
+  }
+}
+
+}} // namespace tator::video_annotator
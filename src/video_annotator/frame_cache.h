@@ -0,0 +1,131 @@
+/// @file
+/// @brief Defines byte budgeted cache of decoded frames.
+
+#ifndef VIDEO_ANNOTATOR_FRAME_CACHE_H
+#define VIDEO_ANNOTATOR_FRAME_CACHE_H
+
+#include <list>
+#include <unordered_map>
+
+#include <QtGlobal>
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavutil/frame.h>
+}
+
+namespace tator { namespace video_annotator {
+
+/// Least recently used cache of decoded frames with a byte budget.
+///
+/// Frames are kept as references to the decoder's buffers in their
+/// native pixel format, which for YUV 4:2:0 video is less than half the
+/// size of the converted image, and are converted only when shown.
+/// Lookups, inserts and evictions are constant time.  Frames within a
+/// window around the playhead are skipped over by eviction, so the
+/// frames needed for stepping and replaying stay cached as long as the
+/// budget can hold the window.  Not thread safe, callers serialize
+/// access.
+class FrameCache {
+public:
+  /// Cache statistics.
+  struct Stats {
+    qint64 hits; ///< Number of successful lookups.
+    qint64 misses; ///< Number of failed lookups.
+    qint64 evictions; ///< Number of frames evicted to stay in budget.
+    qint64 frames; ///< Number of cached frames.
+    qint64 bytes; ///< Total size of cached frames in bytes.
+  };
+
+  /// Constructor.
+  ///
+  /// @param budget Maximum total size of cached frames in bytes.
+  /// @param window Number of frames on either side of the playhead
+  ///   that eviction skips over.
+  explicit FrameCache(qint64 budget, qint64 window);
+
+  /// Destructor.
+  ~FrameCache();
+
+  /// Sets the byte budget, evicting frames if needed.
+  ///
+  /// @param budget Maximum total size of cached frames in bytes.
+  void setBudget(qint64 budget);
+
+  /// Returns the byte budget.
+  qint64 budget() const;
+
+  /// Sets the playhead used to protect frames from eviction.
+  ///
+  /// @param frame Current frame.
+  void setPlayhead(qint64 frame);
+
+  /// Looks up a frame and marks it as most recently used.
+  ///
+  /// @param frame Frame number.
+  /// @return Decoded frame, valid until the cache is next modified, or
+  ///   nullptr if not found.
+  const AVFrame *find(qint64 frame);
+
+  /// Returns true if a frame is cached, without touching it or stats.
+  ///
+  /// @param frame Frame number.
+  bool contains(qint64 frame) const;
+
+  /// Inserts or replaces a frame, evicting frames if over budget.
+  ///
+  /// Takes a new reference to the frame's buffers, no data is copied.
+  ///
+  /// @param frame Frame number.
+  /// @param decoded Decoded frame.
+  void insert(qint64 frame, const AVFrame *decoded);
+
+  /// Removes all frames.  Statistics are kept.
+  void clear();
+
+  /// Returns statistics.
+  Stats stats() const;
+
+  /// Resets hit, miss and eviction counts.
+  void resetStats();
+private:
+  /// Cached frame.
+  struct Entry {
+    qint64 frame; ///< Frame number.
+    AVFrame *decoded; ///< Reference to the decoded frame, owned.
+    qint64 bytes; ///< Size of the referenced buffers in bytes.
+  };
+
+  /// Entries ordered from most to least recently used.
+  typedef std::list<Entry> EntryList;
+
+  /// Maximum total size of cached frames in bytes.
+  qint64 budget_;
+
+  /// Frames on either side of the playhead skipped by eviction.
+  qint64 window_;
+
+  /// Current frame.
+  qint64 playhead_;
+
+  /// Cached frames, most recently used first.
+  EntryList entries_;
+
+  /// Maps frame number to position in entries_.
+  std::unordered_map<qint64, EntryList::iterator> lookup_;
+
+  /// Statistics.
+  Stats stats_;
+
+  /// Evicts least recently used frames until within budget.
+  void evict();
+
+  FrameCache(const FrameCache&) = delete;
+  FrameCache& operator=(const FrameCache&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FRAME_CACHE_H
@@ -0,0 +1,96 @@
+#include "frame_converter.h"
+
+namespace tator { namespace video_annotator {
+
+FrameConverter::FrameConverter()
+  : sws_context_(nullptr)
+  , use_kernel_(false)
+  , kernel_(kScalarKernel)
+  , height_(0)
+  , out_width_(0)
+  , out_height_(0) {
+}
+
+FrameConverter::~FrameConverter() {
+  close();
+}
+
+bool FrameConverter::init(int width, int height, AVPixelFormat format) {
+  return init(width, height, format, width, height, SWS_BICUBIC);
+}
+
+bool FrameConverter::init(
+    int width,
+    int height,
+    AVPixelFormat format,
+    int out_width,
+    int out_height,
+    int flags) {
+  close();
+  if(out_width == width &&
+      out_height == height &&
+      yuvKernelSupports(format) == true &&
+      bestYuvKernel() != kScalarKernel) {
+    use_kernel_ = true;
+    kernel_ = bestYuvKernel();
+    height_ = height;
+    out_width_ = out_width;
+    out_height_ = out_height;
+    return true;
+  }
+  // AV_PIX_FMT_RGB32 is native endian ARGB, which is the memory layout
+  // of QImage::Format_RGB32.
+  sws_context_ = sws_getContext(
+    width,
+    height,
+    format,
+    out_width,
+    out_height,
+    AV_PIX_FMT_RGB32,
+    flags,
+    nullptr, nullptr, nullptr);
+  if(sws_context_ == nullptr) {
+    return false;
+  }
+  height_ = height;
+  out_width_ = out_width;
+  out_height_ = out_height;
+  return true;
+}
+
+void FrameConverter::close() {
+  if(sws_context_ != nullptr) {
+    sws_freeContext(sws_context_);
+    sws_context_ = nullptr;
+  }
+  use_kernel_ = false;
+  height_ = 0;
+  out_width_ = 0;
+  out_height_ = 0;
+}
+
+QImage FrameConverter::convert(const AVFrame *frame) {
+  if(sws_context_ == nullptr && use_kernel_ == false) {
+    return QImage();
+  }
+  // A new image per frame, so images already handed out are never
+  // detached and copied.
+  QImage image(out_width_, out_height_, QImage::Format_RGB32);
+  if(use_kernel_ == true) {
+    convertYuv(frame, image.bits(), image.bytesPerLine(), kernel_);
+    return image;
+  }
+  uint8_t *dst[4] = {image.bits(), nullptr, nullptr, nullptr};
+  int dst_linesize[4] = {image.bytesPerLine(), 0, 0, 0};
+  sws_scale(
+      sws_context_,
+      frame->data,
+      frame->linesize,
+      0,
+      height_,
+      dst,
+      dst_linesize);
+  return image;
+}
+
+}} // namespace tator::video_annotator
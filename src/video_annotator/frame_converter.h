@@ -0,0 +1,91 @@
+/// @file
+/// @brief Defines class for converting decoded frames to images.
+
+#ifndef VIDEO_ANNOTATOR_FRAME_CONVERTER_H
+#define VIDEO_ANNOTATOR_FRAME_CONVERTER_H
+
+#include <QImage>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "yuv_convert.h"
+
+namespace tator { namespace video_annotator {
+
+/// Converts decoded frames to Qt images.
+///
+/// Scales directly into the buffer of a QImage in its native 32 bit
+/// format, so there is no intermediate frame and no per pixel copy.
+/// Unscaled YUV420P and NV12 frames are converted with the fastest SIMD
+/// kernel the CPU supports instead of swscale.
+class FrameConverter {
+public:
+  /// Constructor.
+  FrameConverter();
+
+  /// Destructor.
+  ~FrameConverter();
+
+  /// Prepares conversion for a frame geometry and pixel format.
+  ///
+  /// @param width Frame width.
+  /// @param height Frame height.
+  /// @param format Pixel format of decoded frames.
+  /// @return True if successful, false otherwise.
+  bool init(int width, int height, AVPixelFormat format);
+
+  /// Prepares conversion with scaling to a different output size.
+  ///
+  /// @param width Frame width.
+  /// @param height Frame height.
+  /// @param format Pixel format of decoded frames.
+  /// @param out_width Image width.
+  /// @param out_height Image height.
+  /// @param flags Scaling algorithm, one of the SWS_* flags.
+  /// @return True if successful, false otherwise.
+  bool init(
+      int width,
+      int height,
+      AVPixelFormat format,
+      int out_width,
+      int out_height,
+      int flags);
+
+  /// Releases conversion context.
+  void close();
+
+  /// Converts a frame.
+  ///
+  /// @param frame Decoded frame matching the initialized geometry.
+  /// @return Converted image, null image if not initialized.
+  QImage convert(const AVFrame *frame);
+private:
+  /// Conversion context, null if a kernel is used.
+  SwsContext *sws_context_;
+
+  /// True if frames are converted with kernel_.
+  bool use_kernel_;
+
+  /// Kernel used for unscaled YUV frames.
+  YuvKernel kernel_;
+
+  /// Frame height.
+  int height_;
+
+  /// Image width.
+  int out_width_;
+
+  /// Image height.
+  int out_height_;
+
+  FrameConverter(const FrameConverter&) = delete;
+  FrameConverter& operator=(const FrameConverter&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FRAME_CONVERTER_H
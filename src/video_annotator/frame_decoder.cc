@@ -0,0 +1,293 @@
+#include <algorithm>
+
+#include "decoder_threads.h"
+#include "frame_decoder.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Power of two by which the decoder reduces resolution when scrubbing.
+  static const int kScrubLowres = 2;
+
+  /// Maximum width of images when scrubbing.
+  static const int kScrubWidth = 960;
+}
+
+FrameDecoder::FrameDecoder()
+  : format_context_(nullptr)
+  , io_()
+  , codec_context_(nullptr)
+  , packet_()
+  , frame_(nullptr)
+  , converter_()
+  , stream_index_(-1)
+  , mode_(kFullMode)
+  , eof_sent_(false)
+  , converter_size_() {
+  av_init_packet(&packet_);
+  packet_.data = nullptr;
+  packet_.size = 0;
+}
+
+FrameDecoder::~FrameDecoder() {
+  close();
+}
+
+bool FrameDecoder::open(const QString &filename, Mode mode) {
+  close();
+  mode_ = mode;
+  eof_sent_ = false;
+  int status = io_.openInput(&format_context_, filename);
+  if(status != 0) {
+    return false;
+  }
+  status = avformat_find_stream_info(format_context_, nullptr);
+  if(status < 0) {
+    close();
+    return false;
+  }
+  stream_index_ = av_find_best_stream(
+      format_context_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  if(stream_index_ < 0) {
+    close();
+    return false;
+  }
+  AVStream *stream = format_context_->streams[stream_index_];
+  AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+  if(codec == nullptr) {
+    close();
+    return false;
+  }
+  codec_context_ = avcodec_alloc_context3(codec);
+  if(codec_context_ == nullptr ||
+      avcodec_parameters_to_context(codec_context_, stream->codecpar) < 0) {
+    close();
+    return false;
+  }
+  configureDecoderThreads(codec_context_);
+  if(mode_ != kFullMode) {
+    // Frame threading only adds latency when decoding single keyframes.
+    codec_context_->thread_type = FF_THREAD_SLICE;
+    if(mode_ == kBackgroundScrubMode) {
+      codec_context_->thread_count = 1;
+    }
+    codec_context_->lowres = std::min<int>(codec->max_lowres, kScrubLowres);
+    codec_context_->skip_loop_filter = AVDISCARD_ALL;
+    codec_context_->skip_frame = AVDISCARD_NONKEY;
+  }
+  if(avcodec_open2(codec_context_, codec, nullptr) < 0) {
+    close();
+    return false;
+  }
+  frame_ = av_frame_alloc();
+  return true;
+}
+
+void FrameDecoder::close() {
+  av_packet_unref(&packet_);
+  converter_.close();
+  converter_size_ = QSize();
+  if(codec_context_ != nullptr) {
+    avcodec_free_context(&codec_context_);
+  }
+  io_.closeInput(&format_context_);
+  if(frame_ != nullptr) {
+    av_frame_free(&frame_);
+  }
+  stream_index_ = -1;
+}
+
+bool FrameDecoder::decode(
+    const FrameIndex &index,
+    qint64 first,
+    qint64 last,
+    const FrameCallback &callback,
+    const AbortCheck &aborted) {
+  return decodeRaw(index, first, last,
+    [this, &callback](qint64 frame, const AVFrame *decoded) {
+      if(initConverter() == false) {
+        return false;
+      }
+      return callback(frame, converter_.convert(decoded));
+    },
+    aborted);
+}
+
+bool FrameDecoder::decodeRaw(
+    const FrameIndex &index,
+    qint64 first,
+    qint64 last,
+    const RawFrameCallback &callback,
+    const AbortCheck &aborted) {
+  if(format_context_ == nullptr || first < 0 || last >= index.size()) {
+    return false;
+  }
+  qint64 keyframe = index.keyframeBefore(first);
+  keyframe = keyframe < 0 ? 0 : keyframe;
+  if(seek(index.pts(keyframe)) == false) {
+    return false;
+  }
+  qint64 dec_frame = keyframe - 1;
+  while(receiveFrame() == true) {
+    // Frames before the range can take a whole GOP to decode, so a
+    // cancel is noticed between any two frames.
+    if(aborted && aborted()) {
+      return false;
+    }
+    qint64 frame = index.frameForPts(frame_->best_effort_timestamp);
+    dec_frame = frame >= 0 ? frame : dec_frame + 1;
+    if(dec_frame < first) {
+      continue;
+    }
+    if(callback(dec_frame, frame_) == false) {
+      return false;
+    }
+    if(dec_frame >= last) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FrameDecoder::decodeKeyframe(
+    qint64 pts,
+    QImage &image,
+    qint64 &keyframe_pts) {
+  if(format_context_ == nullptr || seek(pts) == false) {
+    return false;
+  }
+  while(true) {
+    av_packet_unref(&packet_);
+    int status = av_read_frame(format_context_, &packet_);
+    if(status == AVERROR(EAGAIN)) {
+      continue;
+    }
+    if(status < 0) {
+      return false;
+    }
+    if(packet_.stream_index == stream_index_ &&
+        (packet_.flags & AV_PKT_FLAG_KEY) != 0) {
+      break;
+    }
+  }
+  if(avcodec_send_packet(codec_context_, &packet_) < 0) {
+    return false;
+  }
+  // Drain instead of reading on, since frames after the keyframe are
+  // skipped and the decoder would otherwise wait for the next keyframe.
+  avcodec_send_packet(codec_context_, nullptr);
+  eof_sent_ = true;
+  if(avcodec_receive_frame(codec_context_, frame_) != 0 ||
+      initConverter() == false) {
+    return false;
+  }
+  keyframe_pts = frame_->best_effort_timestamp;
+  image = converter_.convert(frame_);
+  return true;
+}
+
+double FrameDecoder::duration() const {
+  if(format_context_ == nullptr) {
+    return 0.0;
+  }
+  AVStream *stream = format_context_->streams[stream_index_];
+  if(stream->duration != AV_NOPTS_VALUE) {
+    return stream->duration * av_q2d(stream->time_base);
+  }
+  if(format_context_->duration != AV_NOPTS_VALUE) {
+    return static_cast<double>(format_context_->duration) / AV_TIME_BASE;
+  }
+  return 0.0;
+}
+
+qint64 FrameDecoder::timeToPts(double seconds) const {
+  if(format_context_ == nullptr) {
+    return 0;
+  }
+  AVStream *stream = format_context_->streams[stream_index_];
+  const qint64 start =
+    stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+  return start + qRound64(seconds / av_q2d(stream->time_base));
+}
+
+bool FrameDecoder::seek(qint64 pts) {
+  if(av_seek_frame(
+        format_context_,
+        stream_index_,
+        pts,
+        AVSEEK_FLAG_BACKWARD) < 0) {
+    return false;
+  }
+  avcodec_flush_buffers(codec_context_);
+  eof_sent_ = false;
+  return true;
+}
+
+bool FrameDecoder::receiveFrame() {
+  while(true) {
+    int status = avcodec_receive_frame(codec_context_, frame_);
+    if(status == 0) {
+      return true;
+    }
+    if(status != AVERROR(EAGAIN) || sendPacket() == false) {
+      return false;
+    }
+  }
+}
+
+bool FrameDecoder::sendPacket() {
+  if(eof_sent_ == true) {
+    return false;
+  }
+  while(true) {
+    av_packet_unref(&packet_);
+    int status = av_read_frame(format_context_, &packet_);
+    if(status == AVERROR(EAGAIN)) {
+      continue;
+    }
+    if(status < 0) {
+      eof_sent_ = true;
+      return avcodec_send_packet(codec_context_, nullptr) == 0;
+    }
+    if(packet_.stream_index != stream_index_) {
+      continue;
+    }
+    status = avcodec_send_packet(codec_context_, &packet_);
+    if(status == 0) {
+      return true;
+    }
+    if(status != AVERROR_INVALIDDATA) {
+      return false;
+    }
+  }
+}
+
+bool FrameDecoder::initConverter() {
+  const QSize size(frame_->width, frame_->height);
+  if(size == converter_size_) {
+    return true;
+  }
+  converter_size_ = QSize();
+  bool ok = false;
+  if(mode_ != kFullMode && size.width() > kScrubWidth) {
+    ok = converter_.init(
+        size.width(),
+        size.height(),
+        static_cast<AVPixelFormat>(frame_->format),
+        kScrubWidth,
+        (size.height() * kScrubWidth / size.width()) & ~1,
+        SWS_FAST_BILINEAR);
+  }
+  else {
+    ok = converter_.init(
+        size.width(),
+        size.height(),
+        static_cast<AVPixelFormat>(frame_->format));
+  }
+  if(ok == true) {
+    converter_size_ = size;
+  }
+  return ok;
+}
+
+}} // namespace tator::video_annotator
@@ -0,0 +1,198 @@
+/// @file
+/// @brief Defines class for decoding ranges of frames.
+
+#ifndef VIDEO_ANNOTATOR_FRAME_DECODER_H
+#define VIDEO_ANNOTATOR_FRAME_DECODER_H
+
+#include <functional>
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+}
+
+#include "frame_converter.h"
+#include "frame_index.h"
+#include "read_ahead_io.h"
+
+namespace tator { namespace video_annotator {
+
+/// Independent decoder for a video.
+///
+/// Has its own demuxer and codec context so it can decode ranges of
+/// frames on a background thread while the player keeps its own decoder
+/// position.  Frames are numbered the same way as in Player, using a
+/// frame index built for the same video.
+class FrameDecoder {
+public:
+  /// Callback for each decoded frame.
+  ///
+  /// Receives the frame number and image, returns false to stop decoding.
+  typedef std::function<bool(qint64, const QImage&)> FrameCallback;
+
+  /// Callback for each decoded frame before conversion.
+  ///
+  /// Receives the frame number and the decoded frame, which is only
+  /// valid during the call, returns false to stop decoding.
+  typedef std::function<bool(qint64, const AVFrame*)> RawFrameCallback;
+
+  /// Predicate checked for each decoded frame, returns true to stop
+  /// decoding.
+  typedef std::function<bool()> AbortCheck;
+
+  /// Decoding modes.
+  enum Mode {
+    kFullMode, ///< Decodes every frame at full resolution.
+    kScrubMode, ///< Decodes keyframes at reduced resolution.
+    kBackgroundScrubMode ///< Same as kScrubMode but single threaded.
+  };
+
+  /// Constructor.
+  FrameDecoder();
+
+  /// Destructor.
+  ~FrameDecoder();
+
+  /// Opens a video.
+  ///
+  /// In scrub modes only keyframes are decoded, at reduced resolution
+  /// where the codec supports it and without loop filtering, and images
+  /// are downscaled.  Use decodeKeyframe in these modes.
+  ///
+  /// @param filename Path to video.
+  /// @param mode Decoding mode.
+  /// @return True if successful, false otherwise.
+  bool open(const QString &filename, Mode mode = kFullMode);
+
+  /// Closes the video.
+  void close();
+
+  /// Decodes a range of frames.
+  ///
+  /// Seeks to the nearest keyframe at or before the first frame and
+  /// decodes forward.  Both frames must be in the index.
+  ///
+  /// @param index Frame index of the video.
+  /// @param first First frame passed to the callback.
+  /// @param last Last frame passed to the callback.
+  /// @param callback Called for each frame in the range.
+  /// @param aborted Checked for every decoded frame, including those
+  ///   before the range, empty to never stop.
+  /// @return True if the last frame was reached, false otherwise.
+  bool decode(
+      const FrameIndex &index,
+      qint64 first,
+      qint64 last,
+      const FrameCallback &callback,
+      const AbortCheck &aborted = AbortCheck());
+
+  /// Decodes a range of frames without converting them.
+  ///
+  /// Same as decode, but passes decoded frames to the callback.  Use
+  /// av_frame_ref in the callback to keep a frame.
+  ///
+  /// @param index Frame index of the video.
+  /// @param first First frame passed to the callback.
+  /// @param last Last frame passed to the callback.
+  /// @param callback Called for each frame in the range.
+  /// @param aborted Checked for every decoded frame, including those
+  ///   before the range, empty to never stop.
+  /// @return True if the last frame was reached, false otherwise.
+  bool decodeRaw(
+      const FrameIndex &index,
+      qint64 first,
+      qint64 last,
+      const RawFrameCallback &callback,
+      const AbortCheck &aborted = AbortCheck());
+
+  /// Decodes the keyframe at or before a timestamp.
+  ///
+  /// Does not need a frame index, so it can be used while the video is
+  /// still being indexed.
+  ///
+  /// @param pts Presentation timestamp to seek to.
+  /// @param image Receives the keyframe.
+  /// @param keyframe_pts Receives the presentation timestamp of the
+  ///   keyframe.
+  /// @return True if successful, false otherwise.
+  bool decodeKeyframe(qint64 pts, QImage &image, qint64 &keyframe_pts);
+
+  /// Returns the duration of the video stream in seconds, 0 if unknown.
+  double duration() const;
+
+  /// Converts a time from the start of the video stream to a timestamp.
+  ///
+  /// @param seconds Time from start of stream.
+  /// @return Timestamp in stream time base.
+  qint64 timeToPts(double seconds) const;
+private:
+  /// Format context.
+  AVFormatContext *format_context_;
+
+  /// Demuxer input with read-ahead for network mounts.
+  ReadAheadIO io_;
+
+  /// Codec context.
+  AVCodecContext *codec_context_;
+
+  /// Packet.
+  AVPacket packet_;
+
+  /// Most recent frame.
+  AVFrame *frame_;
+
+  /// Converts decoded frames to images.
+  FrameConverter converter_;
+
+  /// Index of video stream.
+  int stream_index_;
+
+  /// Decoding mode.
+  Mode mode_;
+
+  /// True after the end of the stream was sent to the decoder.
+  bool eof_sent_;
+
+  /// Size of frames converter_ was initialized for.
+  QSize converter_size_;
+
+  /// Seeks to the keyframe at or before a timestamp and flushes the
+  /// decoder.
+  ///
+  /// @param pts Presentation timestamp.
+  /// @return True if successful, false otherwise.
+  bool seek(qint64 pts);
+
+  /// Receives the next frame into frame_, sending packets as needed.
+  ///
+  /// @return True if a frame was received, false at end of stream or on
+  ///   error.
+  bool receiveFrame();
+
+  /// Reads the next video packet and sends it to the decoder.
+  ///
+  /// At the end of the file, starts draining the decoder instead.
+  ///
+  /// @return True if a packet or the end of stream was sent.
+  bool sendPacket();
+
+  /// Prepares converter_ for the size of the most recent frame.
+  ///
+  /// @return True if successful, false otherwise.
+  bool initConverter();
+
+  FrameDecoder(const FrameDecoder&) = delete;
+  FrameDecoder& operator=(const FrameDecoder&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FRAME_DECODER_H
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <cstring>
+
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+#include "frame_index.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+
+/// Identifies a frame index file.
+static const char kMagic[4] = {'T', 'I', 'D', 'X'};
+
+/// Current version of the frame index file format.
+static const quint32 kVersion = 2;
+
+/// Header flag indicating monotonic timestamps.
+static const quint32 kFlagMonotonic = 1;
+
+/// Header of a frame index file.
+///
+/// Followed by the timestamp array, the sorted frame array (only if
+/// timestamps are not monotonic) and the keyframe bits.
+struct FileHeader {
+  char magic[4]; ///< Must equal kMagic.
+  quint32 version; ///< File format version.
+  qint64 size; ///< Number of frames.
+  quint32 flags; ///< Combination of header flags.
+  quint32 reserved; ///< Pads header to a multiple of eight bytes.
+};
+
+/// Computes size of the keyframe bit array.
+qint64 keyBytes(qint64 size) {
+  return (size + 7) / 8;
+}
+
+} // namespace
+
+FrameIndex::FrameIndex()
+  : lock_()
+  , pts_store_()
+  , key_store_()
+  , order_store_()
+  , pts_(nullptr)
+  , key_(nullptr)
+  , order_(nullptr)
+  , size_(0)
+  , monotonic_(true)
+  , complete_(false)
+  , file_(nullptr) {
+}
+
+FrameIndex::~FrameIndex() {
+  clear();
+}
+
+void FrameIndex::clear() {
+  QWriteLocker locker(&lock_);
+  clearUnlocked();
+}
+
+void FrameIndex::clearUnlocked() {
+  pts_store_.clear();
+  pts_store_.shrink_to_fit();
+  key_store_.clear();
+  key_store_.shrink_to_fit();
+  order_store_.clear();
+  order_store_.shrink_to_fit();
+  pts_ = nullptr;
+  key_ = nullptr;
+  order_ = nullptr;
+  size_ = 0;
+  monotonic_ = true;
+  complete_ = false;
+  file_.reset(nullptr);
+}
+
+void FrameIndex::reserve(qint64 num_frames) {
+  QWriteLocker locker(&lock_);
+  pts_store_.reserve(num_frames);
+  key_store_.reserve(keyBytes(num_frames));
+}
+
+void FrameIndex::append(const std::vector<Entry> &entries) {
+  QWriteLocker locker(&lock_);
+  for(const auto &entry : entries) {
+    if(size_ > 0 && entry.pts <= pts_store_.back()) {
+      monotonic_ = false;
+    }
+    if(size_ % 8 == 0) {
+      key_store_.push_back(0);
+    }
+    if(entry.keyframe) {
+      key_store_.back() |= static_cast<quint8>(1 << (size_ % 8));
+    }
+    pts_store_.push_back(entry.pts);
+    ++size_;
+  }
+  useStore();
+}
+
+void FrameIndex::finalize() {
+  QWriteLocker locker(&lock_);
+  order_store_.clear();
+  if(monotonic_ == false) {
+    order_store_.resize(size_);
+    for(qint64 i = 0; i < size_; ++i) {
+      order_store_[i] = static_cast<quint32>(i);
+    }
+    const qint64 *pts = pts_store_.data();
+    std::stable_sort(order_store_.begin(), order_store_.end(),
+      [pts](quint32 lhs, quint32 rhs) {
+        return pts[lhs] < pts[rhs];
+      });
+  }
+  useStore();
+  complete_ = true;
+}
+
+bool FrameIndex::complete() const {
+  QReadLocker locker(&lock_);
+  return complete_;
+}
+
+qint64 FrameIndex::size() const {
+  QReadLocker locker(&lock_);
+  return size_;
+}
+
+bool FrameIndex::empty() const {
+  QReadLocker locker(&lock_);
+  return size_ == 0;
+}
+
+qint64 FrameIndex::pts(qint64 frame) const {
+  QReadLocker locker(&lock_);
+  return pts_[frame];
+}
+
+qint64 FrameIndex::firstPts() const {
+  QReadLocker locker(&lock_);
+  if(monotonic_ == false && order_ == nullptr) {
+    return *std::min_element(pts_, pts_ + size_);
+  }
+  return monotonic_ ? pts_[0] : pts_[order_[0]];
+}
+
+bool FrameIndex::isKeyframe(qint64 frame) const {
+  QReadLocker locker(&lock_);
+  return (key_[frame / 8] >> (frame % 8)) & 1;
+}
+
+qint64 FrameIndex::keyframeBefore(qint64 frame) const {
+  QReadLocker locker(&lock_);
+  if(frame >= size_) {
+    frame = size_ - 1;
+  }
+  if(frame < 0) {
+    return -1;
+  }
+  // Skip whole bytes of non-keyframes.
+  quint8 bits = key_[frame / 8] & static_cast<quint8>((2 << (frame % 8)) - 1);
+  for(qint64 byte = frame / 8; byte >= 0; --byte) {
+    if(byte != frame / 8) {
+      bits = key_[byte];
+    }
+    if(bits != 0) {
+      int bit = 7;
+      while(((bits >> bit) & 1) == 0) {
+        --bit;
+      }
+      return byte * 8 + bit;
+    }
+  }
+  return -1;
+}
+
+qint64 FrameIndex::frameForPts(qint64 pts) const {
+  QReadLocker locker(&lock_);
+  if(monotonic_ == false && order_ == nullptr) {
+    // Lookup table is built by finalize, search while still appending.
+    const qint64 *it = std::find(pts_, pts_ + size_, pts);
+    return it != pts_ + size_ ? it - pts_ : -1;
+  }
+  if(monotonic_) {
+    const qint64 *it = std::lower_bound(pts_, pts_ + size_, pts);
+    if(it != pts_ + size_ && *it == pts) {
+      return it - pts_;
+    }
+  }
+  else {
+    const qint64 *stamps = pts_;
+    const quint32 *it = std::lower_bound(order_, order_ + size_, pts,
+      [stamps](quint32 frame, qint64 value) {
+        return stamps[frame] < value;
+      });
+    if(it != order_ + size_ && pts_[*it] == pts) {
+      return *it;
+    }
+  }
+  return -1;
+}
+
+bool FrameIndex::save(const QString &path) const {
+  QReadLocker locker(&lock_);
+  QDir().mkpath(QFileInfo(path).absolutePath());
+  QSaveFile file(path);
+  if(file.open(QIODevice::WriteOnly) == false) {
+    return false;
+  }
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.size = size_;
+  header.flags = monotonic_ ? kFlagMonotonic : 0;
+  header.reserved = 0;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(pts_), size_ * sizeof(qint64));
+  if(monotonic_ == false) {
+    file.write(
+        reinterpret_cast<const char*>(order_),
+        size_ * sizeof(quint32));
+  }
+  file.write(reinterpret_cast<const char*>(key_), keyBytes(size_));
+  return file.commit();
+}
+
+bool FrameIndex::load(const QString &path) {
+  QWriteLocker locker(&lock_);
+  clearUnlocked();
+  std::unique_ptr<QFile> file(new QFile(path));
+  if(file->open(QIODevice::ReadOnly) == false) {
+    return false;
+  }
+  const qint64 file_size = file->size();
+  if(file_size < static_cast<qint64>(sizeof(FileHeader))) {
+    return false;
+  }
+  uchar *map = file->map(0, file_size);
+  if(map == nullptr) {
+    return false;
+  }
+  FileHeader header;
+  std::memcpy(&header, map, sizeof(header));
+  if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      header.size <= 0 ||
+      header.size > 0xffffffffLL) {
+    return false;
+  }
+  const bool monotonic = (header.flags & kFlagMonotonic) != 0;
+  qint64 expected = sizeof(FileHeader) + header.size * sizeof(qint64);
+  if(monotonic == false) {
+    expected += header.size * sizeof(quint32);
+  }
+  expected += keyBytes(header.size);
+  if(file_size != expected) {
+    return false;
+  }
+  uchar *pos = map + sizeof(FileHeader);
+  pts_ = reinterpret_cast<const qint64*>(pos);
+  pos += header.size * sizeof(qint64);
+  if(monotonic == false) {
+    order_ = reinterpret_cast<const quint32*>(pos);
+    pos += header.size * sizeof(quint32);
+  }
+  key_ = reinterpret_cast<const quint8*>(pos);
+  size_ = header.size;
+  monotonic_ = monotonic;
+  complete_ = true;
+  file_ = std::move(file);
+  return true;
+}
+
+QString FrameIndex::cachePath(const QString &video_path) {
+  QFileInfo info(video_path);
+  QString key = QString("%1|%2|%3")
+    .arg(info.absoluteFilePath())
+    .arg(info.size())
+    .arg(info.lastModified().toMSecsSinceEpoch());
+  QString hash = QCryptographicHash::hash(
+      key.toUtf8(), QCryptographicHash::Sha1).toHex();
+  QString cache_dir = QStandardPaths::writableLocation(
+      QStandardPaths::CacheLocation);
+  return cache_dir + QStringLiteral("/frame_index/") + hash +
+    QStringLiteral(".idx");
+}
+
+void FrameIndex::useStore() {
+  pts_ = pts_store_.data();
+  key_ = key_store_.data();
+  order_ = order_store_.empty() ? nullptr : order_store_.data();
+}
+
+}} // namespace tator::video_annotator
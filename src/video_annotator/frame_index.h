@@ -0,0 +1,169 @@
+/// @file
+/// @brief Defines class for mapping frame numbers to video timestamps.
+
+#ifndef VIDEO_ANNOTATOR_FRAME_INDEX_H
+#define VIDEO_ANNOTATOR_FRAME_INDEX_H
+
+#include <vector>
+#include <memory>
+
+#include <QString>
+#include <QFile>
+#include <QReadWriteLock>
+
+namespace tator { namespace video_annotator {
+
+/// Table of presentation timestamps and keyframe flags indexed by frame.
+///
+/// Entries are stored in flat arrays rather than node based containers
+/// so that multi-million frame videos stay compact in memory.  The
+/// table can be saved to a binary file and later memory mapped, in which
+/// case the arrays point directly into the mapped file.
+///
+/// Entries may be appended from one thread while another thread reads,
+/// which allows a partially built index to be used during a background
+/// scan.
+class FrameIndex {
+public:
+  /// Index entry for one frame.
+  struct Entry {
+    qint64 pts; ///< Presentation timestamp.
+    bool keyframe; ///< True if the frame is a keyframe.
+  };
+
+  /// Constructor.
+  FrameIndex();
+
+  /// Destructor.
+  ~FrameIndex();
+
+  /// Removes all entries and releases any mapped file.
+  void clear();
+
+  /// Reserves storage for entries.
+  ///
+  /// @param num_frames Expected number of frames.
+  void reserve(qint64 num_frames);
+
+  /// Appends entries for the next frames.
+  ///
+  /// Not valid on an index loaded from file.
+  ///
+  /// @param entries Entries in frame order.
+  void append(const std::vector<Entry> &entries);
+
+  /// Builds lookup tables after the last entry is appended and marks
+  /// the index as complete.
+  void finalize();
+
+  /// Checks whether every frame of the video is in the index.
+  ///
+  /// @return True if complete, false if still being built.
+  bool complete() const;
+
+  /// Gets number of frames in the index.
+  ///
+  /// @return Number of frames.
+  qint64 size() const;
+
+  /// Checks whether index has any entries.
+  ///
+  /// @return True if empty, false otherwise.
+  bool empty() const;
+
+  /// Gets the presentation timestamp of a frame.
+  ///
+  /// @param frame Frame number, must be less than size().
+  /// @return Presentation timestamp.
+  qint64 pts(qint64 frame) const;
+
+  /// Gets the smallest presentation timestamp in the index.
+  ///
+  /// @return Smallest presentation timestamp.
+  qint64 firstPts() const;
+
+  /// Checks whether a frame is a keyframe.
+  ///
+  /// @param frame Frame number, must be less than size().
+  /// @return True if keyframe, false otherwise.
+  bool isKeyframe(qint64 frame) const;
+
+  /// Finds the nearest keyframe at or before a frame.
+  ///
+  /// @param frame Frame number, clamped to the indexed range.
+  /// @return Keyframe number, or -1 if no keyframe precedes the frame.
+  qint64 keyframeBefore(qint64 frame) const;
+
+  /// Finds the frame with a given presentation timestamp.
+  ///
+  /// @param pts Presentation timestamp.
+  /// @return Frame number, or -1 if no frame has this timestamp.
+  qint64 frameForPts(qint64 pts) const;
+
+  /// Saves index to a binary file.
+  ///
+  /// @param path Path to output file.
+  /// @return True if successful, false otherwise.
+  bool save(const QString &path) const;
+
+  /// Loads index from a binary file by memory mapping it.
+  ///
+  /// @param path Path to input file.
+  /// @return True if successful, false otherwise.
+  bool load(const QString &path);
+
+  /// Gets path to the cached index file for a video.
+  ///
+  /// The cache lives in the per user cache directory and is keyed
+  /// by the absolute path, size and modification time of the video.
+  ///
+  /// @param video_path Path to video.
+  /// @return Path to index file.
+  static QString cachePath(const QString &video_path);
+private:
+  /// Guards all members against concurrent append and lookup.
+  mutable QReadWriteLock lock_;
+
+  /// Presentation timestamps owned by this object.
+  std::vector<qint64> pts_store_;
+
+  /// Keyframe bits owned by this object.
+  std::vector<quint8> key_store_;
+
+  /// Frames sorted by timestamp owned by this object.
+  std::vector<quint32> order_store_;
+
+  /// Presentation timestamps, one per frame.
+  const qint64 *pts_;
+
+  /// Keyframe flags, one bit per frame.
+  const quint8 *key_;
+
+  /// Frames sorted by timestamp, only used if timestamps are not monotonic.
+  const quint32 *order_;
+
+  /// Number of frames.
+  qint64 size_;
+
+  /// True if timestamps increase with frame number.
+  bool monotonic_;
+
+  /// True if every frame of the video is in the index.
+  bool complete_;
+
+  /// Memory mapped index file, if loaded from file.
+  std::unique_ptr<QFile> file_;
+
+  /// Updates array pointers to refer to owned storage.
+  void useStore();
+
+  /// Removes all entries without locking.
+  void clearUnlocked();
+
+  FrameIndex(const FrameIndex&) = delete;
+  FrameIndex& operator=(const FrameIndex&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FRAME_INDEX_H
@@ -0,0 +1,115 @@
+#include <queue>
+#include <vector>
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "frame_indexer.h"
+#include "read_ahead_io.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Number of entries published to the index at once.
+  static const int kBatchSize = 256;
+
+  /// Number of packets held back to sort frames into presentation order,
+  /// must exceed the largest reordering delay of supported codecs.
+  static const size_t kReorderWindow = 32;
+}
+
+FrameIndexer::FrameIndexer(const QString &filename, FrameIndex *index)
+  : QObject()
+  , filename_(filename)
+  , index_(index)
+  , abort_(false) {
+}
+
+void FrameIndexer::abort() {
+  abort_ = true;
+}
+
+void FrameIndexer::run() {
+  AVFormatContext *format_context = avformat_alloc_context();
+  AVPacket packet;
+  av_init_packet(&packet);
+  packet.data = nullptr;
+  packet.size = 0;
+  bool complete = false;
+  ReadAheadIO io;
+  int status = io.openInput(&format_context, filename_);
+  if(status == 0) {
+    status = avformat_find_stream_info(format_context, nullptr);
+  }
+  int stream_index = -1;
+  if(status >= 0) {
+    stream_index = av_find_best_stream(
+        format_context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  }
+  if(stream_index >= 0) {
+    // Packets arrive in decode order, a min heap over a window of them
+    // puts frames in presentation order.
+    auto later = [](
+        const FrameIndex::Entry &lhs,
+        const FrameIndex::Entry &rhs) {
+      return lhs.pts > rhs.pts;
+    };
+    std::priority_queue<
+      FrameIndex::Entry,
+      std::vector<FrameIndex::Entry>,
+      decltype(later)> reorder(later);
+    std::vector<FrameIndex::Entry> batch;
+    batch.reserve(kBatchSize);
+    qint64 frame_index = 0;
+    while(abort_ == false) {
+      av_packet_unref(&packet);
+      status = av_read_frame(format_context, &packet);
+      if(status < 0) {
+        complete = true;
+      }
+      else if(packet.stream_index != stream_index) {
+        continue;
+      }
+      else {
+        const qint64 pts =
+          packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+        if(pts == AV_NOPTS_VALUE) {
+          continue;
+        }
+        reorder.push({pts, (packet.flags & AV_PKT_FLAG_KEY) != 0});
+      }
+      while(reorder.empty() == false &&
+          (complete == true || reorder.size() > kReorderWindow)) {
+        batch.push_back(reorder.top());
+        reorder.pop();
+        ++frame_index;
+        if(frame_index % 1000 == 0) {
+          emit progress(frame_index / 1000);
+        }
+      }
+      if(complete == true) {
+        break;
+      }
+      if(static_cast<int>(batch.size()) >= kBatchSize) {
+        index_->append(batch);
+        batch.clear();
+      }
+    }
+    index_->append(batch);
+  }
+  av_packet_unref(&packet);
+  io.closeInput(&format_context);
+  if(complete == true) {
+    index_->finalize();
+  }
+  emit finished(complete);
+}
+
+#include "moc_frame_indexer.cpp"
+
+}} // namespace tator::video_annotator
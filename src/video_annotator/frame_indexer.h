@@ -0,0 +1,61 @@
+/// @file
+/// @brief Defines class for building a frame index in the background.
+
+#ifndef VIDEO_ANNOTATOR_FRAME_INDEXER_H
+#define VIDEO_ANNOTATOR_FRAME_INDEXER_H
+
+#include <atomic>
+
+#include <QObject>
+#include <QString>
+
+#include "frame_index.h"
+
+namespace tator { namespace video_annotator {
+
+/// Scans every packet of a video and appends the results to a frame index.
+///
+/// Intended to be moved to its own thread.  It opens its own demuxer so
+/// the player can keep decoding while the scan runs, and publishes
+/// entries to the index in small batches so that a partial index can be
+/// used before the scan finishes.  Packets are only demuxed, not decoded,
+/// and frames are numbered in presentation timestamp order.
+class FrameIndexer : public QObject {
+  Q_OBJECT
+public:
+  /// Constructor.
+  ///
+  /// @param filename Path to video.
+  /// @param index Index to be filled, must outlive this object.
+  FrameIndexer(const QString &filename, FrameIndex *index);
+
+  /// Requests that a running scan stop as soon as possible.
+  void abort();
+public slots:
+  /// Scans the video.
+  void run();
+signals:
+  /// Emitted periodically during the scan.
+  ///
+  /// @param progress Number of frames indexed so far, in thousands.
+  void progress(int progress);
+
+  /// Emitted when the scan ends.
+  ///
+  /// @param complete True if the whole video was indexed, false if the
+  ///   scan was aborted or failed.
+  void finished(bool complete);
+private:
+  /// Path to video.
+  QString filename_;
+
+  /// Index to be filled.
+  FrameIndex *index_;
+
+  /// True when scan should stop.
+  std::atomic<bool> abort_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FRAME_INDEXER_H
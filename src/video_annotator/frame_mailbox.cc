@@ -0,0 +1,56 @@
+#include <QMutexLocker>
+
+#include "frame_mailbox.h"
+#include "pipeline_stats.h"
+
+namespace tator { namespace video_annotator {
+
+FrameMailbox::FrameMailbox(QObject *parent)
+  : QObject(parent)
+  , mutex_()
+  , image_()
+  , frame_(0)
+  , pending_(false)
+  , dropped_(0)
+  , posted_() {
+}
+
+qint64 FrameMailbox::dropped() const {
+  QMutexLocker locker(&mutex_);
+  return dropped_;
+}
+
+void FrameMailbox::post(QImage image, qint64 frame) {
+  QMutexLocker locker(&mutex_);
+  image_ = image;
+  frame_ = frame;
+  if(pending_ == true) {
+    ++dropped_;
+    return;
+  }
+  pending_ = true;
+  posted_.start();
+  QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void FrameMailbox::deliver() {
+  QImage image;
+  qint64 frame = 0;
+  {
+    QMutexLocker locker(&mutex_);
+    if(pending_ == false) {
+      return;
+    }
+    pending_ = false;
+    image.swap(image_);
+    frame = frame_;
+    if(pipelineStatsEnabled() == true) {
+      recordStage(kDeliveryStage, posted_.nsecsElapsed());
+    }
+  }
+  emit frameReady(image, frame);
+}
+
+#include "moc_frame_mailbox.cpp"
+
+}} // namespace tator::video_annotator
@@ -0,0 +1,70 @@
+/// @file
+/// @brief Defines class for handing the latest frame to the GUI thread.
+
+#ifndef VIDEO_ANNOTATOR_FRAME_MAILBOX_H
+#define VIDEO_ANNOTATOR_FRAME_MAILBOX_H
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+
+namespace tator { namespace video_annotator {
+
+/// Single slot mailbox between the player and the GUI thread.
+///
+/// Frames are posted from any thread and delivered on the thread that
+/// owns the mailbox.  A frame that has not been delivered yet is replaced
+/// by the next one, so a busy GUI thread never builds up a queue of stale
+/// frames and the player is never blocked by painting.
+class FrameMailbox : public QObject {
+  Q_OBJECT
+public:
+  /// Constructor.
+  ///
+  /// @param parent Parent object.
+  explicit FrameMailbox(QObject *parent = nullptr);
+
+  /// Returns number of frames replaced before they were delivered.
+  qint64 dropped() const;
+public slots:
+  /// Posts a frame, replacing any frame not yet delivered.
+  ///
+  /// Thread safe.  Connect with Qt::DirectConnection so it runs on the
+  /// posting thread.
+  ///
+  /// @param image Frame image.
+  /// @param frame Frame number.
+  void post(QImage image, qint64 frame);
+signals:
+  /// Emitted on the owning thread with the latest posted frame.
+  ///
+  /// @param image Frame image.
+  /// @param frame Frame number.
+  void frameReady(QImage image, qint64 frame);
+private slots:
+  /// Emits the frame in the mailbox, if any.
+  void deliver();
+private:
+  /// Guards all other members.
+  mutable QMutex mutex_;
+
+  /// Frame waiting to be delivered.
+  QImage image_;
+
+  /// Frame number of image_.
+  qint64 frame_;
+
+  /// True if deliver is queued.
+  bool pending_;
+
+  /// Number of frames replaced before they were delivered.
+  qint64 dropped_;
+
+  /// Started when deliver is queued.
+  QElapsedTimer posted_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FRAME_MAILBOX_H
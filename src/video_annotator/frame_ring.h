@@ -0,0 +1,119 @@
+/// @file
+/// @brief Defines a lock-free ring buffer for passing decoded frames.
+
+#ifndef VIDEO_ANNOTATOR_FRAME_RING_H
+#define VIDEO_ANNOTATOR_FRAME_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace tator { namespace video_annotator {
+
+/// Bounded single producer, single consumer queue.
+///
+/// One thread may call push while another calls pop, without locks.
+/// Capacity is rounded up to a power of two.
+///
+/// @tparam T Type of element, must be default constructible.
+template<typename T>
+class FrameRing {
+public:
+  /// Constructor.
+  ///
+  /// @param capacity Maximum number of elements in the ring.
+  explicit FrameRing(std::size_t capacity)
+    : slots_()
+    , mask_(0)
+    , head_(0)
+    , tail_(0) {
+    std::size_t size = 1;
+    while(size < capacity) size <<= 1;
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  /// Adds an element.  Called from the producer thread only.
+  ///
+  /// @param item Element to add.
+  /// @return True if added, false if the ring is full.
+  bool push(T item) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    const std::size_t tail = tail_.load(std::memory_order_acquire);
+    if(head - tail == slots_.size()) {
+      return false;
+    }
+    slots_[head & mask_] = std::move(item);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Removes the oldest element.  Called from the consumer thread only.
+  ///
+  /// @param item Receives the removed element.
+  /// @return True if an element was removed, false if the ring is empty.
+  bool pop(T &item) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    const std::size_t head = head_.load(std::memory_order_acquire);
+    if(tail == head) {
+      return false;
+    }
+    item = std::move(slots_[tail & mask_]);
+    slots_[tail & mask_] = T();
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Copies the oldest element without removing it.  Called from the
+  /// consumer thread only.
+  ///
+  /// @param item Receives a copy of the oldest element.
+  /// @return True if an element was copied, false if the ring is empty.
+  bool peek(T &item) const {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    const std::size_t head = head_.load(std::memory_order_acquire);
+    if(tail == head) {
+      return false;
+    }
+    item = slots_[tail & mask_];
+    return true;
+  }
+
+  /// Checks whether the ring is full.
+  ///
+  /// @return True if full, false otherwise.
+  bool full() const {
+    return head_.load(std::memory_order_acquire) -
+      tail_.load(std::memory_order_acquire) == slots_.size();
+  }
+
+  /// Checks whether the ring is empty.
+  ///
+  /// @return True if empty, false otherwise.
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+      tail_.load(std::memory_order_acquire);
+  }
+
+  /// Removes all elements.  Only valid while no producer is running.
+  void clear() {
+    T item;
+    while(pop(item));
+  }
+private:
+  /// Storage for elements.
+  std::vector<T> slots_;
+
+  /// Maps a position to a slot index.
+  std::size_t mask_;
+
+  /// Position of the next element to be pushed.
+  std::atomic<std::size_t> head_;
+
+  /// Position of the next element to be popped.
+  std::atomic<std::size_t> tail_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FRAME_RING_H
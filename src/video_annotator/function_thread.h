@@ -0,0 +1,35 @@
+/// @file
+/// @brief Defines a thread that runs a function.
+
+#ifndef VIDEO_ANNOTATOR_FUNCTION_THREAD_H
+#define VIDEO_ANNOTATOR_FUNCTION_THREAD_H
+
+#include <functional>
+
+#include <QThread>
+
+namespace tator { namespace video_annotator {
+
+/// Thread that runs a function once and then finishes.
+class FunctionThread : public QThread {
+public:
+  /// Constructor.
+  ///
+  /// @param func Function to run on the thread.
+  explicit FunctionThread(std::function<void()> func)
+    : QThread()
+    , func_(func) {
+  }
+protected:
+  /// Runs the function.
+  void run() override {
+    func_();
+  }
+private:
+  /// Function to run on the thread.
+  std::function<void()> func_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_FUNCTION_THREAD_H
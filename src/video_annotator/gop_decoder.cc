@@ -0,0 +1,87 @@
+#include <algorithm>
+
+#include "function_thread.h"
+#include "gop_decoder.h"
+
+namespace tator { namespace video_annotator {
+
+GopDecoder::GopDecoder(const FrameIndex &index)
+  : index_(index)
+  , decoder_()
+  , prefetch_thread_(nullptr)
+  , prefetch_first_(-1)
+  , prefetch_last_(-1)
+  , abort_(false) {
+}
+
+GopDecoder::~GopDecoder() {
+  close();
+}
+
+bool GopDecoder::open(const QString &filename) {
+  close();
+  return decoder_.open(filename);
+}
+
+void GopDecoder::close() {
+  cancel();
+  decoder_.close();
+}
+
+bool GopDecoder::decode(
+    qint64 last,
+    qint64 count,
+    const FrameDecoder::RawFrameCallback &callback) {
+  return decoder_.decodeRaw(index_, firstFrame(last, count), last, callback,
+    [this]() { return abort_ == true; });
+}
+
+void GopDecoder::prefetch(
+    qint64 last,
+    qint64 count,
+    FrameDecoder::RawFrameCallback callback) {
+  if(prefetching() == true) {
+    return;
+  }
+  finish();
+  prefetch_first_ = firstFrame(last, count);
+  prefetch_last_ = last;
+  prefetch_thread_.reset(new FunctionThread([this, last, count, callback]() {
+    decode(last, count, callback);
+  }));
+  prefetch_thread_->start(QThread::LowPriority);
+}
+
+bool GopDecoder::prefetching() const {
+  return prefetch_thread_ != nullptr && prefetch_thread_->isRunning();
+}
+
+void GopDecoder::waitFor(qint64 frame) {
+  if(frame < prefetch_first_ || frame > prefetch_last_) {
+    abort_ = true;
+  }
+  finish();
+}
+
+void GopDecoder::cancel() {
+  abort_ = true;
+  finish();
+}
+
+void GopDecoder::finish() {
+  if(prefetch_thread_ != nullptr) {
+    prefetch_thread_->wait();
+    prefetch_thread_.reset(nullptr);
+  }
+  prefetch_first_ = -1;
+  prefetch_last_ = -1;
+  abort_ = false;
+}
+
+qint64 GopDecoder::firstFrame(qint64 last, qint64 count) const {
+  // One GOP per pass, earlier GOPs are decoded by later passes.
+  const qint64 keyframe = index_.keyframeBefore(last);
+  return std::max<qint64>(std::max<qint64>(keyframe, last - count + 1), 0);
+}
+
+}} // namespace tator::video_annotator
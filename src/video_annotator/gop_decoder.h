@@ -0,0 +1,121 @@
+/// @file
+/// @brief Defines decoder of the frames preceding the playhead.
+
+#ifndef VIDEO_ANNOTATOR_GOP_DECODER_H
+#define VIDEO_ANNOTATOR_GOP_DECODER_H
+
+#include <memory>
+#include <atomic>
+
+#include <QThread>
+
+#include "frame_index.h"
+#include "frame_decoder.h"
+
+namespace tator { namespace video_annotator {
+
+/// Decodes the frames preceding the playhead, a GOP at a time.
+///
+/// Stepping or playing backward needs frames that can only be decoded
+/// forward from their keyframe.  The frames of a GOP up to a requested
+/// frame are decoded in a single pass and passed on unconverted, so the
+/// player keeps them in its frame cache and converts only the frame it
+/// shows.  The frames before those can be decoded on a background
+/// thread, so that stepping or playing backward rarely has to wait for
+/// a decode.
+class GopDecoder {
+public:
+  /// Constructor.
+  ///
+  /// @param index Frame index of the video, must outlive this object.
+  explicit GopDecoder(const FrameIndex &index);
+
+  /// Destructor.
+  ~GopDecoder();
+
+  /// Opens a video.
+  ///
+  /// @param filename Path to video.
+  /// @return True if successful, false otherwise.
+  bool open(const QString &filename);
+
+  /// Stops any prefetch and closes the video.
+  void close();
+
+  /// Decodes frames of the GOP holding a frame, up to that frame.
+  ///
+  /// Frames from the keyframe on are decoded in one pass, and at most
+  /// the last count of them are passed to the callback.  Must not be
+  /// called while a prefetch is running, see waitFor.
+  ///
+  /// @param last Last frame to decode, must be in the frame index.
+  /// @param count Maximum number of frames passed to the callback.
+  /// @param callback Called for each frame passed on.
+  /// @return True if the last frame was reached, false otherwise.
+  bool decode(
+      qint64 last,
+      qint64 count,
+      const FrameDecoder::RawFrameCallback &callback);
+
+  /// Starts decoding frames like decode on a background thread.
+  ///
+  /// Ignored while a prefetch is running.
+  ///
+  /// @param last Last frame to decode, must be in the frame index.
+  /// @param count Maximum number of frames passed to the callback.
+  /// @param callback Called on the background thread for each frame
+  ///   passed on.
+  void prefetch(
+      qint64 last,
+      qint64 count,
+      FrameDecoder::RawFrameCallback callback);
+
+  /// Returns true while a prefetch is running.
+  bool prefetching() const;
+
+  /// Finishes the current prefetch, if any.
+  ///
+  /// Waits for a prefetch that passes on a frame, so it is not decoded
+  /// twice, and cancels any other.
+  ///
+  /// @param frame Frame about to be decoded.
+  void waitFor(qint64 frame);
+
+  /// Stops the current prefetch and waits for it.
+  void cancel();
+private:
+  /// Frame index of the video.
+  const FrameIndex &index_;
+
+  /// Decoder used for both synchronous decodes and prefetch.
+  FrameDecoder decoder_;
+
+  /// Thread for the current prefetch, if any.
+  std::unique_ptr<QThread> prefetch_thread_;
+
+  /// First frame passed on by the current prefetch.
+  qint64 prefetch_first_;
+
+  /// Last frame passed on by the current prefetch.
+  qint64 prefetch_last_;
+
+  /// True when prefetch should stop.
+  std::atomic<bool> abort_;
+
+  /// Gets the first frame passed on when decoding up to a frame.
+  ///
+  /// @param last Last frame to decode.
+  /// @param count Maximum number of frames passed on.
+  /// @return First frame passed on.
+  qint64 firstFrame(qint64 last, qint64 count) const;
+
+  /// Waits for the current prefetch and resets its state.
+  void finish();
+
+  GopDecoder(const GopDecoder&) = delete;
+  GopDecoder& operator=(const GopDecoder&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_GOP_DECODER_H
@@ -0,0 +1,343 @@
+#include <QByteArray>
+
+#include "json_reader.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Appends a code point to a string as UTF-8.
+  void appendUtf8(uint32_t code, std::string &value) {
+    if(code < 0x80) {
+      value.push_back(static_cast<char>(code));
+    }
+    else if(code < 0x800) {
+      value.push_back(static_cast<char>(0xc0 | (code >> 6)));
+      value.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+    else if(code < 0x10000) {
+      value.push_back(static_cast<char>(0xe0 | (code >> 12)));
+      value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      value.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+    else {
+      value.push_back(static_cast<char>(0xf0 | (code >> 18)));
+      value.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+      value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+      value.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+    }
+  }
+
+  /// Reads four hex digits.
+  bool readHex(const char *&pos, const char *end, uint32_t &code) {
+    if(end - pos < 4) {
+      return false;
+    }
+    code = 0;
+    for(int i = 0; i < 4; ++i, ++pos) {
+      char c = *pos;
+      code <<= 4;
+      if(c >= '0' && c <= '9') code |= c - '0';
+      else if(c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+      else if(c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+      else return false;
+    }
+    return true;
+  }
+
+  /// Parses unsigned decimal digits.
+  bool parseDigits(const char *begin, const char *end, uint64_t &value) {
+    if(begin == end) {
+      return false;
+    }
+    value = 0;
+    for(const char *c = begin; c != end; ++c) {
+      if(*c < '0' || *c > '9') {
+        return false;
+      }
+      uint64_t digit = *c - '0';
+      if(value > (UINT64_MAX - digit) / 10) {
+        return false;
+      }
+      value = value * 10 + digit;
+    }
+    return true;
+  }
+} // namespace
+
+JsonReader::JsonReader(const char *begin, const char *end)
+  : pos_(begin)
+  , end_(end)
+  , failed_(false)
+  , first_()
+  , resumed_(false) {
+}
+
+void JsonReader::resumeArray() {
+  first_.push_back(true);
+  resumed_ = true;
+}
+
+bool JsonReader::beginObject() {
+  if(failed_ == true) return false;
+  skipSpace();
+  if(consume('{') == false) return fail();
+  first_.push_back(true);
+  return true;
+}
+
+bool JsonReader::nextMember(std::string &name) {
+  if(failed_ == true || first_.empty() == true) return fail();
+  skipSpace();
+  if(consume('}') == true) {
+    first_.pop_back();
+    return false;
+  }
+  if(first_.back() == false && consume(',') == false) return fail();
+  first_.back() = false;
+  if(readString(name) == false) return false;
+  skipSpace();
+  if(consume(':') == false) return fail();
+  return true;
+}
+
+bool JsonReader::beginArray() {
+  if(failed_ == true) return false;
+  skipSpace();
+  if(consume('[') == false) return fail();
+  first_.push_back(true);
+  return true;
+}
+
+bool JsonReader::nextElement() {
+  if(failed_ == true || first_.empty() == true) return fail();
+  skipSpace();
+  if(resumed_ == true && first_.size() == 1 && pos_ == end_) {
+    first_.pop_back();
+    return false;
+  }
+  if(consume(']') == true) {
+    first_.pop_back();
+    return false;
+  }
+  if(first_.back() == false) {
+    if(consume(',') == false) return fail();
+    skipSpace();
+  }
+  first_.back() = false;
+  return true;
+}
+
+bool JsonReader::readString(std::string &value) {
+  if(failed_ == true) return false;
+  skipSpace();
+  if(consume('"') == false) return fail();
+  value.clear();
+  for(;;) {
+    const char *start = pos_;
+    while(pos_ < end_ && *pos_ != '"' && *pos_ != '\\' &&
+        static_cast<unsigned char>(*pos_) >= 0x20) {
+      ++pos_;
+    }
+    value.append(start, pos_);
+    if(pos_ == end_) return fail();
+    char c = *pos_++;
+    if(c == '"') return true;
+    if(c != '\\' || pos_ == end_) return fail();
+    uint32_t code = 0;
+    switch(*pos_++) {
+      case '"': value.push_back('"'); break;
+      case '\\': value.push_back('\\'); break;
+      case '/': value.push_back('/'); break;
+      case 'b': value.push_back('\b'); break;
+      case 'f': value.push_back('\f'); break;
+      case 'n': value.push_back('\n'); break;
+      case 'r': value.push_back('\r'); break;
+      case 't': value.push_back('\t'); break;
+      case 'u':
+        if(readHex(pos_, end_, code) == false) return fail();
+        if(code >= 0xd800 && code < 0xdc00) {
+          // Surrogate pair.
+          uint32_t low = 0;
+          if(end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u') {
+            return fail();
+          }
+          pos_ += 2;
+          if(readHex(pos_, end_, low) == false) return fail();
+          if(low < 0xdc00 || low >= 0xe000) return fail();
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        }
+        appendUtf8(code, value);
+        break;
+      default:
+        return fail();
+    }
+  }
+}
+
+bool JsonReader::readText(std::string &value) {
+  char c = peek();
+  if(c == '"') {
+    return readString(value);
+  }
+  if(c == '{' || c == '[') return fail();
+  const char *begin = nullptr;
+  const char *end = nullptr;
+  if(readToken(begin, end) == false) return false;
+  value.assign(begin, end);
+  return true;
+}
+
+bool JsonReader::readUInt(uint64_t &value) {
+  const char *begin = nullptr;
+  const char *end = nullptr;
+  if(readToken(begin, end) == false) return false;
+  if(parseDigits(begin, end, value) == false) return fail();
+  return true;
+}
+
+bool JsonReader::readInt(int64_t &value) {
+  const char *begin = nullptr;
+  const char *end = nullptr;
+  if(readToken(begin, end) == false) return false;
+  bool negative = false;
+  if(begin != end && (*begin == '-' || *begin == '+')) {
+    negative = *begin == '-';
+    ++begin;
+  }
+  uint64_t magnitude = 0;
+  if(parseDigits(begin, end, magnitude) == false) return fail();
+  if(magnitude > static_cast<uint64_t>(INT64_MAX) + (negative ? 1 : 0)) {
+    return fail();
+  }
+  value = negative ?
+    static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+  return true;
+}
+
+bool JsonReader::readDouble(double &value) {
+  const char *begin = nullptr;
+  const char *end = nullptr;
+  if(readToken(begin, end) == false) return false;
+  // Qt converts with the C locale whatever the locale of the process.
+  bool ok = false;
+  value = QByteArray::fromRawData(
+      begin, static_cast<int>(end - begin)).toDouble(&ok);
+  if(ok == false) return fail();
+  return true;
+}
+
+bool JsonReader::readTree(boost::property_tree::ptree &tree) {
+  namespace pt = boost::property_tree;
+  char c = peek();
+  if(c == '{') {
+    beginObject();
+    std::string name;
+    while(nextMember(name) == true) {
+      auto it = tree.push_back(std::make_pair(name, pt::ptree()));
+      if(readTree(it->second) == false) return false;
+    }
+  }
+  else if(c == '[') {
+    beginArray();
+    while(nextElement() == true) {
+      auto it = tree.push_back(std::make_pair(std::string(), pt::ptree()));
+      if(readTree(it->second) == false) return false;
+    }
+  }
+  else {
+    std::string data;
+    if(readText(data) == false) return false;
+    tree.data() = data;
+  }
+  return failed_ == false;
+}
+
+bool JsonReader::skipValue() {
+  if(failed_ == true) return false;
+  char c = peek();
+  if(c != '{' && c != '[' && c != '"') {
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    return readToken(begin, end);
+  }
+  // Brackets are only counted, members and elements are not checked.
+  int depth = 0;
+  while(pos_ < end_) {
+    c = *pos_++;
+    if(c == '"') {
+      while(pos_ < end_ && *pos_ != '"') {
+        if(*pos_ == '\\') ++pos_;
+        ++pos_;
+      }
+      if(pos_ >= end_) return fail();
+      ++pos_;
+    }
+    else if(c == '{' || c == '[') {
+      ++depth;
+    }
+    else if(c == '}' || c == ']') {
+      --depth;
+    }
+    if(depth == 0) {
+      return true;
+    }
+  }
+  return fail();
+}
+
+char JsonReader::peek() {
+  skipSpace();
+  return pos_ < end_ ? *pos_ : 0;
+}
+
+const char *JsonReader::position() const {
+  return pos_;
+}
+
+bool JsonReader::failed() const {
+  return failed_;
+}
+
+void JsonReader::skipSpace() {
+  while(pos_ < end_ &&
+      (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t')) {
+    ++pos_;
+  }
+}
+
+bool JsonReader::consume(char c) {
+  if(pos_ < end_ && *pos_ == c) {
+    ++pos_;
+    return true;
+  }
+  return false;
+}
+
+bool JsonReader::fail() {
+  failed_ = true;
+  return false;
+}
+
+bool JsonReader::readToken(const char *&begin, const char *&end) {
+  if(failed_ == true) return false;
+  skipSpace();
+  if(consume('"') == true) {
+    begin = pos_;
+    while(pos_ < end_ && *pos_ != '"' && *pos_ != '\\') {
+      ++pos_;
+    }
+    if(pos_ == end_ || *pos_ == '\\') return fail();
+    end = pos_++;
+    return true;
+  }
+  begin = pos_;
+  while(pos_ < end_ && *pos_ != ',' && *pos_ != '}' && *pos_ != ']' &&
+      *pos_ != ' ' && *pos_ != '\n' && *pos_ != '\r' && *pos_ != '\t') {
+    ++pos_;
+  }
+  end = pos_;
+  if(begin == end) return fail();
+  return true;
+}
+
+}} // namespace tator::video_annotator
@@ -0,0 +1,149 @@
+/// @file
+/// @brief Defines a pull parser for JSON in memory.
+
+#ifndef VIDEO_ANNOTATOR_JSON_READER_H
+#define VIDEO_ANNOTATOR_JSON_READER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace tator { namespace video_annotator {
+
+/// Reads JSON values in document order without building a tree.
+///
+/// Callers decode the values they need straight into their own objects
+/// and skip the rest.  Numbers may also be given as strings, since
+/// property tree writes every value as a string.  After an error every
+/// call fails.
+class JsonReader {
+public:
+  /// Constructor.
+  ///
+  /// @param begin Start of the text.
+  /// @param end End of the text.
+  JsonReader(const char *begin, const char *end);
+
+  /// Starts reading elements of an array from the middle.
+  ///
+  /// The text must start at an element and end after one, with elements
+  /// separated by commas.  nextElement returns false at the end of text.
+  void resumeArray();
+
+  /// Reads the start of an object.
+  ///
+  /// @return True if the next value is an object, false otherwise.
+  bool beginObject();
+
+  /// Reads the name of the next member of the current object.
+  ///
+  /// @param name Receives the name.
+  /// @return True if a member follows, false at the end of the object or
+  ///   on error.
+  bool nextMember(std::string &name);
+
+  /// Reads the start of an array.
+  ///
+  /// @return True if the next value is an array, false otherwise.
+  bool beginArray();
+
+  /// Moves to the next element of the current array.
+  ///
+  /// @return True if an element follows, false at the end of the array or
+  ///   on error.
+  bool nextElement();
+
+  /// Reads a string.
+  ///
+  /// @param value Receives the string.
+  /// @return True if successful, false otherwise.
+  bool readString(std::string &value);
+
+  /// Reads a string, number, boolean or null as text.
+  ///
+  /// @param value Receives the string or the literal.
+  /// @return True if successful, false otherwise.
+  bool readText(std::string &value);
+
+  /// Reads an unsigned integer, plain or in a string.
+  ///
+  /// @param value Receives the integer.
+  /// @return True if successful, false otherwise.
+  bool readUInt(uint64_t &value);
+
+  /// Reads a signed integer, plain or in a string.
+  ///
+  /// @param value Receives the integer.
+  /// @return True if successful, false otherwise.
+  bool readInt(int64_t &value);
+
+  /// Reads a floating point number, plain or in a string.
+  ///
+  /// @param value Receives the number.
+  /// @return True if successful, false otherwise.
+  bool readDouble(double &value);
+
+  /// Reads any value into a property tree, as read_json would.
+  ///
+  /// @param tree Receives the value.
+  /// @return True if successful, false otherwise.
+  bool readTree(boost::property_tree::ptree &tree);
+
+  /// Skips any value.
+  ///
+  /// @return True if successful, false otherwise.
+  bool skipValue();
+
+  /// Returns the next character that is not whitespace, or zero at the
+  /// end of text.
+  char peek();
+
+  /// Returns the current position in the text.
+  const char *position() const;
+
+  /// Returns true if the text is not valid JSON.
+  bool failed() const;
+private:
+  /// Skips whitespace.
+  void skipSpace();
+
+  /// Consumes a character if it is next.
+  ///
+  /// @return True if consumed.
+  bool consume(char c);
+
+  /// Marks the text as invalid.
+  ///
+  /// @return False.
+  bool fail();
+
+  /// Reads the text of a number or literal, or the contents of a string
+  /// without escapes.
+  ///
+  /// @param begin Receives the start of the text.
+  /// @param end Receives the end of the text.
+  /// @return True if successful, false otherwise.
+  bool readToken(const char *&begin, const char *&end);
+
+  /// Current position.
+  const char *pos_;
+
+  /// End of text.
+  const char *end_;
+
+  /// True after an error.
+  bool failed_;
+
+  /// For each open object or array, true until its first member or
+  /// element is read.
+  std::vector<bool> first_;
+
+  /// True if the outermost array was resumed from the middle.
+  bool resumed_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_JSON_READER_H
@@ -0,0 +1,230 @@
+#include <QByteArray>
+#include <QIODevice>
+
+#include "json_writer.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Size at which the buffer is written out.
+  static const std::size_t kBufferBytes = 1 << 20;
+
+  /// Spaces of indentation per level.
+  static const std::size_t kIndent = 4;
+} // namespace
+
+JsonWriter::JsonWriter(QIODevice *device)
+  : device_(device)
+  , buffer_()
+  , levels_()
+  , after_name_(false)
+  , written_(0)
+  , failed_(false) {
+  buffer_.reserve(kBufferBytes + 4096);
+}
+
+void JsonWriter::beginObject() {
+  beginValue();
+  levels_.push_back(Level{'}', true});
+}
+
+void JsonWriter::endObject() {
+  end();
+}
+
+void JsonWriter::beginArray() {
+  beginValue();
+  levels_.push_back(Level{']', true});
+}
+
+void JsonWriter::endArray() {
+  end();
+}
+
+void JsonWriter::name(const char *name) {
+  separate();
+  buffer_.push_back('"');
+  appendEscaped(name, name + std::char_traits<char>::length(name));
+  buffer_.append("\": ");
+  after_name_ = true;
+}
+
+void JsonWriter::writeString(const std::string &value) {
+  beginValue();
+  buffer_.push_back('"');
+  appendEscaped(value.data(), value.data() + value.size());
+  buffer_.push_back('"');
+  maybeFlush();
+}
+
+void JsonWriter::writeUInt(uint64_t value) {
+  beginValue();
+  buffer_.push_back('"');
+  appendUInt(value);
+  buffer_.push_back('"');
+  maybeFlush();
+}
+
+void JsonWriter::writeInt(int64_t value) {
+  beginValue();
+  buffer_.push_back('"');
+  if(value < 0) {
+    buffer_.push_back('-');
+    appendUInt(0 - static_cast<uint64_t>(value));
+  }
+  else {
+    appendUInt(static_cast<uint64_t>(value));
+  }
+  buffer_.push_back('"');
+  maybeFlush();
+}
+
+void JsonWriter::writeDouble(double value) {
+  beginValue();
+  // Qt converts with the C locale whatever the locale of the process.
+  const QByteArray text = QByteArray::number(value, 'g', 17);
+  buffer_.push_back('"');
+  buffer_.append(text.constData(), text.size());
+  buffer_.push_back('"');
+  maybeFlush();
+}
+
+void JsonWriter::writeTree(const boost::property_tree::ptree &tree) {
+  if(tree.empty() == true) {
+    writeString(tree.data());
+  }
+  else if(tree.count(std::string()) == tree.size()) {
+    beginArray();
+    for(const auto &child : tree) {
+      writeTree(child.second);
+    }
+    endArray();
+  }
+  else {
+    beginObject();
+    for(const auto &child : tree) {
+      name(child.first.c_str());
+      writeTree(child.second);
+    }
+    endObject();
+  }
+}
+
+bool JsonWriter::finish() {
+  buffer_.push_back('\n');
+  flush();
+  return failed_ == false;
+}
+
+uint64_t JsonWriter::bytesWritten() const {
+  return written_;
+}
+
+void JsonWriter::separate() {
+  Level &level = levels_.back();
+  if(level.empty == true) {
+    buffer_.push_back(level.close == '}' ? '{' : '[');
+    buffer_.push_back('\n');
+    level.empty = false;
+  }
+  else {
+    buffer_.append(",\n");
+  }
+  buffer_.append(kIndent * levels_.size(), ' ');
+}
+
+void JsonWriter::beginValue() {
+  if(after_name_ == true) {
+    after_name_ = false;
+  }
+  else if(levels_.empty() == false) {
+    separate();
+  }
+}
+
+void JsonWriter::end() {
+  const Level level = levels_.back();
+  levels_.pop_back();
+  const char open = level.close == '}' ? '{' : '[';
+  if(level.empty == false) {
+    buffer_.push_back('\n');
+    buffer_.append(kIndent * levels_.size(), ' ');
+    buffer_.push_back(level.close);
+  }
+  else if(levels_.empty() == true) {
+    buffer_.push_back(open);
+    buffer_.push_back('\n');
+    buffer_.push_back(level.close);
+  }
+  else {
+    // As in write_json, an empty object or array has no children and
+    // is written as its empty data.
+    buffer_.append("\"\"");
+  }
+  maybeFlush();
+}
+
+void JsonWriter::appendEscaped(const char *begin, const char *end) {
+  static const char kHex[] = "0123456789ABCDEF";
+  for(const char *pos = begin; pos != end;) {
+    // Copy runs of characters that need no escape at once.
+    const char *start = pos;
+    for(; pos != end; ++pos) {
+      const unsigned char c = static_cast<unsigned char>(*pos);
+      if(c < 0x20 || c == '"' || c == '/' || c == '\\') break;
+    }
+    buffer_.append(start, pos);
+    if(pos == end) break;
+    const unsigned char c = static_cast<unsigned char>(*pos++);
+    buffer_.push_back('\\');
+    switch(c) {
+      case '\b': buffer_.push_back('b'); break;
+      case '\f': buffer_.push_back('f'); break;
+      case '\n': buffer_.push_back('n'); break;
+      case '\r': buffer_.push_back('r'); break;
+      case '\t': buffer_.push_back('t'); break;
+      case '/': buffer_.push_back('/'); break;
+      case '"': buffer_.push_back('"'); break;
+      case '\\': buffer_.push_back('\\'); break;
+      default:
+        buffer_.append("u00");
+        buffer_.push_back(kHex[c >> 4]);
+        buffer_.push_back(kHex[c & 0xf]);
+        break;
+    }
+  }
+}
+
+void JsonWriter::appendUInt(uint64_t value) {
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while(value != 0);
+  while(count > 0) {
+    buffer_.push_back(digits[--count]);
+  }
+}
+
+void JsonWriter::maybeFlush() {
+  if(buffer_.size() >= kBufferBytes) {
+    flush();
+  }
+}
+
+void JsonWriter::flush() {
+  if(failed_ == false && buffer_.empty() == false) {
+    const qint64 size = static_cast<qint64>(buffer_.size());
+    const qint64 count = device_->write(buffer_.data(), size);
+    if(count != size) {
+      failed_ = true;
+    }
+    if(count > 0) {
+      written_ += static_cast<uint64_t>(count);
+    }
+  }
+  buffer_.clear();
+}
+
+}} // namespace tator::video_annotator
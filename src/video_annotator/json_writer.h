@@ -0,0 +1,129 @@
+/// @file
+/// @brief Defines a buffered writer of JSON.
+
+#ifndef VIDEO_ANNOTATOR_JSON_WRITER_H
+#define VIDEO_ANNOTATOR_JSON_WRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+class QIODevice;
+
+namespace tator { namespace video_annotator {
+
+/// Writes JSON values in document order without building a tree.
+///
+/// Output has the layout of property tree's write_json: values are
+/// written as strings, nested values are indented by four spaces and
+/// an empty object or array is written as an empty string.  Text is
+/// collected in a buffer and written to the device in large blocks.
+class JsonWriter {
+public:
+  /// Constructor.
+  ///
+  /// @param device Device to write to, open for writing.
+  explicit JsonWriter(QIODevice *device);
+
+  /// Starts an object.
+  void beginObject();
+
+  /// Ends the current object.
+  void endObject();
+
+  /// Starts an array.
+  void beginArray();
+
+  /// Ends the current array.
+  void endArray();
+
+  /// Starts a member of the current object.
+  ///
+  /// @param name Name of the member.
+  void name(const char *name);
+
+  /// Writes a string.
+  ///
+  /// @param value String to write.
+  void writeString(const std::string &value);
+
+  /// Writes an unsigned integer.
+  ///
+  /// @param value Integer to write.
+  void writeUInt(uint64_t value);
+
+  /// Writes a signed integer.
+  ///
+  /// @param value Integer to write.
+  void writeInt(int64_t value);
+
+  /// Writes a floating point number with enough digits to read it back
+  /// exactly.
+  ///
+  /// @param value Number to write.
+  void writeDouble(double value);
+
+  /// Writes a property tree, as write_json would.
+  ///
+  /// @param tree Property tree to write.
+  void writeTree(const boost::property_tree::ptree &tree);
+
+  /// Ends the document and writes out the buffer.
+  ///
+  /// @return True if all text was written, false otherwise.
+  bool finish();
+
+  /// Returns the number of bytes written to the device.
+  uint64_t bytesWritten() const;
+private:
+  /// State of an open object or array.
+  struct Level {
+    char close; ///< Closing bracket.
+    bool empty; ///< True until the first member or element.
+  };
+
+  /// Writes what precedes a member or an element.
+  void separate();
+
+  /// Writes what precedes a value.
+  void beginValue();
+
+  /// Closes the current object or array.
+  void end();
+
+  /// Appends an escaped string without quotes.
+  void appendEscaped(const char *begin, const char *end);
+
+  /// Appends an unsigned integer in decimal.
+  void appendUInt(uint64_t value);
+
+  /// Writes out the buffer if it is full.
+  void maybeFlush();
+
+  /// Writes out the buffer.
+  void flush();
+
+  /// Device to write to.
+  QIODevice *device_;
+
+  /// Text not yet written.
+  std::string buffer_;
+
+  /// Open objects and arrays.
+  std::vector<Level> levels_;
+
+  /// True after a member name, until its value.
+  bool after_name_;
+
+  /// Number of bytes written to the device.
+  uint64_t written_;
+
+  /// True after a write error.
+  bool failed_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_JSON_WRITER_H
@@ -1,8 +1,13 @@
 #include <QtPlugin>
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QFontDatabase>
+#include <QSettings>
 
+#include "block_source.h"
+#include "decoder_threads.h"
 #include "mainwindow.h"
+#include "pipeline_stats.h"
 
 #ifdef _WIN32
 Q_IMPORT_PLUGIN(QWindowsIntegrationPlugin)
@@ -12,6 +17,40 @@ Q_IMPORT_PLUGIN(QSvgPlugin)
 
 int main(int argc, char* argv[]) {
   QApplication a(argc, argv);
+  QCoreApplication::setOrganizationName("CVision AI");
+  QCoreApplication::setApplicationName("Video Annotator");
+  // Decoder threads come from the settings file unless given on the
+  // command line, 0 picks a count based on available cores.
+  QSettings settings;
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption threads_option(
+      "decoder-threads",
+      "Number of threads per video decoder, 0 for automatic.",
+      "count",
+      settings.value("decoder/threads", 0).toString());
+  parser.addOption(threads_option);
+  QCommandLineOption pipeline_log_option(
+      "pipeline-log",
+      "Append timings of each frame pipeline stage to a CSV file.",
+      "file");
+  parser.addOption(pipeline_log_option);
+  QCommandLineOption latency_option(
+      "simulate-latency",
+      "Delay every video read as if on a network mount.",
+      "ms");
+  parser.addOption(latency_option);
+  parser.process(a);
+  tator::video_annotator::setDecoderThreads(
+      parser.value(threads_option).toInt());
+  tator::video_annotator::setSimulatedLatency(
+      parser.value(latency_option).toInt());
+  if(parser.isSet(pipeline_log_option) == true) {
+    if(tator::video_annotator::openPipelineLog(
+        parser.value(pipeline_log_option)) == true) {
+      tator::video_annotator::setPipelineStatsEnabled(true);
+    }
+  }
 #if __unix__
   QFontDatabase::addApplicationFont(":/fonts/DejaVuSansCondensed.ttf");
 #endif
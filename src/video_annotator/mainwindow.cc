@@ -5,6 +5,8 @@
 #include <QtMath>
 #include <QTime>
 #include <QCoreApplication>
+#include <QEventLoop>
+#include <QSettings>
 
 #include "species_dialog.h"
 #include "metadata_dialog.h"
@@ -12,6 +14,7 @@
 #include "annotated_line.h"
 #include "annotated_dot.h"
 #include "reassign_dialog.h"
+#include "pipeline_stats.h"
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
@@ -40,6 +43,15 @@ static const std::vector<QColor> track_colors {
   QColor(212, 212, 212)
 };
 
+/// Time playback statistics stay in the status bar.
+static const int kStatsMessageMsec = 5000;
+
+/// Time between refreshes of the pipeline timings.
+static const int kPipelineStatsMsec = 1000;
+
+/// Default height of proxies.
+static const int kProxyHeight = 720;
+
 } // namespace
 
 MainWindow::MainWindow(QWidget *parent)
@@ -54,7 +66,7 @@ MainWindow::MainWindow(QWidget *parent)
   , annotation_widget_(new AnnotationWidget)
   , global_state_widget_(new GlobalStateWidget)
   , current_global_state_(new GlobalStateAnnotation)
-  , load_progress_(nullptr)
+  , load_max_progress_(0)
   , video_path_()
   , width_(0)
   , height_(0)
@@ -69,14 +81,25 @@ MainWindow::MainWindow(QWidget *parent)
   , metadata_()
   , color_map_()
   , zoom_reset_needed_(false)
-  , write_image_enabled_(false) {
+  , write_image_enabled_(false)
+  , thumbnail_preview_(nullptr)
+  , frame_mailbox_(new FrameMailbox)
+  , pipeline_overlay_(nullptr)
+  , pipeline_timer_(nullptr)
+  , frame_cache_stats_()
+  , proxy_transcoder_(nullptr)
+  , proxy_thread_(nullptr) {
   ui_->setupUi(this);
+  thumbnail_preview_.reset(new ThumbnailPreview(ui_->videoSlider));
   setWindowTitle("Video Annotator");
 #ifdef _WIN32
   setWindowIcon(QIcon(":/icons/cvision/cvision_no_text.ico"));
 #endif
   ui_->play->setIcon(
       QIcon(":/icons/video_controls/play.svg"));
+  ui_->playReverse->setIcon(QIcon(
+      QPixmap(":/icons/video_controls/play.svg").transformed(
+        QTransform().scale(-1, 1))));
   ui_->faster->setIcon(
       QIcon(":/icons/video_controls/faster.svg"));
   ui_->slower->setIcon(
@@ -100,6 +123,19 @@ MainWindow::MainWindow(QWidget *parent)
   ui_->reassignTrack->setIcon(
       QIcon(":/icons/navigation/reassign_track.svg"));
   ui_->videoWindowLayout->addWidget(view_.get());
+  pipeline_overlay_ = new QLabel(view_.get());
+  pipeline_overlay_->setStyleSheet(
+      "QLabel { background-color: rgba(0, 0, 0, 160); color: white; "
+      "font-family: monospace; padding: 4px; }");
+  pipeline_overlay_->setAttribute(Qt::WA_TransparentForMouseEvents);
+  pipeline_overlay_->move(8, 8);
+  pipeline_overlay_->hide();
+  pipeline_timer_ = new QTimer(this);
+  QObject::connect(pipeline_timer_, &QTimer::timeout,
+      this, &MainWindow::updatePipelineStats);
+  if(pipelineLogOpen() == true) {
+    pipeline_timer_->start(kPipelineStatsMsec);
+  }
   ui_->speciesLayout->addWidget(annotation_widget_.get());
   ui_->speciesLayout->addWidget(species_controls_.get());
   ui_->globalStateLayout->addWidget(global_state_widget_.get());
@@ -128,8 +164,17 @@ MainWindow::MainWindow(QWidget *parent)
   QObject::connect(scene_.get(), &AnnotationScene::deleteAnn,
     this, &MainWindow::deleteCurrentAnn);
   Player *player = new Player();
+  QSettings settings;
+  if(settings.contains("playback/trick_play_speed") == true) {
+    player->setTrickPlaySpeed(
+        settings.value("playback/trick_play_speed").toDouble());
+  }
   QThread *thread = new QThread();
+  // Frames go through the mailbox, so frames the GUI thread has no time
+  // to paint are replaced rather than queued.
   QObject::connect(player, &Player::processedImage,
+      frame_mailbox_.get(), &FrameMailbox::post, Qt::DirectConnection);
+  QObject::connect(frame_mailbox_.get(), &FrameMailbox::frameReady,
       this, &MainWindow::showFrame);
   QObject::connect(player, &Player::durationChanged,
       this, &MainWindow::handlePlayerDurationChanged);
@@ -143,14 +188,24 @@ MainWindow::MainWindow(QWidget *parent)
       this, &MainWindow::handlePlayerMediaLoadStart);
   QObject::connect(player, &Player::loadProgress,
       this, &MainWindow::handlePlayerLoadProgress);
+  QObject::connect(player, &Player::mediaIndexed,
+      this, &MainWindow::handlePlayerMediaIndexed);
   QObject::connect(player, &Player::mediaLoaded,
       this, &MainWindow::handlePlayerMediaLoaded);
   QObject::connect(player, &Player::error,
       this, &MainWindow::handlePlayerError);
+  QObject::connect(player, &Player::playbackStats,
+      this, &MainWindow::handlePlayerPlaybackStats);
+  QObject::connect(player, &Player::frameCacheStats,
+      this, &MainWindow::handlePlayerFrameCacheStats);
+  QObject::connect(this, &MainWindow::requestFrameCacheStats,
+      player, &Player::reportFrameCacheStats);
   QObject::connect(this, &MainWindow::requestLoadVideo,
       player, &Player::loadVideo);
   QObject::connect(this, &MainWindow::requestPlay,
       player, &Player::play);
+  QObject::connect(this, &MainWindow::requestPlayReverse,
+      player, &Player::playReverse);
   QObject::connect(this, &MainWindow::requestStop,
       player, &Player::stop);
   QObject::connect(this, &MainWindow::requestSpeedUp,
@@ -159,10 +214,16 @@ MainWindow::MainWindow(QWidget *parent)
       player, &Player::slowDown);
   QObject::connect(this, &MainWindow::requestSetFrame,
       player, &Player::setFrame);
+  QObject::connect(this, &MainWindow::requestScrub,
+      player, &Player::scrub);
   QObject::connect(this, &MainWindow::requestNextFrame,
       player, &Player::nextFrame);
   QObject::connect(this, &MainWindow::requestPrevFrame,
       player, &Player::prevFrame);
+  QObject::connect(this, &MainWindow::requestPrefetch,
+      player, &Player::prefetch);
+  QObject::connect(this, &MainWindow::requestReloadVideo,
+      player, &Player::reloadVideo);
   QObject::connect(thread, &QThread::finished,
       player, &Player::deleteLater);
   QObject::connect(thread, &QThread::finished,
@@ -178,6 +239,10 @@ MainWindow::MainWindow(QWidget *parent)
   initGlobalStateAnnotations();
 }
 
+MainWindow::~MainWindow() {
+  stopProxyTranscoder();
+}
+
 void MainWindow::resizeEvent(QResizeEvent *event) {
   view_->fitInView();
 }
@@ -201,6 +266,20 @@ void MainWindow::on_play_clicked() {
   }
 }
 
+void MainWindow::on_playReverse_clicked() {
+  if(stopped_ == true) {
+    emit requestPlayReverse();
+    ui_->play->setIcon(QIcon(":/icons/video_controls/pause.svg"));
+    ui_->minusOneSecond->setEnabled(false);
+    ui_->minusThreeSecond->setEnabled(false);
+    ui_->plusOneFrame->setEnabled(false);
+    ui_->minusOneFrame->setEnabled(false);
+  }
+  else {
+    on_play_clicked();
+  }
+}
+
 void MainWindow::on_faster_clicked() {
   emit requestSpeedUp();
 }
@@ -259,6 +338,7 @@ void MainWindow::on_loadAnnotationFile_triggered() {
       updateSpeciesCounts();
       updateStats();
       drawAnnotations();
+      prefetchTracks();
     }
   }
 }
@@ -348,11 +428,27 @@ void MainWindow::on_writeImageSequence_triggered() {
   prog->setCancelButton(0);
   prog->setWindowTitle("Writing image sequence");
   prog->setMinimumDuration(10);
-  for(qint64 frame = 0; frame <= max_frame; ++frame) {
-    QCoreApplication::processEvents();
+  // The mailbox replaces frames not yet shown, so each frame is shown
+  // and written by showFrame before the next one is requested.
+  emit requestStop();
+  qint64 requested = 0;
+  QEventLoop loop;
+  QMetaObject::Connection shown = QObject::connect(
+      frame_mailbox_.get(), &FrameMailbox::frameReady,
+      [&loop, &requested](QImage image, qint64 frame) {
+        if(frame == requested) {
+          loop.quit();
+        }
+      });
+  // The slider ends one past the last frame, the player shows the last
+  // frame for it.
+  for(qint64 frame = 0; frame < max_frame; ++frame) {
     prog->setValue(frame);
+    requested = frame;
     emit requestSetFrame(frame);
+    loop.exec();
   }
+  QObject::disconnect(shown);
   setEnabled(true);
   write_image_enabled_ = false;
 }
@@ -361,6 +457,94 @@ void MainWindow::on_colorizeByTrack_toggled(bool checked) {
   drawAnnotations();
 }
 
+void MainWindow::on_viewPipelineStats_toggled(bool checked) {
+  // Logging keeps recording on while the overlay is hidden.
+  const bool logging = pipelineLogOpen();
+  setPipelineStatsEnabled(checked == true || logging == true);
+  pipeline_overlay_->setVisible(checked);
+  if(checked == true || logging == true) {
+    pipeline_timer_->start(kPipelineStatsMsec);
+    updatePipelineStats();
+  }
+  else {
+    pipeline_timer_->stop();
+  }
+}
+
+void MainWindow::updatePipelineStats() {
+  if(pipeline_overlay_->isVisible() == true) {
+    // Shows the statistics received after the previous refresh.
+    QString text = pipelineStatsText();
+    if(frame_cache_stats_.isEmpty() == false) {
+      text += "\n" + frame_cache_stats_;
+    }
+    pipeline_overlay_->setText(text);
+    pipeline_overlay_->adjustSize();
+    pipeline_overlay_->raise();
+    emit requestFrameCacheStats();
+  }
+  writePipelineLog();
+}
+
+void MainWindow::on_createProxy_triggered() {
+  if(proxy_transcoder_ != nullptr || video_path_.isEmpty() == true) {
+    return;
+  }
+  QSettings settings;
+  const int height = settings.value("proxy/height", kProxyHeight).toInt();
+  const ProxyCodec codec =
+    settings.value("proxy/codec", "mjpeg").toString() == "h264" ?
+    kH264IntraProxy : kMjpegProxy;
+  proxy_transcoder_ = new ProxyTranscoder(video_path_, height, codec);
+  proxy_thread_ = new QThread();
+  proxy_transcoder_->moveToThread(proxy_thread_);
+  QObject::connect(proxy_thread_, &QThread::started,
+      proxy_transcoder_, &ProxyTranscoder::run);
+  QObject::connect(proxy_transcoder_, &ProxyTranscoder::progress,
+      this, &MainWindow::handleProxyProgress);
+  QObject::connect(proxy_transcoder_, &ProxyTranscoder::finished,
+      this, &MainWindow::handleProxyFinished);
+  proxy_thread_->start(QThread::LowPriority);
+  ui_->createProxy->setEnabled(false);
+}
+
+void MainWindow::handleProxyProgress(int percent) {
+  if(sender() == proxy_transcoder_) {
+    ui_->statusBar->showMessage(
+        QString("Creating proxy: %1%").arg(percent));
+  }
+}
+
+void MainWindow::handleProxyFinished(bool complete) {
+  // Ignore jobs that finished after another video was loaded.
+  if(proxy_transcoder_ == nullptr || sender() != proxy_transcoder_) {
+    return;
+  }
+  stopProxyTranscoder();
+  ui_->createProxy->setEnabled(true);
+  if(complete == true) {
+    ui_->statusBar->showMessage("Proxy created", kStatsMessageMsec);
+    emit requestReloadVideo();
+  }
+  else {
+    ui_->statusBar->showMessage(
+        "Could not create a proxy with the same frames as the video",
+        kStatsMessageMsec);
+  }
+}
+
+void MainWindow::stopProxyTranscoder() {
+  if(proxy_transcoder_ != nullptr) {
+    proxy_transcoder_->abort();
+    proxy_thread_->quit();
+    proxy_thread_->wait();
+    delete proxy_transcoder_;
+    delete proxy_thread_;
+    proxy_transcoder_ = nullptr;
+    proxy_thread_ = nullptr;
+  }
+}
+
 void MainWindow::on_setMetadata_triggered() {
   MetadataDialog *dlg = new MetadataDialog(this);
   dlg->setMetadata(metadata_);
@@ -380,7 +564,12 @@ void MainWindow::on_videoSlider_sliderReleased() {
 }
 
 void MainWindow::on_videoSlider_actionTriggered(int action) {
-  emit requestSetFrame(ui_->videoSlider->sliderPosition());
+  if(ui_->videoSlider->isSliderDown() == true) {
+    emit requestScrub(ui_->videoSlider->sliderPosition());
+  }
+  else {
+    emit requestSetFrame(ui_->videoSlider->sliderPosition());
+  }
 }
 
 void MainWindow::on_typeMenu_activated(const QString &text) {
@@ -418,6 +607,7 @@ void MainWindow::on_prevTrack_clicked() {
   if(trk != nullptr) {
     track_id_ = trk->id_;
     updateStats();
+    prefetchTracks();
   }
 }
 
@@ -426,6 +616,7 @@ void MainWindow::on_nextTrack_clicked() {
   if(trk != nullptr) {
     track_id_ = trk->id_;
     updateStats();
+    prefetchTracks();
   }
 }
 
@@ -458,11 +649,13 @@ void MainWindow::on_removeTrack_clicked() {
   updateStats();
   updateSpeciesCounts();
   drawAnnotations();
+  prefetchTracks();
 }
 
 void MainWindow::on_goToFrame_clicked() {
   qint64 frame = annotation_->trackFirstFrame(track_id_);
   emit requestSetFrame(frame);
+  prefetchTracks();
 }
 
 void MainWindow::on_reassignTrack_clicked() {
@@ -478,7 +671,7 @@ void MainWindow::on_reassignTrack_clicked() {
     Reassignment reassign = dlg->getReassignment();
     auto from_trk = annotation_->findTrack(reassign.from_id_);
     auto from_det = annotation_->getDetectionAnnotationsById(
-        reassign.from_id_);
+        reassign.from_id_, reassign.from_frame_, reassign.to_frame_);
     auto to_trk = annotation_->findTrack(reassign.to_id_);
     if(to_trk == nullptr) {
       // Detections assigned to new track
@@ -495,13 +688,10 @@ void MainWindow::on_reassignTrack_clicked() {
       // overwrite of existing detections
       bool need_new = false;
       for(auto& det : from_det) {
-        if(det->frame_ >= reassign.from_frame_ &&
-            det->frame_ <= reassign.to_frame_) {
-          auto exist = annotation_->findDetection(det->frame_, reassign.to_id_);
-          if(exist != nullptr) {
-            need_new = true;
-            break;
-          }
+        auto exist = annotation_->findDetection(det->frame_, reassign.to_id_);
+        if(exist != nullptr) {
+          need_new = true;
+          break;
         }
       }
       if(need_new == true) {
@@ -516,30 +706,27 @@ void MainWindow::on_reassignTrack_clicked() {
       }
     }
     for(auto& det : from_det) {
-      if(det->frame_ >= reassign.from_frame_ &&
-          det->frame_ <= reassign.to_frame_) {
-        auto exist = annotation_->findDetection(det->frame_, reassign.to_id_);
-        if(exist != nullptr) {
-          auto replace = std::make_shared<DetectionAnnotation>(
-              exist->frame_,
-              new_id,
-              exist->area_,
-              exist->type_,
-              exist->species_,
-              exist->prob_);
-          annotation_->remove(exist->frame_, exist->id_);
-          annotation_->insert(replace);
-        }
-        auto updated = std::make_shared<DetectionAnnotation>(
-            det->frame_,
-            reassign.to_id_,
-            det->area_,
-            det->type_,
-            det->species_,
-            det->prob_);
-        annotation_->remove(det->frame_, det->id_);
-        annotation_->insert(updated);
+      auto exist = annotation_->findDetection(det->frame_, reassign.to_id_);
+      if(exist != nullptr) {
+        auto replace = std::make_shared<DetectionAnnotation>(
+            exist->frame_,
+            new_id,
+            exist->area_,
+            exist->type_,
+            exist->species_,
+            exist->prob_);
+        annotation_->remove(exist->frame_, exist->id_);
+        annotation_->insert(replace);
       }
+      auto updated = std::make_shared<DetectionAnnotation>(
+          det->frame_,
+          reassign.to_id_,
+          det->area_,
+          det->type_,
+          det->species_,
+          det->prob_);
+      annotation_->remove(det->frame_, det->id_);
+      annotation_->insert(updated);
     }
   }
   delete dlg;
@@ -564,6 +751,7 @@ void MainWindow::on_trackNumVal_activated(const QString &text) {
   auto trk = annotation_->findTrack(track_id_);
   if(trk != nullptr) {
     updateStats();
+    prefetchTracks();
   }
 }
 
@@ -630,12 +818,21 @@ void MainWindow::onGlobalStateChange() {
 
 void MainWindow::showFrame(QImage image, qint64 frame) {
   last_frame_ = image;
-  auto pixmap = QPixmap::fromImage(image);
+  QPixmap pixmap;
+  {
+    StageTimer timer(kPixmapStage);
+    pixmap = QPixmap::fromImage(image);
+  }
   pixmap_item_->setPixmap(pixmap);
+  // Previews shown while scrubbing are smaller than the video.
+  pixmap_item_->setScale(
+      image.width() > 0 ? static_cast<double>(width_) / image.width() : 1.0);
   last_position_ = frame;
   ui_->currentTime->setText(frameToTime(frame));
   drawAnnotations();
-  ui_->videoSlider->setValue(static_cast<int>(frame));
+  if(ui_->videoSlider->isSliderDown() == false) {
+    ui_->videoSlider->setValue(static_cast<int>(frame));
+  }
   if(zoom_reset_needed_ == true) {
     view_->fitInView();
     zoom_reset_needed_ = false;
@@ -693,33 +890,25 @@ void MainWindow::handlePlayerStateChanged(bool stopped) {
 }
 
 void MainWindow::handlePlayerMediaLoadStart(int max_progress) {
-  if(load_progress_ == nullptr) {
-    load_progress_.reset(new QProgressDialog(
-          "Extracting video timestamps...",
-          "",
-          0,
-          max_progress,
-          this,
-          Qt::Window | Qt::WindowTitleHint | Qt::CustomizeWindowHint));
-    load_progress_->setCancelButton(0);
-    load_progress_->setWindowTitle("Loading video");
-    load_progress_->setMinimumDuration(10);
-  }
+  load_max_progress_ = max_progress;
+  ui_->statusBar->showMessage("Extracting video timestamps...");
 }
 
 void MainWindow::handlePlayerLoadProgress(int progress) {
-  if(load_progress_ != nullptr) {
-    load_progress_->setValue(progress);
-  }
+  ui_->statusBar->showMessage(
+      QString("Extracting video timestamps... %1k of about %2k frames")
+      .arg(progress)
+      .arg(load_max_progress_));
+}
+
+void MainWindow::handlePlayerMediaIndexed() {
+  ui_->statusBar->clearMessage();
 }
 
 void MainWindow::handlePlayerMediaLoaded(
   QString video_path,
   qreal native_rate) {
-  if(load_progress_ != nullptr) {
-    load_progress_->setValue(load_progress_->maximum());
-    load_progress_.reset(nullptr);
-  }
+  stopProxyTranscoder();
   video_path_ = video_path;
   native_rate_ = native_rate;
   setEnabled(true);
@@ -736,6 +925,7 @@ void MainWindow::handlePlayerMediaLoaded(
   updateStats();
   drawAnnotations();
   zoom_reset_needed_ = true;
+  thumbnail_preview_->load(video_path_, native_rate_);
   emit requestSetFrame(0);
 }
 
@@ -745,6 +935,32 @@ void MainWindow::handlePlayerError(QString err) {
   msgBox.exec();
 }
 
+void MainWindow::handlePlayerPlaybackStats(qint64 dropped, qint64 late) {
+  if(dropped == 0 && late == 0) {
+    return;
+  }
+  ui_->statusBar->showMessage(
+      QString("Playback skipped %1 frames, %2 frames late")
+      .arg(dropped)
+      .arg(late),
+      kStatsMessageMsec);
+}
+
+void MainWindow::handlePlayerFrameCacheStats(
+    qint64 hits,
+    qint64 misses,
+    qint64 evictions,
+    qint64 frames,
+    qint64 bytes) {
+  const qint64 lookups = hits + misses;
+  frame_cache_stats_ = QString(
+      "cache %1 frames %2 MB, %3% hits, %4 evictions")
+    .arg(frames)
+    .arg(bytes / (1024.0 * 1024.0), 0, 'f', 1)
+    .arg(lookups > 0 ? 100.0 * hits / lookups : 0.0, 0, 'f', 1)
+    .arg(evictions);
+}
+
 void MainWindow::addBoxAnnotation(const QRectF &rect) {
   annotation_->insert(std::make_shared<DetectionAnnotation>(
     last_position_,
@@ -817,8 +1033,7 @@ void MainWindow::setItemActive(
 
 void MainWindow::deleteCurrentAnn() {
   on_removeRegion_clicked();
-  auto current_track_anns = annotation_->getDetectionAnnotationsById(track_id_);
-  if (current_track_anns.empty()) {
+  if (annotation_->trackDetectionCount(track_id_) == 0) {
     on_removeTrack_clicked();
   }
 }
@@ -867,7 +1082,26 @@ void MainWindow::updateStats() {
   }
 }
 
+void MainWindow::prefetchTracks() {
+  if(annotation_->findTrack(track_id_) == nullptr) {
+    return;
+  }
+  // Go to frame is the most likely jump, then the neighboring tracks.
+  QList<qint64> frames;
+  frames.push_back(annotation_->trackFirstFrame(track_id_));
+  auto next = annotation_->nextTrack(track_id_);
+  if(next != nullptr) {
+    frames.push_back(annotation_->trackFirstFrame(next->id_));
+  }
+  auto prev = annotation_->prevTrack(track_id_);
+  if(prev != nullptr) {
+    frames.push_back(annotation_->trackFirstFrame(prev->id_));
+  }
+  emit requestPrefetch(frames);
+}
+
 void MainWindow::drawAnnotations() {
+  StageTimer timer(kDrawStage);
   for(auto ann : current_annotations_) {
     scene_->removeItem(ann.second);
   }
@@ -894,7 +1128,7 @@ void MainWindow::drawAnnotations() {
         box = new AnnotatedRegion<DetectionAnnotation>(
             id,
             ann,
-            pixmap_item_->pixmap().toImage().rect(),
+            QRect(0, 0, width_, height_),
             color,
             species,
             prob);
@@ -905,7 +1139,7 @@ void MainWindow::drawAnnotations() {
         break;
       case kLine:
         line = new AnnotatedLine<DetectionAnnotation>(
-            ann->id_, ann, pixmap_item_->pixmap().toImage().rect(), color);
+            ann->id_, ann, QRect(0, 0, width_, height_), color);
         if(line->isValid() == true) {
           scene_->addItem(line);
           current_annotations_.emplace_back(ann->id_, line);
@@ -913,7 +1147,7 @@ void MainWindow::drawAnnotations() {
         break;
       case kDot:
         dot = new AnnotatedDot<DetectionAnnotation>(
-            ann->id_, ann, pixmap_item_->pixmap().toImage().rect(), color);
+            ann->id_, ann, QRect(0, 0, width_, height_), color);
         if(dot->isValid() == true) {
           scene_->addItem(dot);
           current_annotations_.emplace_back(ann->id_, dot);
@@ -970,6 +1204,7 @@ void MainWindow::initGlobalStateAnnotations() {
 void MainWindow::setEnabled(bool enable) {
   ui_->videoSlider->setEnabled(enable);
   ui_->play->setEnabled(enable);
+  ui_->playReverse->setEnabled(enable);
   ui_->faster->setEnabled(enable);
   ui_->slower->setEnabled(enable);
   ui_->minusOneSecond->setEnabled(enable);
@@ -982,6 +1217,7 @@ void MainWindow::setEnabled(bool enable) {
   ui_->writeImage->setEnabled(enable);
   ui_->writeImageSequence->setEnabled(enable);
   ui_->setMetadata->setEnabled(enable);
+  ui_->createProxy->setEnabled(enable && proxy_transcoder_ == nullptr);
   ui_->typeLabel->setEnabled(enable);
   ui_->typeMenu->setEnabled(enable);
   ui_->countLabelLabel->setEnabled(enable);
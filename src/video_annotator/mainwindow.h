@@ -17,6 +17,8 @@
 #include <QThread>
 #include <QMap>
 #include <QProgressDialog>
+#include <QLabel>
+#include <QTimer>
 
 #include "species_controls.h"
 #include "annotation_widget.h"
@@ -26,6 +28,9 @@
 #include "metadata.h"
 #include "video_annotation.h"
 #include "player.h"
+#include "frame_mailbox.h"
+#include "proxy_transcoder.h"
+#include "thumbnail_preview.h"
 #include "ui_mainwindow.h"
 
 #ifndef NO_TESTING
@@ -45,6 +50,9 @@ public:
   ///
   /// @param parent Parent widget.
   explicit MainWindow(QWidget *parent = 0);
+
+  /// Destructor.
+  ~MainWindow();
 protected:
   /// Resizes the video and scene.
   ///
@@ -89,16 +97,20 @@ public slots:
   /// @param stopped True if player stopped, false otherwise.
   void handlePlayerStateChanged(bool stopped);
 
-  /// Handles start of media load by creating a progress dialog.
+  /// Handles start of background frame indexing by showing a status
+  /// message.
   ///
-  /// @param max_progress Maximum value of the progress bar.
+  /// @param max_progress Estimated maximum progress.
   void handlePlayerMediaLoadStart(int max_progress);
 
-  /// Handles file open progress update.
+  /// Handles frame indexing progress update.
   ///
   /// @param progress Progress update.
   void handlePlayerLoadProgress(int progress);
 
+  /// Handles completion of frame indexing by clearing the status message.
+  void handlePlayerMediaIndexed();
+
   /// Handles new media loaded.
   ///
   /// @param video_path Path to loaded video.
@@ -110,6 +122,26 @@ public slots:
   /// @param err Error message.
   void handlePlayerError(QString err);
 
+  /// Reports frames skipped during the last playback.
+  ///
+  /// @param dropped Frames skipped by the player.
+  /// @param late Ticks where the player had no frame ready in time.
+  void handlePlayerPlaybackStats(qint64 dropped, qint64 late);
+
+  /// Keeps frame cache statistics for the pipeline overlay.
+  ///
+  /// @param hits Number of lookups that found a frame.
+  /// @param misses Number of lookups that did not.
+  /// @param evictions Number of frames evicted to stay in budget.
+  /// @param frames Number of cached frames.
+  /// @param bytes Total size of cached frames in bytes.
+  void handlePlayerFrameCacheStats(
+      qint64 hits,
+      qint64 misses,
+      qint64 evictions,
+      qint64 frames,
+      qint64 bytes);
+
   /// Adds a box annotation.
   ///
   /// @param rect Definition of the box.
@@ -129,6 +161,9 @@ signals:
   /// Requests play.
   void requestPlay();
 
+  /// Requests backward play.
+  void requestPlayReverse();
+
   /// Requests stop.
   void requestStop();
 
@@ -148,15 +183,35 @@ signals:
   /// @param value Frame to go to.
   void requestSetFrame(qint64 value);
 
+  /// Requests low resolution preview while dragging the slider.
+  ///
+  /// @param value Frame to preview.
+  void requestScrub(qint64 value);
+
   /// Requests next frame.
   void requestNextFrame();
 
+  /// Requests that likely jump targets are decoded in the background.
+  ///
+  /// @param frames Likely targets, most likely first.
+  void requestPrefetch(QList<qint64> frames);
+
   /// Requests previous frame.
   void requestPrevFrame();
+
+  /// Requests frame cache statistics.
+  void requestFrameCacheStats();
+
+  /// Requests that the current video is loaded again, to switch to its
+  /// proxy.
+  void requestReloadVideo();
 private slots:
   /// Plays/pauses the video.
   void on_play_clicked();
 
+  /// Plays the video backward or pauses it.
+  void on_playReverse_clicked();
+
   /// Increases the playback speed of the video by a factor of two.
   void on_faster_clicked();
 
@@ -193,6 +248,25 @@ private slots:
   /// Enables or disables colorization by track.
   void on_colorizeByTrack_toggled(bool checked);
 
+  /// Shows or hides the pipeline timing overlay.
+  void on_viewPipelineStats_toggled(bool checked);
+
+  /// Starts transcoding the video to a proxy in the background.
+  void on_createProxy_triggered();
+
+  /// Shows proxy transcode progress in the status bar.
+  ///
+  /// @param percent Percentage of the video transcoded.
+  void handleProxyProgress(int percent);
+
+  /// Switches to the proxy once it is written.
+  ///
+  /// @param complete True if the proxy was written.
+  void handleProxyFinished(bool complete);
+
+  /// Refreshes the pipeline timing overlay and appends to the log.
+  void updatePipelineStats();
+
   /// Sets metadata for the annotation.
   void on_setMetadata_triggered();
 
@@ -314,8 +388,8 @@ private:
   /// Current global state annotations.
   std::shared_ptr<GlobalStateAnnotation> current_global_state_;
 
-  /// Load progress dialog.
-  std::unique_ptr<QProgressDialog> load_progress_;
+  /// Estimated maximum frame indexing progress.
+  int load_max_progress_;
 
   /// Path to loaded video.
   QString video_path_;
@@ -365,12 +439,39 @@ private:
   /// If true, writes new frames to disk.
   bool write_image_enabled_;
 
+  /// Shows thumbnails while hovering the video slider.
+  std::unique_ptr<ThumbnailPreview> thumbnail_preview_;
+
+  /// Passes only the latest frame from the player to showFrame.
+  std::unique_ptr<FrameMailbox> frame_mailbox_;
+
+  /// Overlay on the video window showing pipeline timings, owned by view_.
+  QLabel *pipeline_overlay_;
+
+  /// Periodically refreshes pipeline timings.
+  QTimer *pipeline_timer_;
+
+  /// Latest frame cache statistics, shown below pipeline timings.
+  QString frame_cache_stats_;
+
+  /// Transcodes the video to a proxy, nullptr if not running.
+  ProxyTranscoder *proxy_transcoder_;
+
+  /// Thread for proxy_transcoder_.
+  QThread *proxy_thread_;
+
+  /// Stops transcoding the proxy and waits for the thread to exit.
+  void stopProxyTranscoder();
+
   /// Updates counts of each species in species controls.
   void updateSpeciesCounts();
 
   /// Updates displayed track statistics.
   void updateStats();
 
+  /// Prefetches the first frames of the current, next and previous tracks.
+  void prefetchTracks();
+
   /// Draws annotations for the last displayed frame.
   void drawAnnotations();
 
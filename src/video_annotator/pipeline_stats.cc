@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include "pipeline_stats.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Number of recent samples summarized per stage.
+  static const int kWindow = 512;
+
+  /// Names of stages, in stage order.
+  static const char *kStageNames[kNumStages] = {
+    "demux",
+    "decode",
+    "convert",
+    "cache",
+    "delivery",
+    "pixmap",
+    "draw"
+  };
+
+  /// Rolling window of recent samples of a stage.
+  struct StageSamples {
+    std::vector<qint64> samples; ///< Circular buffer of durations in nsec.
+    qint64 count; ///< Total number of samples recorded.
+  };
+
+  /// True if recording.
+  std::atomic<bool> enabled(false);
+
+  /// Guards samples and log_file.
+  QMutex mutex;
+
+  /// Samples of each stage.
+  StageSamples stage_samples[kNumStages];
+
+  /// CSV log, closed if not logging.
+  QFile log_file;
+
+  /// Summarizes a stage, called with mutex held.
+  StageSummary summarize(const StageSamples &stage) {
+    StageSummary summary = {stage.count, 0.0, 0.0, 0.0, 0.0};
+    std::vector<qint64> sorted(stage.samples);
+    if(sorted.empty()) {
+      return summary;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for(qint64 sample : sorted) {
+      total += sample;
+    }
+    const std::size_t n = sorted.size();
+    summary.mean = total / n / 1.0e6;
+    summary.p50 = sorted[n / 2] / 1.0e6;
+    summary.p95 = sorted[std::min(n - 1, n * 95 / 100)] / 1.0e6;
+    summary.max = sorted.back() / 1.0e6;
+    return summary;
+  }
+}
+
+void setPipelineStatsEnabled(bool enable) {
+  QMutexLocker locker(&mutex);
+  if(enable == true && enabled == false) {
+    for(StageSamples &stage : stage_samples) {
+      stage.samples.clear();
+      stage.count = 0;
+    }
+  }
+  enabled = enable;
+}
+
+bool pipelineStatsEnabled() {
+  return enabled;
+}
+
+void recordStage(PipelineStage stage, qint64 nsec) {
+  QMutexLocker locker(&mutex);
+  StageSamples &target = stage_samples[stage];
+  if(target.samples.size() < static_cast<std::size_t>(kWindow)) {
+    target.samples.push_back(nsec);
+  }
+  else {
+    target.samples[target.count % kWindow] = nsec;
+  }
+  ++target.count;
+}
+
+StageSummary stageSummary(PipelineStage stage) {
+  QMutexLocker locker(&mutex);
+  return summarize(stage_samples[stage]);
+}
+
+const char *stageName(PipelineStage stage) {
+  return kStageNames[stage];
+}
+
+QString pipelineStatsText() {
+  QString text = QString("%1 %2 %3 %4 %5\n")
+    .arg("stage", -8)
+    .arg("count", 8)
+    .arg("p50 ms", 8)
+    .arg("p95 ms", 8)
+    .arg("max ms", 8);
+  for(int i = 0; i < kNumStages; ++i) {
+    PipelineStage stage = static_cast<PipelineStage>(i);
+    StageSummary summary = stageSummary(stage);
+    text += QString("%1 %2 %3 %4 %5\n")
+      .arg(stageName(stage), -8)
+      .arg(summary.count, 8)
+      .arg(summary.p50, 8, 'f', 2)
+      .arg(summary.p95, 8, 'f', 2)
+      .arg(summary.max, 8, 'f', 2);
+  }
+  return text.trimmed();
+}
+
+bool openPipelineLog(const QString &path) {
+  QMutexLocker locker(&mutex);
+  if(log_file.isOpen() == true) {
+    log_file.close();
+  }
+  log_file.setFileName(path);
+  const bool exists = log_file.exists();
+  if(log_file.open(QIODevice::WriteOnly | QIODevice::Append) == false) {
+    return false;
+  }
+  if(exists == false || log_file.size() == 0) {
+    log_file.write("time,stage,count,mean_ms,p50_ms,p95_ms,max_ms\n");
+  }
+  return true;
+}
+
+void writePipelineLog() {
+  QMutexLocker locker(&mutex);
+  if(log_file.isOpen() == false) {
+    return;
+  }
+  const QString time = QDateTime::currentDateTime().toString(Qt::ISODate);
+  QTextStream stream(&log_file);
+  for(int i = 0; i < kNumStages; ++i) {
+    StageSummary summary = summarize(stage_samples[i]);
+    stream << time << ',' << kStageNames[i] << ',' << summary.count << ','
+      << summary.mean << ',' << summary.p50 << ',' << summary.p95 << ','
+      << summary.max << '\n';
+  }
+  stream.flush();
+}
+
+bool pipelineLogOpen() {
+  QMutexLocker locker(&mutex);
+  return log_file.isOpen();
+}
+
+}} // namespace tator::video_annotator
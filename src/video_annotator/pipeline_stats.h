@@ -0,0 +1,106 @@
+/// @file
+/// @brief Defines timing counters for the stages of the frame path.
+
+#ifndef VIDEO_ANNOTATOR_PIPELINE_STATS_H
+#define VIDEO_ANNOTATOR_PIPELINE_STATS_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+namespace tator { namespace video_annotator {
+
+/// Stages of the path from file to screen.
+enum PipelineStage {
+  kDemuxStage, ///< Reading a packet with av_read_frame.
+  kDecodeStage, ///< Sending a packet to or receiving a frame from the codec.
+  kConvertStage, ///< Converting a decoded frame to an image.
+  kCacheStage, ///< Looking up a frame in the frame cache.
+  kDeliveryStage, ///< Passing a frame from the player to the GUI thread.
+  kPixmapStage, ///< Converting an image to a pixmap for display.
+  kDrawStage, ///< Rebuilding the annotations in the scene.
+  kNumStages ///< Number of stages.
+};
+
+/// Timing summary of the recent samples of a stage.
+struct StageSummary {
+  qint64 count; ///< Number of samples since recording was enabled.
+  double mean; ///< Mean of the recent samples in milliseconds.
+  double p50; ///< Median of the recent samples in milliseconds.
+  double p95; ///< 95th percentile of the recent samples in milliseconds.
+  double max; ///< Maximum of the recent samples in milliseconds.
+};
+
+/// Enables or disables recording, disabled by default.
+///
+/// Enabling while disabled clears previous samples.
+///
+/// @param enabled True to record stage timings.
+void setPipelineStatsEnabled(bool enabled);
+
+/// Returns true if stage timings are recorded.
+bool pipelineStatsEnabled();
+
+/// Records one sample of a stage.  Thread safe.
+///
+/// @param stage Stage that was timed.
+/// @param nsec Duration in nanoseconds.
+void recordStage(PipelineStage stage, qint64 nsec);
+
+/// Returns the summary of a stage.  Thread safe.
+///
+/// @param stage Stage to summarize.
+StageSummary stageSummary(PipelineStage stage);
+
+/// Returns a short name for a stage.
+///
+/// @param stage Stage to name.
+const char *stageName(PipelineStage stage);
+
+/// Returns a table of all stage summaries, one stage per line.
+QString pipelineStatsText();
+
+/// Starts appending stage summaries to a CSV file.
+///
+/// @param path Path to the log, appended to if it exists.
+/// @return True if successful, false otherwise.
+bool openPipelineLog(const QString &path);
+
+/// Appends one row per stage with the current summaries, if a log is open.
+void writePipelineLog();
+
+/// Returns true if a log is open.
+bool pipelineLogOpen();
+
+/// Times a stage from construction to destruction.
+///
+/// Does nothing if recording is disabled at construction.
+class StageTimer {
+public:
+  /// Constructor.
+  ///
+  /// @param stage Stage to time.
+  explicit StageTimer(PipelineStage stage)
+    : stage_(stage)
+    , timer_() {
+    if(pipelineStatsEnabled() == true) {
+      timer_.start();
+    }
+  }
+
+  /// Destructor.
+  ~StageTimer() {
+    if(timer_.isValid() == true) {
+      recordStage(stage_, timer_.nsecsElapsed());
+    }
+  }
+private:
+  /// Stage being timed.
+  PipelineStage stage_;
+
+  /// Started if recording.
+  QElapsedTimer timer_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_PIPELINE_STATS_H
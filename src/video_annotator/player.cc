@@ -1,42 +1,111 @@
 
-#include <QTime>
-#include <QCoreApplication>
-#include <QEventLoop>
+#include <algorithm>
+
 #include <QMutexLocker>
 
+#include "decoder_threads.h"
+#include "function_thread.h"
+#include "pipeline_stats.h"
 #include "player.h"
 
 namespace tator { namespace video_annotator {
 
 namespace {
-  static const int kMaxBufferSize = 50;
-  static const int kTrimBound = kMaxBufferSize / 2;
+  /// Number of frames on either side of the playhead kept cached.
+  static const int kTrimBound = 25;
+
+  /// Default byte budget of the frame cache.
+  static const qint64 kFrameCacheBudget = 512LL * 1024 * 1024;
+
+  /// Number of frames decoded ahead of the playhead during playback.
+  static const int kRingSize = 16;
+
+  /// Default playback speed, as a multiple of the native rate, from which
+  /// only keyframes are decoded.
+  static const double kTrickPlaySpeed = 4.0;
+
+  /// Number of decoders prefetching jump targets.
+  static const int kPrefetchDecoders = 2;
+
+  /// Maximum number of frames prefetched from each jump target.
+  static const qint64 kPrefetchFrames = 8;
+
+  /// Prefetched frames use at most the budget divided by this.
+  static const qint64 kPrefetchShare = 4;
+
+  /// Frames decoded for stepping backward use at most the budget divided
+  /// by this.
+  static const qint64 kBackwardShare = 2;
+
+  /// Takes a reference to a decoded frame.
+  ///
+  /// @param decoded Decoded frame.
+  /// @return Shared reference, freed with the last copy.
+  std::shared_ptr<AVFrame> shareFrame(const AVFrame *decoded) {
+    return std::shared_ptr<AVFrame>(
+        av_frame_clone(decoded),
+        [](AVFrame *frame) { av_frame_free(&frame); });
+  }
 }
 
 Player::Player()
   : QObject()
   , video_path_()
+  , decode_path_()
   , frame_rate_(0.0)
   , stopped_(true)
   , image_()
   , current_speed_(0.0)
   , codec_context_(nullptr)
   , format_context_(nullptr)
+  , io_()
   , packet_()
   , stream_index_(-1)
   , frame_(nullptr)
-  , frame_rgb_(nullptr)
-  , sws_context_(nullptr)
+  , converter_()
+  , eof_sent_(false)
   , delay_(0.0)
   , dec_frame_(0)
   , req_frame_(0) 
   , seek_map_()
-  , frame_buffer_()
+  , gop_decoder_(seek_map_)
+  , scrub_decoder_()
+  , scrub_frame_(-1)
+  , scrub_pending_(false)
+  , step_delta_(0)
+  , step_pending_(false)
+  , index_path_()
+  , indexer_(nullptr)
+  , index_thread_(nullptr)
+  , duration_(0)
+  , start_pts_(0)
+  , frame_ticks_(1.0)
+  , container_complete_(false)
+  , frame_cache_(kFrameCacheBudget, kTrimBound)
+  , prefetch_pool_(seek_map_, kPrefetchDecoders)
+  , prefetch_generation_(0)
+  , prefetch_mutex_()
+  , prefetched_()
   , frame_mutex_()
   , buffering_(false)
-  , condition_() {
+  , condition_()
+  , ring_(kRingSize)
+  , decode_thread_(nullptr)
+  , decoding_(false)
+  , decode_eof_(false)
+  , present_timer_(this)
+  , clock_()
+  , clock_frame_(0)
+  , reverse_(false)
+  , dropped_frames_(0)
+  , late_frames_(0)
+  , trick_play_speed_(kTrickPlaySpeed)
+  , trick_play_(false) {
   av_register_all();
   av_init_packet(&packet_);
+  present_timer_.setTimerType(Qt::PreciseTimer);
+  QObject::connect(&present_timer_, &QTimer::timeout,
+      this, &Player::presentFrame);
 }
 
 Player::~Player() {
@@ -45,17 +114,30 @@ Player::~Player() {
 }
 
 void Player::loadVideo(QString filename) {
+  openVideo(filename, false);
+}
+
+void Player::reloadVideo() {
+  if(video_path_.isEmpty() == false) {
+    stop();
+    openVideo(video_path_, true);
+  }
+}
+
+void Player::openVideo(const QString &filename, bool reload) {
+  const qint64 reload_frame = req_frame_;
   reinit();
   video_path_ = filename;
-  frame_buffer_.clear();
+  ProxyInfo proxy;
+  const bool use_proxy = readProxyInfo(filename, proxy);
+  decode_path_ = use_proxy ? proxyPath(filename) : filename;
+  frame_cache_.clear();
+  frame_cache_.resetStats();
+  dec_frame_ = -1;
+  req_frame_ = 0;
   format_context_ = avformat_alloc_context();
   frame_ = av_frame_alloc();
-  frame_rgb_ = av_frame_alloc();
-  int status = avformat_open_input(
-    &format_context_, 
-    filename.toStdString().c_str(),
-    nullptr,
-    nullptr);
+  int status = io_.openInput(&format_context_, decode_path_);
   if(status != 0) {
     std::string msg(
         std::string("Failed to load media at ") +
@@ -89,10 +171,6 @@ void Player::loadVideo(QString filename) {
   frame_rate_ = 
     static_cast<double>(stream->avg_frame_rate.num) / 
     static_cast<double>(stream->avg_frame_rate.den);
-  uint64_t num_frames_est = format_context_->duration;
-  num_frames_est /= AV_TIME_BASE;
-  num_frames_est *= frame_rate_;
-  emit mediaLoadStart(num_frames_est / 1000);
   AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
   if(codec == nullptr) {
     std::string msg(
@@ -123,6 +201,7 @@ void Player::loadVideo(QString filename) {
     emit error(QString(msg.c_str()));
     return;
   }
+  configureDecoderThreads(codec_context_);
   status = avcodec_open2(codec_context_, codec, nullptr);
   if(status < 0) {
     std::string msg(
@@ -132,274 +211,807 @@ void Player::loadVideo(QString filename) {
     emit error(QString(msg.c_str()));
     return;
   }
-  sws_context_ = sws_getContext(
+  eof_sent_ = false;
+  converter_.init(
     codec_context_->width, 
     codec_context_->height,
-    codec_context_->pix_fmt,
-    codec_context_->width, 
-    codec_context_->height,
-    AV_PIX_FMT_RGB24,
-    SWS_BICUBIC,
-    nullptr, nullptr, nullptr);
+    codec_context_->pix_fmt);
   seek_map_.clear();
-  qint64 frame_index = 0;
-  avcodec_flush_buffers(codec_context_);
-  while(true) {
-    av_packet_unref(&packet_);
-    status = av_read_frame(format_context_, &packet_);
-    if(status < 0) {
-      break;
+  index_path_ = FrameIndex::cachePath(decode_path_);
+  frame_ticks_ = 
+    av_q2d(av_inv_q(stream->avg_frame_rate)) / 
+    av_q2d(stream->time_base);
+  start_pts_ = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+  const bool container_indexed = 
+    stream->nb_frames > 0 && 
+    stream->nb_index_entries >= stream->nb_frames;
+  // Index entries hold decode timestamps, which are only presentation
+  // timestamps if frames are not reordered.
+  container_complete_ = 
+    container_indexed && 
+    stream->codecpar->video_delay == 0;
+  if(seek_map_.load(index_path_) == true) {
+    duration_ = seek_map_.size();
+  }
+  else {
+    if(container_indexed) {
+      duration_ = stream->nb_index_entries;
     }
-    if(packet_.stream_index == stream_index_) {
-      if(frame_index % 1000 == 0) {
-        emit loadProgress(frame_index / 1000);
-      }
-      int got_picture = 1;
-      if(frame_index < 10) {
-        status = avcodec_decode_video2(
-          codec_context_, 
-          frame_,
-          &got_picture,
-          &packet_);
-      }
-      if(got_picture) {
-        seek_map_.left.insert({frame_index, packet_.dts});
-        ++frame_index;
-      }
+    else if(stream->nb_frames > 0) {
+      duration_ = stream->nb_frames;
     }
+    else {
+      duration_ = format_context_->duration * frame_rate_ / AV_TIME_BASE;
+    }
+    startIndexer();
+  }
+  if(duration_ <= 0) {
+    std::string msg(
+        std::string("Could not find any video frames in ") +
+        filename.toStdString() +
+        std::string("!"));
+    emit error(QString(msg.c_str()));
+    return;
   }
   av_seek_frame(
       format_context_, 
       stream_index_, 
-      seek_map_.right.begin()->first,
+      seek_map_.complete() ? seek_map_.firstPts() : frameToPts(0),
       AVSEEK_FLAG_BACKWARD);
+  gop_decoder_.open(decode_path_);
+  scrub_decoder_.open(decode_path_, FrameDecoder::kScrubMode);
+  prefetch_pool_.open(decode_path_);
   current_speed_ = frame_rate_;
   delay_ = 1000000.0 / frame_rate_;
+  trick_play_ = false;
   image_ = QImage(
       codec_context_->width,
       codec_context_->height,
       QImage::Format_RGB32);
-  if(frame_rgb_ != nullptr) {
-    if(frame_rgb_->data[0] != nullptr) {
-      av_freep(&frame_rgb_->data[0]);
-    }
+  // Proxy frames are smaller, the view scales them to the video size so
+  // annotations keep their coordinates.
+  const int width = use_proxy ? proxy.width : codec_context_->width;
+  const int height = use_proxy ? proxy.height : codec_context_->height;
+  if(reload == false) {
+    emit mediaLoaded(filename, frame_rate_);
   }
-  av_image_alloc(
-      frame_rgb_->data,
-      frame_rgb_->linesize,
-      codec_context_->width,
-      codec_context_->height,
-      AV_PIX_FMT_RGB24,
-      1);
-  emit mediaLoaded(filename, frame_rate_);
   emit playbackRateChanged(current_speed_);
-  emit durationChanged(seek_map_.size());
-  emit resolutionChanged(codec_context_->width, codec_context_->height);
+  emit durationChanged(duration_);
+  emit resolutionChanged(width, height);
+  if(reload == true) {
+    setFrame(std::min(reload_frame, duration_ - 1));
+  }
+}
+
+void Player::startIndexer() {
+  emit mediaLoadStart(duration_ / 1000);
+  seek_map_.reserve(duration_);
+  indexer_ = new FrameIndexer(decode_path_, &seek_map_);
+  index_thread_ = new QThread();
+  indexer_->moveToThread(index_thread_);
+  QObject::connect(index_thread_, &QThread::started,
+      indexer_, &FrameIndexer::run);
+  QObject::connect(indexer_, &FrameIndexer::progress,
+      this, &Player::loadProgress);
+  QObject::connect(indexer_, &FrameIndexer::finished,
+      this, &Player::handleIndexFinished);
+  index_thread_->start(QThread::LowPriority);
+}
+
+void Player::stopIndexer() {
+  if(indexer_ != nullptr) {
+    indexer_->abort();
+    index_thread_->quit();
+    index_thread_->wait();
+    delete indexer_;
+    delete index_thread_;
+    indexer_ = nullptr;
+    index_thread_ = nullptr;
+  }
+}
+
+void Player::handleIndexFinished(bool complete) {
+  // Ignore aborted scans and scans that finished after another video
+  // was loaded.
+  if(complete == false || seek_map_.complete() == false) {
+    return;
+  }
+  stopIndexer();
+  seek_map_.save(index_path_);
+  duration_ = seek_map_.size();
+  emit durationChanged(duration_);
+  emit mediaIndexed();
+}
+
+qint64 Player::frameToPts(qint64 frame) {
+  const qint64 size = seek_map_.size();
+  if(frame < size) {
+    return seek_map_.pts(frame);
+  }
+  AVStream *stream = format_context_->streams[stream_index_];
+  const qint64 last_pts = size > 0 ? seek_map_.pts(size - 1) : start_pts_;
+  if(container_complete_) {
+    // Container index has an entry per packet, so count entries past
+    // the last indexed frame.
+    qint64 pos = frame;
+    if(size > 0) {
+      int last = av_index_search_timestamp(
+          stream, last_pts, AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD);
+      pos = last < 0 ? -1 : last + frame - size + 1;
+    }
+    if(pos >= 0 && pos < stream->nb_index_entries) {
+      return stream->index_entries[pos].timestamp;
+    }
+  }
+  if(size > 0) {
+    return last_pts + qRound64((frame - size + 1) * frame_ticks_);
+  }
+  return start_pts_ + qRound64(frame * frame_ticks_);
+}
+
+qint64 Player::ptsToFrame(qint64 pts) {
+  if(pts == AV_NOPTS_VALUE) {
+    return -1;
+  }
+  const qint64 size = seek_map_.size();
+  const qint64 last_pts = size > 0 ? seek_map_.pts(size - 1) : start_pts_;
+  qint64 frame = seek_map_.frameForPts(pts);
+  if(frame >= 0 || seek_map_.complete()) {
+    return frame;
+  }
+  if(size > 0 && pts <= last_pts) {
+    return -1;
+  }
+  AVStream *stream = format_context_->streams[stream_index_];
+  if(container_complete_) {
+    int pos = av_index_search_timestamp(
+        stream, pts, AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD);
+    if(pos >= 0 && stream->index_entries[pos].timestamp == pts) {
+      if(size == 0) {
+        return pos;
+      }
+      int last = av_index_search_timestamp(
+          stream, last_pts, AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD);
+      if(last >= 0) {
+        return size - 1 + pos - last;
+      }
+    }
+  }
+  if(size > 0) {
+    return size - 1 + qRound64((pts - last_pts) / frame_ticks_);
+  }
+  return qRound64((pts - start_pts_) / frame_ticks_);
 }
 
 void Player::play() {
-  if(stopped_ == true) {
-    stopped_ = false;
+  if(present_timer_.isActive() == true) {
+    endPresenting();
   }
+  prefetch_pool_.cancel();
+  gop_decoder_.cancel();
+  stopped_ = false;
+  reverse_ = false;
   emit stateChanged(stopped_);
-  while(stopped_ == false) {
-    QTime t;
-    t.start();
-    setCurrentFrame(req_frame_ + 1);
-    emit processedImage(image_, req_frame_);
-    double usec = 1000.0 * t.restart();
-    processWait(std::round(delay_ - usec));
+  startDecoder();
+  startPresenting();
+}
+
+void Player::playReverse() {
+  if(present_timer_.isActive() == true) {
+    endPresenting();
+  }
+  prefetch_pool_.cancel();
+  stopDecoder();
+  stopped_ = false;
+  reverse_ = true;
+  emit stateChanged(stopped_);
+  startPresenting();
+}
+
+void Player::startPresenting() {
+  dropped_frames_ = 0;
+  late_frames_ = 0;
+  restartClock();
+  present_timer_.start();
+}
+
+void Player::restartClock() {
+  clock_frame_ = req_frame_;
+  clock_.start();
+  // Tick once per frame period, the clock decides which frame is due.
+  present_timer_.setInterval(std::max(1, qRound(delay_ / 1000.0)));
+}
+
+void Player::presentFrame() {
+  const qint64 elapsed = static_cast<qint64>(
+      clock_.nsecsElapsed() / 1000.0 / delay_);
+  if(reverse_ == true) {
+    qint64 due = clock_frame_ - elapsed;
+    due = due < 0 ? 0 : due;
+    if(trick_play_ == true && due < seek_map_.size()) {
+      // Snap to the keyframe, which decodes without the rest of its GOP.
+      const qint64 keyframe = seek_map_.keyframeBefore(due);
+      due = keyframe >= 0 ? keyframe : due;
+    }
+    if(due < req_frame_) {
+      dropped_frames_ += req_frame_ - due - 1;
+      setCurrentFrame(due);
+      emit processedImage(image_, req_frame_);
+    }
+    if(req_frame_ <= 0) {
+      stop();
+    }
+    return;
+  }
+  const qint64 due = clock_frame_ + elapsed;
+  if(req_frame_ >= due) {
+    return;
+  }
+  // Present the newest decoded frame that is due, dropping older ones
+  // without converting them.  Frames past the due frame stay in the ring,
+  // in trick play there may be many ticks between keyframes.
+  bool found = false;
+  DecodedFrame decoded;
+  DecodedFrame next;
+  while(ring_.peek(next) == true && next.frame <= due) {
+    ring_.pop(next);
+    if(found == true) {
+      ++dropped_frames_;
+    }
+    decoded = next;
+    found = true;
+  }
+  const bool ahead = ring_.empty() == false;
+  if(found == false) {
+    if(ahead == true) {
+      return;
+    }
+    if(decode_eof_ == true) {
+      // Every frame up to the end of the video has been presented.
+      stop();
+    }
+    else {
+      ++late_frames_;
+    }
+    return;
+  }
+  if(ahead == false && decoded.frame < due) {
+    ++late_frames_;
+  }
+  req_frame_ = decoded.frame;
+  if(decoded.decoded != nullptr) {
+    image_ = convertFrame(decoded.decoded.get());
+  }
+  emit processedImage(image_, req_frame_);
+}
+
+void Player::endPresenting() {
+  present_timer_.stop();
+  stopDecoder();
+  emit playbackStats(dropped_frames_, late_frames_);
+}
+
+void Player::startDecoder() {
+  if(decode_thread_ != nullptr) {
+    return;
+  }
+  ring_.clear();
+  decoding_ = true;
+  decode_eof_ = false;
+  decode_thread_.reset(new FunctionThread([this]() { decodeLoop(); }));
+  decode_thread_->start();
+}
+
+bool Player::stopDecoder() {
+  if(decode_thread_ == nullptr) {
+    return false;
+  }
+  decoding_ = false;
+  decode_thread_->wait();
+  decode_thread_.reset(nullptr);
+  ring_.clear();
+  return true;
+}
+
+void Player::decodeLoop() {
+  // Replay frames that were decoded ahead of the playhead before the
+  // last stop, then position the decoder right after them.
+  qint64 next = req_frame_ + 1;
+  while(next <= dec_frame_ && decoding_ == true) {
+    if(ring_.full()) {
+      QThread::msleep(1);
+      continue;
+    }
+    std::shared_ptr<AVFrame> decoded;
+    {
+      QMutexLocker locker(&frame_mutex_);
+      const AVFrame *cached = frame_cache_.find(next);
+      if(cached == nullptr) {
+        break;
+      }
+      decoded = shareFrame(cached);
+    }
+    ring_.push({next, decoded});
+    ++next;
+  }
+  if(next - 1 != dec_frame_) {
+    buffer(next - 1, false);
+  }
+  // In trick play the decoder still reads every packet but only decodes
+  // keyframes, frame numbers still come from their timestamps.
+  codec_context_->skip_frame =
+    trick_play_ == true ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+  while(decoding_ == true) {
+    if(ring_.full()) {
+      QThread::msleep(1);
+      continue;
+    }
+    if(getOneFrame() == false) {
+      decode_eof_ = true;
+      break;
+    }
+    ring_.push({dec_frame_, shareFrame(frame_)});
+  }
+  if(codec_context_->skip_frame != AVDISCARD_DEFAULT) {
+    // Packets after the last keyframe were discarded, so the decoder
+    // cannot continue from it and the next decode has to seek.
+    codec_context_->skip_frame = AVDISCARD_DEFAULT;
+    dec_frame_ = -1;
   }
 }
 
 void Player::stop() {
+  if(present_timer_.isActive() == true) {
+    endPresenting();
+  }
   stopped_ = true;
   emit stateChanged(stopped_);
 }
 
-void Player::getOneFrame() {
+bool Player::getOneFrame(qint64 cache_from) {
   QMutexLocker locker(&frame_mutex_);
-  bool valid = false;
-  int count_errs = 0;
-  const int max_errs = 1 << 9;
-  int got_picture;
-  while(!valid) {
+  while(true) {
+    int status = 0;
+    {
+      StageTimer timer(kDecodeStage);
+      status = avcodec_receive_frame(codec_context_, frame_);
+    }
+    if(status == AVERROR(EAGAIN)) {
+      // Decoder needs more input before it can return a frame.
+      if(sendPacket() == false) {
+        return false;
+      }
+      continue;
+    }
+    if(status < 0) {
+      // Drained at end of stream, or decoder failure.
+      return false;
+    }
+    qint64 frame = ptsToFrame(frame_->best_effort_timestamp);
+    dec_frame_ = frame >= 0 ? frame : dec_frame_ + 1;
+    if(dec_frame_ >= cache_from) {
+      frame_cache_.setPlayhead(req_frame_);
+      frame_cache_.insert(dec_frame_, frame_);
+    }
+    return true;
+  }
+}
+
+QImage Player::convertFrame(const AVFrame *decoded) {
+  StageTimer timer(kConvertStage);
+  return converter_.convert(decoded);
+}
+
+bool Player::sendPacket() {
+  if(eof_sent_ == true) {
+    return false;
+  }
+  while(true) {
     av_packet_unref(&packet_);
-    int status = av_read_frame(format_context_, &packet_);
+    int status = 0;
+    {
+      StageTimer timer(kDemuxStage);
+      status = av_read_frame(format_context_, &packet_);
+    }
     if(status == AVERROR(EAGAIN)) {
       continue;
     }
     if(status < 0) {
-      stop();
-      break;
+      // Start draining, frames still held by the decoder are returned
+      // by the following receive calls.
+      eof_sent_ = true;
+      return avcodec_send_packet(codec_context_, nullptr) == 0;
     }
     if(packet_.stream_index != stream_index_) {
-      av_packet_unref(&packet_);
+      continue;
     }
-    else {
-      auto it = seek_map_.right.find(packet_.dts);
-      if(!(it == seek_map_.right.end())) {
-        dec_frame_ = it->second;
-      }
-      status = avcodec_decode_video2(
-        codec_context_, 
-        frame_,
-        &got_picture,
-        &packet_);
-      if(got_picture) {
-        sws_scale(
-            sws_context_, 
-            frame_->data, 
-            frame_->linesize, 
-            0, 
-            codec_context_->height, 
-            frame_rgb_->data, 
-            frame_rgb_->linesize);
-        uint8_t *src = (uint8_t*)(frame_rgb_->data[0]);
-        for(int y = 0; y < codec_context_->height; ++y) {
-          QRgb *scan_line = (QRgb*)image_.scanLine(y);
-          for(int x = 0; x < codec_context_->width; ++x) {
-            scan_line[x] = qRgb(src[3*x], src[3*x+1], src[3*x+2]);
-          }
-          src += frame_rgb_->linesize[0];
-        }
-        frame_buffer_.insert({dec_frame_, image_});
-        if(frame_buffer_.size() > kMaxBufferSize) {
-          for(auto buf_it = frame_buffer_.cbegin(); 
-              buf_it != frame_buffer_.cend();) {
-            if(qAbs(buf_it->first - req_frame_) > kTrimBound) {
-              buf_it = frame_buffer_.erase(buf_it);
-            }
-            else {
-              ++buf_it;
-            }
-          }
-        }
-        valid = true;
-      }
-      else {
-        count_errs++;
-        if(count_errs > max_errs) {
-          break;
-        }
-      }
+    // Corrupt packets are skipped, the decoder recovers at the next
+    // decodable one.
+    {
+      StageTimer timer(kDecodeStage);
+      status = avcodec_send_packet(codec_context_, &packet_);
+    }
+    if(status == 0) {
+      return true;
+    }
+    if(status != AVERROR_INVALIDDATA) {
+      return false;
     }
   }
 }
 
+void Player::flushDecoder() {
+  avcodec_flush_buffers(codec_context_);
+  eof_sent_ = false;
+}
+
 void Player::speedUp() {
   delay_ /= 2.0;
   if(delay_ < 1.0) delay_ = 1.0;
   current_speed_ *= 2.0;
+  updateTrickPlay();
+  restartClock();
   emit playbackRateChanged(current_speed_);
 }
 
 void Player::slowDown() {
   delay_ *= 2.0;
   current_speed_ /= 2.0;
+  updateTrickPlay();
+  restartClock();
   emit playbackRateChanged(current_speed_);
 }
 
+void Player::setTrickPlaySpeed(double speed) {
+  trick_play_speed_ = speed;
+  updateTrickPlay();
+}
+
+void Player::updateTrickPlay() {
+  const bool trick_play = 
+    frame_rate_ > 0.0 &&
+    trick_play_speed_ > 0.0 &&
+    current_speed_ >= trick_play_speed_ * frame_rate_;
+  if(trick_play == trick_play_) {
+    return;
+  }
+  // Decoder settings are only changed while the decode thread is stopped.
+  const bool was_decoding = stopDecoder();
+  trick_play_ = trick_play;
+  if(was_decoding == true && stopped_ == false) {
+    startDecoder();
+  }
+}
+
 void Player::nextFrame() {
-  setCurrentFrame(req_frame_ + 1);
-  emit processedImage(image_, req_frame_);
+  step(1);
 }
 
 void Player::prevFrame() {
-  setCurrentFrame(req_frame_ - 1);
+  step(-1);
+}
+
+void Player::step(qint64 delta) {
+  step_delta_ += delta;
+  if(step_pending_ == false) {
+    // Queued behind any step requests already waiting, so repeated key
+    // presses are merged into one seek.
+    step_pending_ = true;
+    QMetaObject::invokeMethod(this, "processStep", Qt::QueuedConnection);
+  }
+}
+
+void Player::processStep() {
+  step_pending_ = false;
+  const qint64 delta = step_delta_;
+  step_delta_ = 0;
+  if(delta == 0 || format_context_ == nullptr) {
+    return;
+  }
+  setCurrentFrame(req_frame_ + delta);
   emit processedImage(image_, req_frame_);
-  if(buffering_ == false) {
-    buffering_ = true;
-    auto buf_it = frame_buffer_.begin();
-    if(req_frame_ - buf_it->first < kTrimBound / 2) {
-      buffer(req_frame_, 1000);
+}
+
+void Player::scrub(qint64 frame) {
+  scrub_frame_ = frame;
+  if(scrub_pending_ == false) {
+    // Queued behind any scrub requests already waiting, so only the
+    // latest one is decoded.
+    scrub_pending_ = true;
+    QMetaObject::invokeMethod(this, "processScrub", Qt::QueuedConnection);
+  }
+}
+
+void Player::processScrub() {
+  scrub_pending_ = false;
+  if(scrub_frame_ < 0 || format_context_ == nullptr) {
+    return;
+  }
+  qint64 frame = scrub_frame_ > duration_ - 1 ? duration_ - 1 : scrub_frame_;
+  scrub_frame_ = -1;
+  qint64 pts = frameToPts(frame);
+  if(frame < seek_map_.size()) {
+    qint64 keyframe = seek_map_.keyframeBefore(frame);
+    if(keyframe >= 0) {
+      pts = seek_map_.pts(keyframe);
     }
-    buffering_ = false;
   }
+  QImage image;
+  qint64 keyframe_pts = 0;
+  if(scrub_decoder_.decodeKeyframe(pts, image, keyframe_pts) == false) {
+    return;
+  }
+  qint64 shown = ptsToFrame(keyframe_pts);
+  emit processedImage(image, shown < 0 ? frame : shown);
+}
+
+void Player::prefetch(QList<qint64> frames) {
+  prefetch_pool_.cancel();
+  ++prefetch_generation_;
+  // The frame cache belongs to the decode thread during playback.
+  if(format_context_ == nullptr || decode_thread_ != nullptr) {
+    return;
+  }
+  std::vector<qint64> targets;
+  for(qint64 frame : frames) {
+    if(frame >= 0 &&
+        frame < seek_map_.size() &&
+        frame_cache_.contains(frame) == false) {
+      targets.push_back(frame);
+    }
+  }
+  if(targets.empty()) {
+    return;
+  }
+  qint64 count = frame_cache_.budget() / kPrefetchShare / frameBytes() /
+    static_cast<qint64>(targets.size());
+  count = std::min(count, kPrefetchFrames);
+  if(count < 1) {
+    return;
+  }
+  const int generation = prefetch_generation_;
+  prefetch_pool_.prefetch(targets, count,
+    [this, generation](qint64 frame, const AVFrame *decoded) {
+      queuePrefetched(frame, decoded, generation);
+      return true;
+    });
+}
+
+void Player::queuePrefetched(
+    qint64 frame,
+    const AVFrame *decoded,
+    int generation) {
+  QMutexLocker locker(&prefetch_mutex_);
+  if(prefetched_.empty()) {
+    QMetaObject::invokeMethod(
+        this, "cachePrefetched", Qt::QueuedConnection);
+  }
+  prefetched_.push_back({frame, av_frame_clone(decoded), generation});
+}
+
+qint64 Player::frameBytes() const {
+  // Size of a YUV 4:2:0 frame, the most common cached format.
+  return 3LL * codec_context_->width * codec_context_->height / 2;
+}
+
+void Player::cachePrefetched() {
+  std::vector<PrefetchedFrame> prefetched;
+  {
+    QMutexLocker locker(&prefetch_mutex_);
+    prefetched.swap(prefetched_);
+  }
+  for(PrefetchedFrame &entry : prefetched) {
+    if(entry.decoded != nullptr &&
+        entry.generation == prefetch_generation_ &&
+        decode_thread_ == nullptr &&
+        codec_context_ != nullptr &&
+        entry.decoded->width == codec_context_->width &&
+        entry.decoded->height == codec_context_->height &&
+        entry.decoded->format == codec_context_->pix_fmt) {
+      frame_cache_.setPlayhead(req_frame_);
+      frame_cache_.insert(entry.frame, entry.decoded);
+    }
+    av_frame_free(&entry.decoded);
+  }
+}
+
+void Player::setFrameCacheBudget(qint64 bytes) {
+  const bool was_decoding = stopDecoder();
+  gop_decoder_.cancel();
+  frame_cache_.setBudget(bytes);
+  if(was_decoding == true && stopped_ == false) {
+    startDecoder();
+  }
+}
+
+void Player::reportFrameCacheStats() {
+  FrameCache::Stats stats;
+  {
+    // The decode thread modifies the cache under this mutex.
+    QMutexLocker locker(&frame_mutex_);
+    stats = frame_cache_.stats();
+  }
+  emit frameCacheStats(
+      stats.hits, stats.misses, stats.evictions, stats.frames, stats.bytes);
 }
 
 void Player::setCurrentFrame(qint64 frame_num) {
+  // Decoder state is owned by the decode thread during playback.
+  const bool was_decoding = stopDecoder();
   qint64 bounded = frame_num < 0 ? 0 : frame_num;
-  const qint64 max_frame = seek_map_.left.rbegin()->first;
+  const qint64 max_frame = duration_ - 1;
   bounded = bounded > max_frame ? max_frame : bounded;
+  const bool backward = bounded < req_frame_;
   req_frame_ = bounded;
-  if(frame_num - dec_frame_ == 1) {
-    getOneFrame();
+  if(dec_frame_ >= 0 && frame_num - dec_frame_ == 1) {
+    if(getOneFrame() == true) {
+      image_ = convertFrame(frame_);
+    }
   }
   else {
     buffering_ = true;
-    auto buf_it = frame_buffer_.find(frame_num);
-    if(buf_it != frame_buffer_.end()) {
-      image_ = buf_it->second;
+    const AVFrame *cached = frame_cache_.find(bounded);
+    if(cached != nullptr) {
+      image_ = convertFrame(cached);
     }
-    else {
-      buffer(bounded, 0);
+    else if(backward == false || 
+        bounded >= seek_map_.size() ||
+        frame_cache_.budget() == 0 ||
+        decodeBackward(bounded) == false) {
+      buffer(bounded);
+    }
+    if(backward == true && 
+        bounded < seek_map_.size() &&
+        frame_cache_.budget() > 0) {
+      prefetchBackward(bounded);
     }
     buffering_ = false;
   }
+  if(was_decoding == true && stopped_ == false) {
+    startDecoder();
+  }
 }
 
-void Player::buffer(qint64 frame_num, qint64 wait) {
-  qint64 seek_to = frame_num - kTrimBound;
-  seek_to = seek_to < 0 ? 0 : seek_to;
-  auto it = seek_map_.left.find(seek_to);
-  if(it != seek_map_.left.end()) {
+bool Player::decodeBackward(qint64 frame_num) {
+  // A prefetch may be decoding this frame already.
+  gop_decoder_.waitFor(frame_num);
+  cachePrefetched();
+  frame_cache_.setPlayhead(frame_num);
+  if(frame_cache_.contains(frame_num) == true) {
+    image_ = convertFrame(frame_cache_.find(frame_num));
+    return true;
+  }
+  bool found = false;
+  gop_decoder_.decode(frame_num, backwardFrames(),
+    [this, frame_num, &found](qint64 frame, const AVFrame *decoded) {
+      frame_cache_.insert(frame, decoded);
+      if(frame == frame_num) {
+        image_ = convertFrame(decoded);
+        found = true;
+      }
+      return true;
+    });
+  return found;
+}
+
+void Player::prefetchBackward(qint64 frame_num) {
+  if(gop_decoder_.prefetching() == true) {
+    return;
+  }
+  // Start once fewer than half of the frames decoded by a pass are
+  // cached right behind the playhead.
+  const qint64 count = backwardFrames();
+  qint64 target = frame_num - 1;
+  while(target >= 0 && 
+      frame_num - target <= count / 2 &&
+      frame_cache_.contains(target) == true) {
+    --target;
+  }
+  if(target < 0 || frame_num - target > count / 2) {
+    return;
+  }
+  const int generation = prefetch_generation_;
+  gop_decoder_.prefetch(target, count,
+    [this, generation](qint64 frame, const AVFrame *decoded) {
+      queuePrefetched(frame, decoded, generation);
+      return true;
+    });
+}
+
+qint64 Player::backwardFrames() const {
+  return std::max<qint64>(
+      frame_cache_.budget() / kBackwardShare / frameBytes(), 1);
+}
+
+void Player::buffer(qint64 frame_num, bool show) {
+  const qint64 keep_from = frame_num - kTrimBound;
+  qint64 seek_to = -1;
+  if(frame_num < seek_map_.size()) {
+    seek_to = seek_map_.keyframeBefore(frame_num);
+  }
+  bool need_seek = true;
+  if(seek_to >= 0 && dec_frame_ >= seek_to && dec_frame_ < frame_num) {
+    // Decoder is already inside the target GOP.
+    need_seek = false;
+  }
+  if(seek_to < 0) {
+    // Keyframes not indexed yet, seek near the frame and rely on the
+    // demuxer to find the preceding keyframe.
+    seek_to = keep_from < 0 ? 0 : keep_from;
+  }
+  if(need_seek == true) {
     int status = av_seek_frame(
         format_context_, 
         stream_index_, 
-        it->second, 
+        frameToPts(seek_to), 
         AVSEEK_FLAG_BACKWARD);
     if(status < 0) {
       emit error("Error seeking to frame!");
       return;
     }
-    avcodec_flush_buffers(codec_context_);
-    while(true) {
-      getOneFrame();
-      if(dec_frame_ >= frame_num) {
-        break;
+    flushDecoder();
+  }
+  qint64 decoded = 0;
+  qint64 wasted = 0;
+  while(true) {
+    if(getOneFrame(keep_from) == false) {
+      // Ended before the requested frame, show the last decoded one.
+      // The cache is shared with the player thread, which reads its
+      // statistics.
+      QMutexLocker locker(&frame_mutex_);
+      const AVFrame *last = frame_cache_.find(dec_frame_);
+      if(last != nullptr && show == true) {
+        image_ = convertFrame(last);
       }
-      if(wait > 0) {
-        processWait(wait);
+      break;
+    }
+    ++decoded;
+    if(dec_frame_ < keep_from) {
+      ++wasted;
+    }
+    if(dec_frame_ >= frame_num) {
+      // Only the requested frame is converted, frames on the way there
+      // stay in the cache in decoded form.
+      if(show == true) {
+        image_ = convertFrame(frame_);
       }
+      emit seekCompleted(frame_num, decoded, wasted);
+      break;
     }
   }
 }
 
 void Player::setFrame(qint64 frame) {
   setCurrentFrame(frame);
-  emit processedImage(image_, req_frame_);
-}
-
-void Player::processWait(qint64 usec) {
-  QTime die_time = QTime::currentTime().addMSecs(usec / 1000);
-  QCoreApplication::processEvents(QEventLoop::AllEvents, 1);
-  while(QTime::currentTime() < die_time) {
-    QCoreApplication::processEvents(QEventLoop::AllEvents, 1);
+  if(present_timer_.isActive() == true) {
+    restartClock();
   }
+  emit processedImage(image_, req_frame_);
 }
 
 void Player::reinit() {
+  present_timer_.stop();
+  stopDecoder();
+  stopIndexer();
   QMutexLocker locker(&frame_mutex_);
   if(codec_context_ != nullptr) {
     avcodec_close(codec_context_);
     codec_context_ = nullptr;
   }
-  if(format_context_ != nullptr) {
-    avformat_close_input(&format_context_);
-    format_context_ = nullptr;
-  }
-  if(frame_rgb_ != nullptr) {
-    if(frame_rgb_->data[0] != nullptr) {
-      av_freep(&frame_rgb_->data[0]);
-    }
-    av_frame_free(&frame_rgb_);
-    frame_rgb_ = nullptr;
-  }
+  io_.closeInput(&format_context_);
+  converter_.close();
   if(frame_ != nullptr) {
     av_frame_free(&frame_);
     frame_ = nullptr;
   }
+  gop_decoder_.close();
+  scrub_decoder_.close();
+  prefetch_pool_.close();
+  ++prefetch_generation_;
+  cachePrefetched();
+  scrub_frame_ = -1;
+  step_delta_ = 0;
+  seek_map_.clear();
   stopped_ = true;
 }
 
@@ -7,14 +7,14 @@
 #include <string>
 #include <memory>
 #include <atomic>
-#include <map>
-
-#include <boost/bimap.hpp>
+#include <vector>
 
 #include <QImage>
 #include <QThread>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QTimer>
+#include <QElapsedTimer>
 
 extern "C" {
 #include <libavutil/attributes.h>
@@ -28,6 +28,16 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+#include "frame_cache.h"
+#include "frame_converter.h"
+#include "frame_index.h"
+#include "frame_indexer.h"
+#include "frame_ring.h"
+#include "gop_decoder.h"
+#include "prefetch_pool.h"
+#include "proxy_transcoder.h"
+#include "read_ahead_io.h"
+
 namespace tator { namespace video_annotator {
 
 /// Class for playing video.
@@ -41,32 +51,94 @@ public:
     ~Player();
 public slots:
     /// Plays the video.
+    ///
+    /// Returns immediately.  Frames are presented by a timer against a
+    /// playback clock, and frames that are not decoded in time are
+    /// skipped instead of slowing playback down.
     void play();
     
+    /// Plays the video backward.
+    ///
+    /// Uses the same playback rate as forward playback.
+    void playReverse();
+
     /// Stops the video.
     void stop();
 
     /// Loads the video.
     ///
+    /// Decodes the all-intra proxy of the video instead, if it has one.
+    /// Frames of the proxy are numbered the same as the video.
+    ///
     /// @param filename Path to video.
     void loadVideo(QString filename);
 
+    /// Loads the current video again at the current frame.
+    ///
+    /// Used to switch to a proxy once it is made, without reloading
+    /// annotations.
+    void reloadVideo();
+
     /// Increases the speed of the video by a factor of two.
     void speedUp();
 
     /// Decreases the speed of the video by a factor of two.
     void slowDown();
 
+    /// Sets the speed from which playback only decodes keyframes.
+    ///
+    /// Above this speed decoding every frame cannot keep up, so keyframes
+    /// are shown at their place on the playback clock instead.
+    ///
+    /// @param speed Multiple of the native frame rate, 0 to disable.
+    void setTrickPlaySpeed(double speed);
+
     /// Sets position to specified frame.
     ///
     /// @param frame Frame to seek to.
     void setFrame(qint64 frame);
 
     /// Sets position to next frame.
+    ///
+    /// Steps requested before the previous one was handled are merged
+    /// into a single seek.
     void nextFrame();
 
     /// Sets position to previous frame.
+    ///
+    /// Steps requested before the previous one was handled are merged
+    /// into a single seek.
     void prevFrame();
+
+    /// Shows a low resolution preview near a frame.
+    ///
+    /// Intended for dragging the video slider.  Requests that arrive
+    /// before a preview is decoded supersede it, and the position is not
+    /// changed, so setFrame should follow when scrubbing ends.
+    ///
+    /// @param frame Frame to preview.
+    void scrub(qint64 frame);
+
+    /// Warms the frame cache at frames the user may jump to next.
+    ///
+    /// Cancels the previous prefetch.  Frames are decoded in the
+    /// background by a pool of decoders, with the most likely target
+    /// first, and use at most a fraction of the frame cache budget.
+    /// Ignored during playback and for frames not indexed yet.
+    ///
+    /// @param frames Likely targets, most likely first.
+    void prefetch(QList<qint64> frames);
+
+    /// Sets the memory budget of the decoded frame cache.
+    ///
+    /// A budget of zero disables caching, including the frames decoded
+    /// for stepping backward, so that every seek decodes.
+    ///
+    /// @param bytes Maximum total size of cached frames in bytes.
+    void setFrameCacheBudget(qint64 bytes);
+
+    /// Emits frameCacheStats with the statistics of the frame cache.
+    void reportFrameCacheStats();
 signals:
     /// Emitted when a frame is ready to display.
     //
@@ -90,6 +162,38 @@ signals:
     /// @param height Video height.
     void resolutionChanged(qint64 width, qint64 height);
 
+    /// Emitted after a seek and decode to a requested frame.
+    ///
+    /// @param frame Requested frame.
+    /// @param decoded Number of frames decoded to reach the requested frame.
+    /// @param wasted Number of decoded frames that were discarded without
+    ///   being buffered.
+    void seekCompleted(qint64 frame, qint64 decoded, qint64 wasted);
+
+    /// Emitted when playback ends.
+    ///
+    /// @param dropped Number of decoded frames skipped to keep up with
+    ///   the playback clock.
+    /// @param late Number of timer ticks where the due frame was not
+    ///   decoded yet.
+    void playbackStats(qint64 dropped, qint64 late);
+
+    /// Emitted when frame cache statistics are requested.
+    ///
+    /// Counts are since the video was loaded.
+    ///
+    /// @param hits Number of lookups that found a frame.
+    /// @param misses Number of lookups that did not.
+    /// @param evictions Number of frames evicted to stay in budget.
+    /// @param frames Number of cached frames.
+    /// @param bytes Total size of cached frames in bytes.
+    void frameCacheStats(
+        qint64 hits,
+        qint64 misses,
+        qint64 evictions,
+        qint64 frames,
+        qint64 bytes);
+
     /// Emitted when play/pause state changed.
     ///
     /// @param stopped True if stopped, false otherwise.
@@ -105,6 +209,12 @@ signals:
     /// @param progress Load progress.
     void loadProgress(int progress);
 
+    /// Emitted when the frame index of the loaded media is complete.
+    ///
+    /// Until this is emitted, frame positions beyond the indexed part of
+    /// the video are estimated and duration is approximate.
+    void mediaIndexed();
+
     /// Emitted when new media is loaded.
     ///
     /// @param video_path Path to loaded video file.
@@ -115,15 +225,37 @@ signals:
     ///
     /// @param err Error message.
     void error(QString err);
+private slots:
+    /// Handles completion of the background frame index scan.
+    ///
+    /// @param complete True if the whole video was indexed.
+    void handleIndexFinished(bool complete);
+
+    /// Decodes and emits the preview for the latest scrub request.
+    void processScrub();
+
+    /// Applies the accumulated frame steps.
+    void processStep();
+
+    /// Moves prefetched frames to the frame cache.
+    ///
+    /// Frames from an earlier prefetch or video are dropped.
+    void cachePrefetched();
+
+    /// Presents the frame due on the playback clock.
+    void presentFrame();
 private:
     /// Path to loaded video.
     QString video_path_;
 
+    /// Path to decoded video, the proxy of video_path_ if it has one.
+    QString decode_path_;
+
     /// Native frame rate of loaded video.
     double frame_rate_;
 
     /// True if player is stopped, false otherwise.
-    bool stopped_;
+    std::atomic<bool> stopped_;
 
     /// Stores most recent image.
     QImage image_;
@@ -137,6 +269,9 @@ private:
     /// Format context.
     AVFormatContext *format_context_;
 
+    /// Demuxer input with read-ahead for network mounts.
+    ReadAheadIO io_;
+
     /// Packet.
     AVPacket packet_;
 
@@ -146,26 +281,85 @@ private:
     /// Most recent frame.
     AVFrame *frame_;
 
-    /// For converting decoded frame to RGB.
-    AVFrame *frame_rgb_;
+    /// Converts decoded frames to images.
+    FrameConverter converter_;
 
-    /// Conversion context.
-    SwsContext *sws_context_;
+    /// True after the end of the stream was sent to the decoder.
+    bool eof_sent_;
 
     /// Delay between frames in microseconds.
     double delay_;
 
-    /// Last decoded frame.
+    /// Last decoded frame, -1 if the decoder must seek before decoding.
     qint64 dec_frame_;
 
     /// Last requested frame.
-    qint64 req_frame_;
+    std::atomic<qint64> req_frame_;
+
+    /// Map between frame index, presentation timestamp and keyframes.
+    FrameIndex seek_map_;
+
+    /// Decodes frames preceding the playhead, for stepping backward.
+    GopDecoder gop_decoder_;
+
+    /// Decoder for low resolution previews while scrubbing.
+    FrameDecoder scrub_decoder_;
+
+    /// Latest frame requested by scrub, -1 if none.
+    qint64 scrub_frame_;
+
+    /// True if processScrub is queued.
+    bool scrub_pending_;
+
+    /// Frame steps requested but not yet applied.
+    qint64 step_delta_;
+
+    /// True if processStep is queued.
+    bool step_pending_;
+
+    /// Path to cached frame index for loaded video.
+    QString index_path_;
+
+    /// Builds seek_map_ in the background, nullptr if not running.
+    FrameIndexer *indexer_;
+
+    /// Thread for indexer_.
+    QThread *index_thread_;
+
+    /// Number of frames in video, estimated until indexing completes.
+    qint64 duration_;
+
+    /// Stream timestamp of the first frame, used for estimates.
+    qint64 start_pts_;
+
+    /// Duration of one frame in stream time base, used for estimates.
+    double frame_ticks_;
+
+    /// True if the container index has an entry for every packet and
+    /// its timestamps are presentation timestamps.
+    bool container_complete_;
+
+    /// Recently decoded frames.
+    FrameCache frame_cache_;
 
-    /// Map between frame index and decompression timestamp.
-    boost::bimap<qint64, qint64> seek_map_;
+    /// Decoders warming frame_cache_ at likely jump targets.
+    PrefetchPool prefetch_pool_;
 
-    /// Frame buffer.
-    std::map<qint64, QImage> frame_buffer_;
+    /// Incremented for each prefetch and each loaded video.
+    int prefetch_generation_;
+
+    /// Frame decoded by prefetch_pool_, waiting to be cached.
+    struct PrefetchedFrame {
+      qint64 frame; ///< Frame number.
+      AVFrame *decoded; ///< Reference to the decoded frame, owned.
+      int generation; ///< Value of prefetch_generation_ when requested.
+    };
+
+    /// Guards prefetched_.
+    QMutex prefetch_mutex_;
+
+    /// Frames decoded by prefetch_pool_, waiting to be cached.
+    std::vector<PrefetchedFrame> prefetched_;
 
     /// Mutex for grabbing frames.
     QMutex frame_mutex_;
@@ -176,8 +370,131 @@ private:
     /// Wait condition for deletion.
     QWaitCondition condition_;
 
-    /// Processes a single frame.
-    void getOneFrame();
+    /// Decoded frame waiting to be presented.
+    struct DecodedFrame {
+      qint64 frame; ///< Frame number.
+      std::shared_ptr<AVFrame> decoded; ///< Converted only if presented.
+    };
+
+    /// Frames decoded ahead of the playhead during playback.
+    FrameRing<DecodedFrame> ring_;
+
+    /// Fills ring_ during playback, nullptr if not running.
+    std::unique_ptr<QThread> decode_thread_;
+
+    /// True while decode_thread_ should keep decoding.
+    std::atomic<bool> decoding_;
+
+    /// True when decode_thread_ reached the end of the video.
+    std::atomic<bool> decode_eof_;
+
+    /// Fires once per frame period during playback.
+    QTimer present_timer_;
+
+    /// Playback clock, time since clock_frame_ was presented.
+    QElapsedTimer clock_;
+
+    /// Frame presented when clock_ was started.
+    qint64 clock_frame_;
+
+    /// True if playing backward.
+    bool reverse_;
+
+    /// Frames skipped during the current playback.
+    qint64 dropped_frames_;
+
+    /// Ticks without a due frame during the current playback.
+    qint64 late_frames_;
+
+    /// Speed as a multiple of the native rate from which trick play is used.
+    double trick_play_speed_;
+
+    /// True if playback only decodes keyframes.
+    bool trick_play_;
+
+    /// Switches trick play on or off to match the current speed.
+    void updateTrickPlay();
+
+    /// Starts the presentation timer and playback clock.
+    void startPresenting();
+
+    /// Stops the presentation timer and decoder and reports statistics.
+    void endPresenting();
+
+    /// Restarts the playback clock from the current frame.
+    ///
+    /// Called when the position or rate changes during playback.
+    void restartClock();
+
+    /// Requests a relative frame step.
+    ///
+    /// @param delta Number of frames to step, negative for backward.
+    void step(qint64 delta);
+
+    /// Starts decoding ahead of the playhead on decode_thread_.
+    void startDecoder();
+
+    /// Stops decode_thread_ and discards frames in ring_.
+    ///
+    /// @return True if the decoder was running.
+    bool stopDecoder();
+
+    /// Decodes frames into ring_ until stopped.  Runs on decode_thread_.
+    void decodeLoop();
+
+    /// Decodes a single frame into frame_.
+    ///
+    /// The frame is cached but not converted, see convertFrame.
+    ///
+    /// @param cache_from Decoded frames before this frame are not cached.
+    /// @return True if a frame was decoded, false on end of file or error.
+    bool getOneFrame(qint64 cache_from = 0);
+
+    /// Decodes a frame before the playhead with the rest of its GOP.
+    ///
+    /// Frames up to the requested one go to the frame cache, within a
+    /// share of its budget, and only the requested frame is converted.
+    ///
+    /// @param frame_num Frame to decode, must be in the frame index.
+    /// @return True if the frame was decoded, false otherwise.
+    bool decodeBackward(qint64 frame_num);
+
+    /// Starts decoding the frames before those cached behind a frame,
+    /// unless enough of them are cached.
+    ///
+    /// @param frame_num Current frame.
+    void prefetchBackward(qint64 frame_num);
+
+    /// Returns the number of frames decoded for stepping backward.
+    qint64 backwardFrames() const;
+
+    /// Returns the estimated size of a decoded frame in bytes.
+    qint64 frameBytes() const;
+
+    /// Queues a frame decoded on a background thread for the cache.
+    ///
+    /// @param frame Frame number.
+    /// @param decoded Decoded frame.
+    /// @param generation Value of prefetch_generation_ when requested.
+    void queuePrefetched(
+        qint64 frame,
+        const AVFrame *decoded,
+        int generation);
+
+    /// Converts a decoded frame to an image for display.
+    ///
+    /// @param decoded Decoded frame.
+    QImage convertFrame(const AVFrame *decoded);
+
+    /// Reads the next video packet and sends it to the decoder.
+    ///
+    /// At the end of the file, starts draining the decoder instead.
+    ///
+    /// @return True if a packet or the end of stream was sent.
+    bool sendPacket();
+
+    /// Discards decoder state after a seek.
+    void flushDecoder();
 
     /// Sets the current frame.
     ///
@@ -186,12 +503,46 @@ private:
 
     /// Buffers frames.
     ///
+    /// Seeks to the nearest keyframe at or before the requested frame, 
+    /// unless the decoder can reach it by decoding forward from its current
+    /// position, and converts only frames close to the requested one.
+    ///
     /// @param frame_num Buffer up to this frame number.
-    /// @param wait Number of usec to wait between decoding frames.
-    void buffer(qint64 frame_num, qint64 wait = 0);
+    /// @param show Whether to convert the requested frame into image_,
+    ///   false to only position the decoder.
+    void buffer(qint64 frame_num, bool show = true);
+
+    /// Loads a video.
+    ///
+    /// @param filename Path to video.
+    /// @param reload True if the video is loaded again, so it keeps the
+    /// current frame and mediaLoaded is not emitted.
+    void openVideo(const QString &filename, bool reload);
+
+    /// Starts building the frame index in the background.
+    void startIndexer();
 
-    /// Waits for specified time while allowing events to process.
-    void processWait(qint64 usec);
+    /// Stops the background frame index scan, if running.
+    void stopIndexer();
+
+    /// Gets presentation timestamp of a frame.
+    ///
+    /// Uses the container index or frame rate to estimate the timestamp
+    /// if the frame has not been indexed yet.  The container index is
+    /// only used for streams without reordered frames.
+    ///
+    /// @param frame Frame number.
+    /// @return Presentation timestamp.
+    qint64 frameToPts(qint64 frame);
+
+    /// Gets frame number of a presentation timestamp.
+    ///
+    /// Uses the container index or frame rate to estimate the frame if
+    /// the timestamp is past the indexed part of the video.
+    ///
+    /// @param pts Presentation timestamp.
+    /// @return Frame number, or -1 if not found.
+    qint64 ptsToFrame(qint64 pts);
 
     /// Reinitializes the player.
     void reinit();
@@ -0,0 +1,76 @@
+#include "function_thread.h"
+#include "prefetch_pool.h"
+
+namespace tator { namespace video_annotator {
+
+PrefetchPool::PrefetchPool(const FrameIndex &index, int decoders)
+  : index_(index)
+  , decoders_()
+  , threads_()
+  , abort_(false) {
+  for(int i = 0; i < decoders; ++i) {
+    decoders_.emplace_back(new FrameDecoder);
+  }
+}
+
+PrefetchPool::~PrefetchPool() {
+  close();
+}
+
+bool PrefetchPool::open(const QString &filename) {
+  close();
+  for(auto &decoder : decoders_) {
+    if(decoder->open(filename) == false) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PrefetchPool::close() {
+  cancel();
+  for(auto &decoder : decoders_) {
+    decoder->close();
+  }
+}
+
+void PrefetchPool::prefetch(
+    const std::vector<qint64> &targets,
+    qint64 count,
+    FrameDecoder::RawFrameCallback callback) {
+  cancel();
+  const std::size_t num_decoders = decoders_.size();
+  for(std::size_t i = 0; i < num_decoders && i < targets.size(); ++i) {
+    // Decoder i takes targets i, i + num_decoders and so on.
+    std::vector<qint64> assigned;
+    for(std::size_t j = i; j < targets.size(); j += num_decoders) {
+      assigned.push_back(targets[j]);
+    }
+    FrameDecoder *decoder = decoders_[i].get();
+    threads_.emplace_back(new FunctionThread(
+      [this, decoder, assigned, count, callback]() {
+        for(qint64 first : assigned) {
+          qint64 last = first + count - 1;
+          const qint64 size = index_.size();
+          last = last >= size ? size - 1 : last;
+          decoder->decodeRaw(index_, first, last, callback,
+            [this]() { return abort_ == true; });
+          if(abort_ == true) {
+            return;
+          }
+        }
+      }));
+    threads_.back()->start(QThread::LowPriority);
+  }
+}
+
+void PrefetchPool::cancel() {
+  abort_ = true;
+  for(auto &thread : threads_) {
+    thread->wait();
+  }
+  threads_.clear();
+  abort_ = false;
+}
+
+}} // namespace tator::video_annotator
@@ -0,0 +1,76 @@
+/// @file
+/// @brief Defines pool of decoders for warming the frame cache.
+
+#ifndef VIDEO_ANNOTATOR_PREFETCH_POOL_H
+#define VIDEO_ANNOTATOR_PREFETCH_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <QThread>
+
+#include "frame_decoder.h"
+#include "frame_index.h"
+
+namespace tator { namespace video_annotator {
+
+/// Small pool of decoders that decode frames the user is likely to jump
+/// to next.
+///
+/// Each decoder has its own demuxer and codec context and runs on its
+/// own thread, so the targets are decoded in parallel and independently
+/// of the player's decoder.  Decoded frames are passed unconverted to a
+/// callback on the decoder threads.
+class PrefetchPool {
+public:
+  /// Constructor.
+  ///
+  /// @param index Frame index of the video, must outlive this object.
+  /// @param decoders Number of decoders in the pool.
+  PrefetchPool(const FrameIndex &index, int decoders);
+
+  /// Destructor.
+  ~PrefetchPool();
+
+  /// Opens a video with every decoder in the pool.
+  ///
+  /// @param filename Path to video.
+  /// @return True if successful, false otherwise.
+  bool open(const QString &filename);
+
+  /// Cancels any prefetch and closes the video.
+  void close();
+
+  /// Starts decoding runs of frames, cancelling any previous prefetch.
+  ///
+  /// Targets are spread over the decoders in order, so earlier targets
+  /// are ready first.
+  ///
+  /// @param targets First frame of each run, must be in the frame index.
+  /// @param count Number of frames per run.
+  /// @param callback Called on a decoder thread for each decoded frame.
+  void prefetch(
+      const std::vector<qint64> &targets,
+      qint64 count,
+      FrameDecoder::RawFrameCallback callback);
+
+  /// Stops any prefetch and waits for the decoder threads.
+  void cancel();
+private:
+  /// Frame index of the video.
+  const FrameIndex &index_;
+
+  /// Decoders, one per thread.
+  std::vector<std::unique_ptr<FrameDecoder>> decoders_;
+
+  /// Threads of the current prefetch, one per busy decoder.
+  std::vector<std::unique_ptr<QThread>> threads_;
+
+  /// True when prefetch should stop.
+  std::atomic<bool> abort_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_PREFETCH_POOL_H
@@ -0,0 +1,404 @@
+#include <algorithm>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/dict.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "decoder_threads.h"
+#include "proxy_transcoder.h"
+#include "read_ahead_io.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Appended to the video path to get the proxy path.
+  static const char kProxySuffix[] = ".proxy.mkv";
+
+  /// Appended to the proxy path while it is being written.
+  static const char kPartSuffix[] = ".part";
+
+  /// Metadata keys recorded in the proxy.
+  static const char kSizeKey[] = "tator_source_size";
+  static const char kModifiedKey[] = "tator_source_modified";
+  static const char kWidthKey[] = "tator_source_width";
+  static const char kHeightKey[] = "tator_source_height";
+
+  /// Quantizer of MJPEG proxies, lower is better.
+  static const int kMjpegQscale = 3;
+
+  /// Constant rate factor of H.264 proxies, lower is better.
+  static const char kH264Crf[] = "18";
+
+  /// Contexts of a transcode, freed when it ends.
+  struct Transcode {
+    Transcode()
+      : io()
+      , input(nullptr)
+      , decoder(nullptr)
+      , output(nullptr)
+      , encoder(nullptr)
+      , sws(nullptr)
+      , decoded(av_frame_alloc())
+      , scaled(av_frame_alloc())
+      , last_pts(AV_NOPTS_VALUE)
+      , written(0) {
+    }
+
+    ~Transcode() {
+      av_frame_free(&scaled);
+      av_frame_free(&decoded);
+      sws_freeContext(sws);
+      avcodec_free_context(&encoder);
+      if(output != nullptr) {
+        if(output->pb != nullptr) {
+          avio_closep(&output->pb);
+        }
+        avformat_free_context(output);
+      }
+      avcodec_free_context(&decoder);
+      io.closeInput(&input);
+    }
+
+    ReadAheadIO io; ///< Input of the source.
+    AVFormatContext *input; ///< Demuxer of the source.
+    AVCodecContext *decoder; ///< Decoder of the source.
+    AVFormatContext *output; ///< Muxer of the proxy.
+    AVCodecContext *encoder; ///< Encoder of the proxy.
+    SwsContext *sws; ///< Scales decoded frames to the proxy.
+    AVFrame *decoded; ///< Decoded frame.
+    AVFrame *scaled; ///< Frame to encode.
+    qint64 last_pts; ///< Timestamp of the last packet in the proxy.
+    qint64 written; ///< Number of packets written to the proxy.
+  };
+
+  /// Writes all packets the encoder has ready to the output.
+  bool writePackets(Transcode &t) {
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = nullptr;
+    packet.size = 0;
+    AVStream *stream = t.output->streams[0];
+    while(true) {
+      int status = avcodec_receive_packet(t.encoder, &packet);
+      if(status == AVERROR(EAGAIN) || status == AVERROR_EOF) {
+        return true;
+      }
+      if(status < 0) {
+        return false;
+      }
+      av_packet_rescale_ts(&packet, t.encoder->time_base, stream->time_base);
+      if(packet.pts == AV_NOPTS_VALUE) {
+        av_packet_unref(&packet);
+        return false;
+      }
+      // Frames of the proxy are numbered by timestamp, so timestamps
+      // that become equal in the coarser time base of the proxy are
+      // moved apart.  Frames are intra only, so decode order is
+      // presentation order.
+      if(t.last_pts != AV_NOPTS_VALUE && packet.pts <= t.last_pts) {
+        packet.pts = t.last_pts + 1;
+      }
+      packet.dts = packet.pts;
+      t.last_pts = packet.pts;
+      ++t.written;
+      packet.stream_index = stream->index;
+      status = av_interleaved_write_frame(t.output, &packet);
+      av_packet_unref(&packet);
+      if(status < 0) {
+        return false;
+      }
+    }
+  }
+
+  /// Opens the encoder and muxer of the proxy.
+  bool openOutput(
+      Transcode &t,
+      const QString &path,
+      const QString &source_path,
+      const AVStream *source,
+      int width,
+      int height,
+      ProxyCodec codec) {
+    AVCodec *encoder = nullptr;
+    if(codec == kH264IntraProxy) {
+      encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+    if(encoder == nullptr) {
+      encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    }
+    const std::string filename = path.toStdString();
+    // The name ends with the part suffix, so the format is given.
+    avformat_alloc_output_context2(
+        &t.output, nullptr, "matroska", filename.c_str());
+    if(encoder == nullptr || t.output == nullptr) {
+      return false;
+    }
+    AVStream *stream = avformat_new_stream(t.output, nullptr);
+    t.encoder = avcodec_alloc_context3(encoder);
+    if(stream == nullptr || t.encoder == nullptr) {
+      return false;
+    }
+    t.encoder->width = width;
+    t.encoder->height = height;
+    t.encoder->time_base = source->time_base;
+    t.encoder->framerate = source->avg_frame_rate;
+    t.encoder->sample_aspect_ratio = source->codecpar->sample_aspect_ratio;
+    t.encoder->gop_size = 1;
+    t.encoder->max_b_frames = 0;
+    t.encoder->thread_count = 0;
+    if(encoder->id == AV_CODEC_ID_MJPEG) {
+      t.encoder->pix_fmt = AV_PIX_FMT_YUVJ420P;
+      t.encoder->flags |= AV_CODEC_FLAG_QSCALE;
+      t.encoder->global_quality = FF_QP2LAMBDA * kMjpegQscale;
+    }
+    else {
+      t.encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+      av_opt_set(t.encoder->priv_data, "crf", kH264Crf, 0);
+      av_opt_set(t.encoder->priv_data, "preset", "veryfast", 0);
+    }
+    if(t.output->oformat->flags & AVFMT_GLOBALHEADER) {
+      t.encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if(avcodec_open2(t.encoder, encoder, nullptr) < 0 ||
+        avcodec_parameters_from_context(stream->codecpar, t.encoder) < 0) {
+      return false;
+    }
+    stream->time_base = t.encoder->time_base;
+    stream->avg_frame_rate = t.encoder->framerate;
+    // The source is identified by size and modification time, so a
+    // proxy of an older version of the file is not used.
+    QFileInfo info(source_path);
+    av_dict_set(&t.output->metadata, kSizeKey,
+        QByteArray::number(info.size()).constData(), 0);
+    av_dict_set(&t.output->metadata, kModifiedKey,
+        QByteArray::number(info.lastModified().toMSecsSinceEpoch())
+        .constData(), 0);
+    av_dict_set(&t.output->metadata, kWidthKey,
+        QByteArray::number(source->codecpar->width).constData(), 0);
+    av_dict_set(&t.output->metadata, kHeightKey,
+        QByteArray::number(source->codecpar->height).constData(), 0);
+    if(avio_open(&t.output->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0 ||
+        avformat_write_header(t.output, nullptr) < 0) {
+      return false;
+    }
+    t.scaled->format = t.encoder->pix_fmt;
+    t.scaled->width = width;
+    t.scaled->height = height;
+    return av_frame_get_buffer(t.scaled, 32) == 0;
+  }
+
+  /// Scales and encodes the decoded frame.
+  ///
+  /// @param last_pts Timestamp of the previous frame, AV_NOPTS_VALUE for
+  /// none, updated.
+  bool encodeFrame(Transcode &t, qint64 &last_pts) {
+    t.sws = sws_getCachedContext(
+        t.sws,
+        t.decoded->width,
+        t.decoded->height,
+        static_cast<AVPixelFormat>(t.decoded->format),
+        t.scaled->width,
+        t.scaled->height,
+        static_cast<AVPixelFormat>(t.scaled->format),
+        SWS_BICUBIC,
+        nullptr, nullptr, nullptr);
+    if(t.sws == nullptr || av_frame_make_writable(t.scaled) < 0) {
+      return false;
+    }
+    sws_scale(
+        t.sws,
+        t.decoded->data,
+        t.decoded->linesize,
+        0,
+        t.decoded->height,
+        t.scaled->data,
+        t.scaled->linesize);
+    // Timestamps must increase for the encoder, and frames keep their
+    // order either way.
+    qint64 pts = t.decoded->best_effort_timestamp;
+    if(last_pts != AV_NOPTS_VALUE &&
+        (pts == AV_NOPTS_VALUE || pts <= last_pts)) {
+      pts = last_pts + 1;
+    }
+    else if(pts == AV_NOPTS_VALUE) {
+      pts = 0;
+    }
+    t.scaled->pts = pts;
+    last_pts = pts;
+    return
+      avcodec_send_frame(t.encoder, t.scaled) == 0 &&
+      writePackets(t);
+  }
+}
+
+QString proxyPath(const QString &video_path) {
+  return video_path + QString(kProxySuffix);
+}
+
+bool readProxyInfo(const QString &video_path, ProxyInfo &info) {
+  const QString path = proxyPath(video_path);
+  if(QFileInfo::exists(path) == false) {
+    return false;
+  }
+  AVFormatContext *format_context = nullptr;
+  if(avformat_open_input(
+        &format_context,
+        path.toStdString().c_str(),
+        nullptr,
+        nullptr) != 0) {
+    return false;
+  }
+  auto tag = [format_context](const char *key) {
+    AVDictionaryEntry *entry = av_dict_get(
+        format_context->metadata, key, nullptr, 0);
+    return entry == nullptr ? QByteArray() : QByteArray(entry->value);
+  };
+  QFileInfo source(video_path);
+  const bool current =
+    tag(kSizeKey) == QByteArray::number(source.size()) &&
+    tag(kModifiedKey) ==
+      QByteArray::number(source.lastModified().toMSecsSinceEpoch());
+  info.width = tag(kWidthKey).toInt();
+  info.height = tag(kHeightKey).toInt();
+  avformat_close_input(&format_context);
+  return current == true && info.width > 0 && info.height > 0;
+}
+
+ProxyTranscoder::ProxyTranscoder(
+    const QString &filename,
+    int height,
+    ProxyCodec codec)
+  : QObject()
+  , filename_(filename)
+  , height_(height)
+  , codec_(codec)
+  , abort_(false) {
+}
+
+void ProxyTranscoder::abort() {
+  abort_ = true;
+}
+
+void ProxyTranscoder::run() {
+  const QString path = proxyPath(filename_);
+  const QString part = path + QString(kPartSuffix);
+  bool complete = transcode(part);
+  if(complete == true) {
+    QFile::remove(path);
+    complete = QFile::rename(part, path);
+  }
+  if(complete == false) {
+    QFile::remove(part);
+  }
+  emit finished(complete);
+}
+
+bool ProxyTranscoder::transcode(const QString &path) {
+  Transcode t;
+  if(t.io.openInput(&t.input, filename_) != 0 ||
+      avformat_find_stream_info(t.input, nullptr) < 0) {
+    return false;
+  }
+  const int stream_index = av_find_best_stream(
+      t.input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+  if(stream_index < 0) {
+    return false;
+  }
+  AVStream *stream = t.input->streams[stream_index];
+  AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+  if(codec == nullptr) {
+    return false;
+  }
+  t.decoder = avcodec_alloc_context3(codec);
+  if(t.decoder == nullptr ||
+      avcodec_parameters_to_context(t.decoder, stream->codecpar) < 0) {
+    return false;
+  }
+  configureDecoderThreads(t.decoder);
+  if(avcodec_open2(t.decoder, codec, nullptr) < 0) {
+    return false;
+  }
+  // Even dimensions for 4:2:0, keeping the aspect ratio.
+  const int height = std::min(height_, t.decoder->height) & ~1;
+  const int width = static_cast<int>(
+      static_cast<qint64>(t.decoder->width) * height /
+      t.decoder->height + 1) & ~1;
+  if(width <= 0 || height <= 0 ||
+      openOutput(t, path, filename_, stream, width, height, codec_) == false) {
+    return false;
+  }
+  // Frames are numbered by packets with a timestamp, like FrameIndexer
+  // does, and the proxy must have exactly one frame with a distinct
+  // timestamp for each.
+  qint64 expected = stream->nb_frames;
+  if(expected <= 0) {
+    expected = static_cast<qint64>(
+        t.input->duration * av_q2d(stream->avg_frame_rate) / AV_TIME_BASE);
+  }
+  qint64 packets = 0;
+  qint64 frames = 0;
+  qint64 last_pts = AV_NOPTS_VALUE;
+  int percent = -1;
+  AVPacket packet;
+  av_init_packet(&packet);
+  packet.data = nullptr;
+  packet.size = 0;
+  bool ok = true;
+  bool end_of_input = false;
+  while(ok == true && abort_ == false && end_of_input == false) {
+    av_packet_unref(&packet);
+    if(av_read_frame(t.input, &packet) < 0) {
+      // Flush the frames the decoder holds back.
+      end_of_input = true;
+      ok = avcodec_send_packet(t.decoder, nullptr) == 0;
+    }
+    else if(packet.stream_index != stream_index) {
+      continue;
+    }
+    else {
+      if(packet.pts != AV_NOPTS_VALUE || packet.dts != AV_NOPTS_VALUE) {
+        ++packets;
+      }
+      ok = avcodec_send_packet(t.decoder, &packet) == 0;
+    }
+    int status = 0;
+    while(ok == true &&
+        (status = avcodec_receive_frame(t.decoder, t.decoded)) == 0) {
+      ok = encodeFrame(t, last_pts);
+      ++frames;
+    }
+    ok = ok && (status == AVERROR(EAGAIN) || status == AVERROR_EOF);
+    if(expected > 0) {
+      const int now = static_cast<int>(
+          std::min<qint64>(100, frames * 100 / expected));
+      if(now != percent) {
+        percent = now;
+        emit progress(percent);
+      }
+    }
+  }
+  av_packet_unref(&packet);
+  ok = ok &&
+    abort_ == false &&
+    frames == packets &&
+    avcodec_send_frame(t.encoder, nullptr) == 0 &&
+    writePackets(t) &&
+    t.written == packets &&
+    av_write_trailer(t.output) == 0;
+  return ok;
+}
+
+#include "moc_proxy_transcoder.cpp"
+
+}} // namespace tator::video_annotator
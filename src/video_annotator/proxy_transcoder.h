@@ -0,0 +1,93 @@
+/// @file
+/// @brief Defines class for transcoding a video into an all-intra proxy.
+
+#ifndef VIDEO_ANNOTATOR_PROXY_TRANSCODER_H
+#define VIDEO_ANNOTATOR_PROXY_TRANSCODER_H
+
+#include <atomic>
+
+#include <QObject>
+#include <QString>
+
+namespace tator { namespace video_annotator {
+
+/// Codec of a proxy.
+enum ProxyCodec {
+  kMjpegProxy, ///< Motion JPEG, always available.
+  kH264IntraProxy ///< H.264 with every frame a keyframe, needs libx264.
+};
+
+/// Properties of the source video recorded in its proxy.
+struct ProxyInfo {
+  int width; ///< Width of the source video.
+  int height; ///< Height of the source video.
+};
+
+/// Returns the path of the proxy of a video, next to the video.
+///
+/// @param video_path Path to video.
+QString proxyPath(const QString &video_path);
+
+/// Reads the properties recorded in the proxy of a video.
+///
+/// @param video_path Path to video.
+/// @param info Receives the properties.
+/// @return True if the video has a proxy made from its current contents.
+bool readProxyInfo(const QString &video_path, ProxyInfo &info);
+
+/// Transcodes a video into a proxy where every frame is a keyframe, so
+/// that seeking anywhere costs a single frame decode.
+///
+/// The proxy has one frame for every frame of the source, in the same
+/// order, so frame numbers and annotations are the same for both.  A
+/// proxy that would not match is discarded.  Intended to be moved to its
+/// own low priority thread like ThumbnailGenerator.
+class ProxyTranscoder : public QObject {
+  Q_OBJECT
+public:
+  /// Constructor.
+  ///
+  /// @param filename Path to video.
+  /// @param height Height of the proxy, not more than the source height.
+  /// @param codec Codec of the proxy, MJPEG if the codec is unavailable.
+  ProxyTranscoder(const QString &filename, int height, ProxyCodec codec);
+
+  /// Requests that a running job stop as soon as possible.
+  void abort();
+public slots:
+  /// Transcodes the video.
+  void run();
+signals:
+  /// Emitted when the completed percentage changes.
+  ///
+  /// @param percent Percentage of the source transcoded.
+  void progress(int percent);
+
+  /// Emitted when the job ends.
+  ///
+  /// @param complete True if the proxy was written, false if the job was
+  ///   aborted or failed.
+  void finished(bool complete);
+private:
+  /// Transcodes the video to a file.
+  ///
+  /// @param path Path of the output.
+  /// @return True if the whole video was transcoded frame for frame.
+  bool transcode(const QString &path);
+
+  /// Path to video.
+  QString filename_;
+
+  /// Height of the proxy.
+  int height_;
+
+  /// Codec of the proxy.
+  ProxyCodec codec_;
+
+  /// True when job should stop.
+  std::atomic<bool> abort_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_PROXY_TRANSCODER_H
@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <QFileInfo>
+
+#include "function_thread.h"
+#include "read_ahead_io.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Size of the buffer between the demuxer and this input.
+  static const int kBufferSize = 64 * 1024;
+
+  /// Size of a block read from the source.
+  static const qint64 kBlockSize = 1024 * 1024;
+
+  /// Number of blocks kept, including blocks being read.
+  static const size_t kCacheBlocks = 16;
+
+  /// Number of blocks read ahead of a sequential reader.
+  static const qint64 kReadAheadBlocks = 8;
+
+  /// Number of reader threads, and so of reads in flight.
+  static const int kReaders = 4;
+}
+
+ReadAheadIO::ReadAheadIO()
+  : source_()
+  , context_(nullptr)
+  , position_(0)
+  , read_ahead_(false)
+  , mutex_()
+  , queued_()
+  , fetched_()
+  , blocks_()
+  , queue_()
+  , last_block_(-1)
+  , use_counter_(0)
+  , stalls_(0)
+  , stop_(false)
+  , readers_() {
+}
+
+ReadAheadIO::~ReadAheadIO() {
+  close();
+}
+
+int ReadAheadIO::openInput(
+    AVFormatContext **format_context,
+    const QString &filename) {
+  close();
+  QFileInfo info(filename);
+  bool opened = false;
+  if(info.isFile() == true) {
+    const bool remote =
+      isRemotePath(info.absoluteFilePath()) == true ||
+      simulatedLatency() > 0;
+    std::unique_ptr<BlockSource> source;
+    if(remote == false) {
+      MappedSource *mapped = new MappedSource;
+      source.reset(mapped);
+      if(mapped->open(filename) == false) {
+        source.reset();
+      }
+    }
+    if(source == nullptr) {
+      FileSource *file = new FileSource;
+      source.reset(file);
+      if(file->open(filename) == false) {
+        source.reset();
+      }
+    }
+    if(source != nullptr && simulatedLatency() > 0) {
+      source.reset(new LatencySource(std::move(source), simulatedLatency()));
+    }
+    opened = source != nullptr && open(std::move(source), remote);
+  }
+  if(opened == true) {
+    if(*format_context == nullptr) {
+      *format_context = avformat_alloc_context();
+    }
+    (*format_context)->pb = context_;
+    (*format_context)->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+  const int status = avformat_open_input(
+      format_context,
+      filename.toStdString().c_str(),
+      nullptr,
+      nullptr);
+  if(status != 0) {
+    // The format context is freed on failure, but custom input is not.
+    close();
+  }
+  return status;
+}
+
+void ReadAheadIO::closeInput(AVFormatContext **format_context) {
+  if(*format_context != nullptr) {
+    avformat_close_input(format_context);
+  }
+  close();
+}
+
+bool ReadAheadIO::open(std::unique_ptr<BlockSource> source, bool read_ahead) {
+  close();
+  unsigned char *buffer = static_cast<unsigned char*>(av_malloc(kBufferSize));
+  if(buffer == nullptr) {
+    return false;
+  }
+  context_ = avio_alloc_context(
+      buffer,
+      kBufferSize,
+      0,
+      this,
+      &ReadAheadIO::readPacket,
+      nullptr,
+      &ReadAheadIO::seek);
+  if(context_ == nullptr) {
+    av_free(buffer);
+    return false;
+  }
+  source_ = std::move(source);
+  position_ = 0;
+  read_ahead_ = read_ahead;
+  last_block_ = -1;
+  use_counter_ = 0;
+  stalls_ = 0;
+  stop_ = false;
+  if(read_ahead_ == true) {
+    for(int i = 0; i < kReaders; ++i) {
+      readers_.emplace_back(new FunctionThread([this]() {
+        readerLoop();
+      }));
+      readers_.back()->start();
+    }
+  }
+  return true;
+}
+
+void ReadAheadIO::close() {
+  {
+    QMutexLocker locker(&mutex_);
+    stop_ = true;
+    queued_.wakeAll();
+  }
+  for(auto &reader : readers_) {
+    reader->wait();
+  }
+  readers_.clear();
+  if(context_ != nullptr) {
+    // The demuxer may have replaced the buffer, so free the current one.
+    av_freep(&context_->buffer);
+    avio_context_free(&context_);
+  }
+  source_.reset();
+  blocks_.clear();
+  queue_.clear();
+}
+
+AVIOContext *ReadAheadIO::context() {
+  return context_;
+}
+
+qint64 ReadAheadIO::stalls() const {
+  QMutexLocker locker(&mutex_);
+  return stalls_;
+}
+
+int ReadAheadIO::readPacket(void *opaque, uint8_t *buffer, int size) {
+  ReadAheadIO *io = static_cast<ReadAheadIO*>(opaque);
+  if(io->position_ >= io->source_->size()) {
+    return AVERROR_EOF;
+  }
+  int count = 0;
+  if(io->read_ahead_ == true) {
+    count = io->readCached(buffer, size);
+  }
+  else {
+    const qint64 read = io->source_->read(
+        io->position_, reinterpret_cast<char*>(buffer), size);
+    count = read < 0 ? AVERROR(EIO) : static_cast<int>(read);
+  }
+  if(count > 0) {
+    io->position_ += count;
+  }
+  return count == 0 ? AVERROR_EOF : count;
+}
+
+int64_t ReadAheadIO::seek(void *opaque, int64_t offset, int whence) {
+  ReadAheadIO *io = static_cast<ReadAheadIO*>(opaque);
+  const qint64 size = io->source_->size();
+  qint64 position = 0;
+  switch(whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+      return size;
+    case SEEK_SET:
+      position = offset;
+      break;
+    case SEEK_CUR:
+      position = io->position_ + offset;
+      break;
+    case SEEK_END:
+      position = size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+  if(position < 0) {
+    return AVERROR(EINVAL);
+  }
+  io->position_ = position;
+  return position;
+}
+
+int ReadAheadIO::readCached(uint8_t *buffer, int size) {
+  const qint64 block = position_ / kBlockSize;
+  const qint64 offset = position_ % kBlockSize;
+  const bool sequential = block == last_block_ || block == last_block_ + 1;
+  QMutexLocker locker(&mutex_);
+  auto it = blocks_.find(block);
+  if(it == blocks_.end() || it->second.ready == false) {
+    if(sequential == false) {
+      // Blocks queued for the old position are no longer needed.
+      for(qint64 queued : queue_) {
+        blocks_.erase(queued);
+      }
+      queue_.clear();
+    }
+    request(block, true);
+    ++stalls_;
+    it = blocks_.find(block);
+    while(it->second.ready == false) {
+      fetched_.wait(&mutex_);
+    }
+  }
+  Block &entry = it->second;
+  if(entry.failed == true) {
+    blocks_.erase(it);
+    return AVERROR(EIO);
+  }
+  entry.last_use = ++use_counter_;
+  const qint64 count = std::min<qint64>(size, entry.data.size() - offset);
+  if(count > 0) {
+    std::memcpy(buffer, entry.data.constData() + offset, count);
+  }
+  if(block != last_block_) {
+    readAhead(block);
+    last_block_ = block;
+  }
+  return count > 0 ? static_cast<int>(count) : 0;
+}
+
+void ReadAheadIO::readAhead(qint64 block) {
+  // After a jump only the next block is read, so seeking around does not
+  // flood the source with reads that are thrown away.
+  const bool sequential = block == last_block_ + 1;
+  const qint64 ahead = sequential ? kReadAheadBlocks : 1;
+  const qint64 last = (source_->size() - 1) / kBlockSize;
+  for(qint64 next = block + 1; next <= block + ahead && next <= last; ++next) {
+    request(next, false);
+  }
+}
+
+void ReadAheadIO::request(qint64 block, bool urgent) {
+  auto it = blocks_.find(block);
+  if(it != blocks_.end()) {
+    auto queued = std::find(queue_.begin(), queue_.end(), block);
+    if(urgent == true && queued != queue_.end()) {
+      queue_.erase(queued);
+      queue_.push_front(block);
+    }
+    return;
+  }
+  Block entry;
+  entry.ready = false;
+  entry.failed = false;
+  entry.last_use = ++use_counter_;
+  blocks_.emplace(block, entry);
+  if(urgent == true) {
+    queue_.push_front(block);
+  }
+  else {
+    queue_.push_back(block);
+  }
+  evict();
+  queued_.wakeOne();
+}
+
+void ReadAheadIO::evict() {
+  while(blocks_.size() > kCacheBlocks) {
+    auto oldest = blocks_.end();
+    for(auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+      if(it->second.ready == true &&
+          (oldest == blocks_.end() ||
+           it->second.last_use < oldest->second.last_use)) {
+        oldest = it;
+      }
+    }
+    if(oldest == blocks_.end()) {
+      break;
+    }
+    blocks_.erase(oldest);
+  }
+}
+
+void ReadAheadIO::readerLoop() {
+  QMutexLocker locker(&mutex_);
+  while(stop_ == false) {
+    if(queue_.empty() == true) {
+      queued_.wait(&mutex_);
+      continue;
+    }
+    const qint64 block = queue_.front();
+    queue_.pop_front();
+    const qint64 start = block * kBlockSize;
+    const qint64 length = std::min(kBlockSize, source_->size() - start);
+    locker.unlock();
+    QByteArray data(static_cast<int>(length), Qt::Uninitialized);
+    const qint64 count = source_->read(start, data.data(), length);
+    locker.relock();
+    auto it = blocks_.find(block);
+    if(it != blocks_.end()) {
+      it->second.data = data;
+      it->second.ready = true;
+      it->second.failed = count != length;
+    }
+    fetched_.wakeAll();
+  }
+}
+
+}} // namespace tator::video_annotator
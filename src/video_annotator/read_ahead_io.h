@@ -0,0 +1,165 @@
+/// @file
+/// @brief Defines demuxer input with asynchronous read-ahead.
+
+#ifndef VIDEO_ANNOTATOR_READ_AHEAD_IO_H
+#define VIDEO_ANNOTATOR_READ_AHEAD_IO_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+extern "C" {
+#include <libavutil/attributes.h>
+#undef attribute_deprecated
+#define attribute_deprecated
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+}
+
+#include "block_source.h"
+
+namespace tator { namespace video_annotator {
+
+/// Custom demuxer input that reads a video through a block source.
+///
+/// Local files are read straight from a memory mapping.  Files on
+/// network mounts are read in large blocks by a few reader threads that
+/// stay ahead of the demuxer while it reads sequentially, and recently
+/// used blocks are cached so seeking back and forth near the playhead
+/// does not go back to the network.
+class ReadAheadIO {
+public:
+  /// Constructor.
+  ReadAheadIO();
+
+  /// Destructor.
+  ~ReadAheadIO();
+
+  /// Opens a format context on a video.
+  ///
+  /// Chooses the source for where the video lives and falls back to
+  /// FFmpeg's own input for anything that is not a plain file.
+  ///
+  /// @param format_context Receives the opened context, may hold a
+  /// context from avformat_alloc_context.
+  /// @param filename Path to video.
+  /// @return Result of avformat_open_input.
+  int openInput(AVFormatContext **format_context, const QString &filename);
+
+  /// Closes a format context opened with openInput, then this input.
+  ///
+  /// @param format_context Context to close, set to null.
+  void closeInput(AVFormatContext **format_context);
+
+  /// Opens a source.
+  ///
+  /// @param source Source to read.
+  /// @param read_ahead True to read ahead and cache blocks, false to
+  /// pass every read straight to the source.
+  /// @return True if successful, false otherwise.
+  bool open(std::unique_ptr<BlockSource> source, bool read_ahead);
+
+  /// Stops the reader threads and closes the source.
+  void close();
+
+  /// Returns the context to set as the pb of a format context.
+  AVIOContext *context();
+
+  /// Returns the number of reads that waited for a block.
+  qint64 stalls() const;
+private:
+  /// Block of the source.
+  struct Block {
+    QByteArray data; ///< Contents, empty until read.
+    bool ready; ///< True once read.
+    bool failed; ///< True if the read failed.
+    quint64 last_use; ///< Use counter value of the last read.
+  };
+
+  /// Reads from the current position, called by the demuxer.
+  static int readPacket(void *opaque, uint8_t *buffer, int size);
+
+  /// Moves the current position, called by the demuxer.
+  static int64_t seek(void *opaque, int64_t offset, int whence);
+
+  /// Copies bytes of the block at the current position, waiting for it
+  /// if needed.
+  int readCached(uint8_t *buffer, int size);
+
+  /// Queues blocks after the current one while reading sequentially.
+  ///
+  /// Must be called with mutex_ held.
+  void readAhead(qint64 block);
+
+  /// Queues a block unless it is cached or queued already.
+  ///
+  /// Must be called with mutex_ held.
+  ///
+  /// @param block Block number.
+  /// @param urgent True to read it before any other queued block.
+  void request(qint64 block, bool urgent);
+
+  /// Drops least recently used blocks beyond the cache capacity.
+  ///
+  /// Must be called with mutex_ held.
+  void evict();
+
+  /// Reads queued blocks until stopped, run by each reader thread.
+  void readerLoop();
+
+  /// Source of bytes.
+  std::unique_ptr<BlockSource> source_;
+
+  /// Demuxer input.
+  AVIOContext *context_;
+
+  /// Current position.
+  qint64 position_;
+
+  /// True if blocks are read ahead and cached.
+  bool read_ahead_;
+
+  /// Guards blocks_, queue_, stop_ and the statistics.
+  mutable QMutex mutex_;
+
+  /// Wakes reader threads when blocks are queued.
+  QWaitCondition queued_;
+
+  /// Wakes the demuxer when a block is read.
+  QWaitCondition fetched_;
+
+  /// Cached and pending blocks by block number.
+  std::map<qint64, Block> blocks_;
+
+  /// Blocks waiting for a reader, most urgent first.
+  std::deque<qint64> queue_;
+
+  /// Last block read by the demuxer.
+  qint64 last_block_;
+
+  /// Incremented on every read for least recently used eviction.
+  quint64 use_counter_;
+
+  /// Number of reads that waited for a block.
+  qint64 stalls_;
+
+  /// True when reader threads should exit.
+  bool stop_;
+
+  /// Reader threads.
+  std::vector<std::unique_ptr<QThread>> readers_;
+
+  ReadAheadIO(const ReadAheadIO&) = delete;
+  ReadAheadIO& operator=(const ReadAheadIO&) = delete;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_READ_AHEAD_IO_H
@@ -0,0 +1,57 @@
+#include <QThread>
+
+#include "frame_decoder.h"
+#include "thumbnail_generator.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Width of thumbnails.
+  static const int kThumbnailWidth = 160;
+
+  /// Pause between thumbnails, so the job yields to interactive decoding.
+  static const unsigned long kPauseMsec = 10;
+}
+
+ThumbnailGenerator::ThumbnailGenerator(
+    const QString &filename,
+    double interval,
+    ThumbnailStrip *strip)
+  : QObject()
+  , filename_(filename)
+  , interval_(interval)
+  , strip_(strip)
+  , abort_(false) {
+}
+
+void ThumbnailGenerator::abort() {
+  abort_ = true;
+}
+
+void ThumbnailGenerator::run() {
+  strip_->reset(interval_);
+  FrameDecoder decoder;
+  bool complete = false;
+  if(decoder.open(filename_, FrameDecoder::kBackgroundScrubMode) == true) {
+    const double duration = decoder.duration();
+    complete = duration > 0.0;
+    for(double time = 0.0; time < duration; time += interval_) {
+      QImage image;
+      qint64 keyframe_pts = 0;
+      if(abort_ == true ||
+          decoder.decodeKeyframe(
+            decoder.timeToPts(time), image, keyframe_pts) == false) {
+        complete = false;
+        break;
+      }
+      strip_->append(image.scaledToWidth(
+            kThumbnailWidth, Qt::SmoothTransformation));
+      QThread::msleep(kPauseMsec);
+    }
+  }
+  emit finished(complete);
+}
+
+#include "moc_thumbnail_generator.cpp"
+
+}} // namespace tator::video_annotator
@@ -0,0 +1,62 @@
+/// @file
+/// @brief Defines class for building a thumbnail strip in the background.
+
+#ifndef VIDEO_ANNOTATOR_THUMBNAIL_GENERATOR_H
+#define VIDEO_ANNOTATOR_THUMBNAIL_GENERATOR_H
+
+#include <atomic>
+
+#include <QObject>
+#include <QString>
+
+#include "thumbnail_strip.h"
+
+namespace tator { namespace video_annotator {
+
+/// Decodes one keyframe per interval of a video into a thumbnail strip.
+///
+/// Intended to be moved to its own low priority thread.  It opens its
+/// own single threaded decoder in background scrub mode, so it only
+/// decodes keyframes at reduced resolution and leaves the cores to
+/// interactive decoding.
+class ThumbnailGenerator : public QObject {
+  Q_OBJECT
+public:
+  /// Constructor.
+  ///
+  /// @param filename Path to video.
+  /// @param interval Time between thumbnails in seconds.
+  /// @param strip Strip to be filled, must outlive this object.
+  ThumbnailGenerator(
+      const QString &filename,
+      double interval,
+      ThumbnailStrip *strip);
+
+  /// Requests that a running job stop as soon as possible.
+  void abort();
+public slots:
+  /// Generates the thumbnails.
+  void run();
+signals:
+  /// Emitted when the job ends.
+  ///
+  /// @param complete True if the whole video was sampled, false if the
+  ///   job was aborted or failed.
+  void finished(bool complete);
+private:
+  /// Path to video.
+  QString filename_;
+
+  /// Time between thumbnails in seconds.
+  double interval_;
+
+  /// Strip to be filled.
+  ThumbnailStrip *strip_;
+
+  /// True when job should stop.
+  std::atomic<bool> abort_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_THUMBNAIL_GENERATOR_H
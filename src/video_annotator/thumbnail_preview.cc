@@ -0,0 +1,112 @@
+#include <QEvent>
+#include <QMouseEvent>
+#include <QStyle>
+
+#include "thumbnail_preview.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Time between thumbnails in seconds.
+  static const double kThumbnailInterval = 5.0;
+
+  /// Gap between the popup and the slider in pixels.
+  static const int kPopupMargin = 4;
+}
+
+ThumbnailPreview::ThumbnailPreview(QSlider *slider)
+  : QObject()
+  , slider_(slider)
+  , cache_path_()
+  , frame_rate_(0.0)
+  , strip_()
+  , generator_(nullptr)
+  , generator_thread_(nullptr)
+  , popup_(new QLabel(nullptr, Qt::ToolTip)) {
+  slider_->setMouseTracking(true);
+  slider_->installEventFilter(this);
+}
+
+ThumbnailPreview::~ThumbnailPreview() {
+  slider_->removeEventFilter(this);
+  stopGenerator();
+}
+
+void ThumbnailPreview::load(const QString &video_path, double frame_rate) {
+  stopGenerator();
+  popup_->hide();
+  frame_rate_ = frame_rate;
+  cache_path_ = ThumbnailStrip::cachePath(video_path);
+  if(strip_.load(cache_path_) == true) {
+    return;
+  }
+  strip_.reset(kThumbnailInterval);
+  generator_ = new ThumbnailGenerator(video_path, kThumbnailInterval, &strip_);
+  generator_thread_ = new QThread();
+  generator_->moveToThread(generator_thread_);
+  QObject::connect(generator_thread_, &QThread::started,
+      generator_, &ThumbnailGenerator::run);
+  QObject::connect(generator_, &ThumbnailGenerator::finished,
+      this, &ThumbnailPreview::handleGeneratorFinished);
+  generator_thread_->start(QThread::IdlePriority);
+}
+
+bool ThumbnailPreview::eventFilter(QObject *watched, QEvent *event) {
+  if(watched != slider_) {
+    return false;
+  }
+  if(event->type() == QEvent::MouseMove && slider_->isSliderDown() == false) {
+    QMouseEvent *mouse_event = static_cast<QMouseEvent*>(event);
+    const int value = QStyle::sliderValueFromPosition(
+        slider_->minimum(),
+        slider_->maximum(),
+        mouse_event->pos().x(),
+        slider_->width());
+    QImage thumbnail;
+    if(frame_rate_ > 0.0) {
+      thumbnail = strip_.at(value / frame_rate_);
+    }
+    if(thumbnail.isNull() == true) {
+      popup_->hide();
+      return false;
+    }
+    popup_->setPixmap(QPixmap::fromImage(thumbnail));
+    popup_->resize(thumbnail.size());
+    popup_->move(slider_->mapToGlobal(QPoint(
+            mouse_event->pos().x() - thumbnail.width() / 2,
+            -thumbnail.height() - kPopupMargin)));
+    popup_->show();
+  }
+  else if(event->type() == QEvent::Leave ||
+      event->type() == QEvent::MouseButtonPress) {
+    popup_->hide();
+  }
+  return false;
+}
+
+void ThumbnailPreview::handleGeneratorFinished(bool complete) {
+  // Ignore jobs that finished after another video was loaded.
+  if(generator_ == nullptr || sender() != generator_) {
+    return;
+  }
+  stopGenerator();
+  if(complete == true) {
+    strip_.save(cache_path_);
+  }
+}
+
+void ThumbnailPreview::stopGenerator() {
+  if(generator_ != nullptr) {
+    generator_->abort();
+    generator_thread_->quit();
+    generator_thread_->wait();
+    delete generator_;
+    delete generator_thread_;
+    generator_ = nullptr;
+    generator_thread_ = nullptr;
+  }
+}
+
+#include "moc_thumbnail_preview.cpp"
+
+}} // namespace tator::video_annotator
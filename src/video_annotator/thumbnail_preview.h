@@ -0,0 +1,77 @@
+/// @file
+/// @brief Defines class for showing thumbnails while hovering a slider.
+
+#ifndef VIDEO_ANNOTATOR_THUMBNAIL_PREVIEW_H
+#define VIDEO_ANNOTATOR_THUMBNAIL_PREVIEW_H
+
+#include <memory>
+
+#include <QLabel>
+#include <QObject>
+#include <QSlider>
+#include <QThread>
+
+#include "thumbnail_generator.h"
+#include "thumbnail_strip.h"
+
+namespace tator { namespace video_annotator {
+
+/// Shows a thumbnail of the video above a slider while hovering it.
+///
+/// Thumbnails are loaded from the cache if available, otherwise they are
+/// generated on a background thread at the lowest priority and saved to
+/// the cache when complete.  Previews are available for the generated
+/// part of the video while generation runs.
+class ThumbnailPreview : public QObject {
+  Q_OBJECT
+public:
+  /// Constructor.
+  ///
+  /// @param slider Slider over frame numbers, must outlive this object.
+  explicit ThumbnailPreview(QSlider *slider);
+
+  /// Destructor.
+  ~ThumbnailPreview();
+
+  /// Loads or starts generating thumbnails for a video.
+  ///
+  /// @param video_path Path to video.
+  /// @param frame_rate Frame rate used to convert slider values to time.
+  void load(const QString &video_path, double frame_rate);
+protected:
+  /// Shows, moves or hides the preview according to slider mouse events.
+  bool eventFilter(QObject *watched, QEvent *event) override;
+private slots:
+  /// Saves thumbnails once generation is complete.
+  ///
+  /// @param complete True if the whole video was sampled.
+  void handleGeneratorFinished(bool complete);
+private:
+  /// Slider the preview is shown over.
+  QSlider *slider_;
+
+  /// Path to thumbnail cache for loaded video.
+  QString cache_path_;
+
+  /// Frame rate of loaded video.
+  double frame_rate_;
+
+  /// Thumbnails of loaded video.
+  ThumbnailStrip strip_;
+
+  /// Generates thumbnails, nullptr if not running.
+  ThumbnailGenerator *generator_;
+
+  /// Thread for generator_.
+  QThread *generator_thread_;
+
+  /// Popup showing the thumbnail.
+  std::unique_ptr<QLabel> popup_;
+
+  /// Stops generating thumbnails and waits for the thread to exit.
+  void stopGenerator();
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_THUMBNAIL_PREVIEW_H
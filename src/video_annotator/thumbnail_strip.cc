@@ -0,0 +1,168 @@
+#include <cstring>
+
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <QSaveFile>
+
+#include "frame_index.h"
+#include "thumbnail_strip.h"
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Identifies a thumbnail cache file.
+  static const char kMagic[4] = {'T', 'T', 'H', 'M'};
+
+  /// Version of the file layout.
+  static const quint32 kVersion = 1;
+
+  /// Number of thumbnails per row of the sprite.
+  static const int kColumns = 16;
+
+  /// JPEG quality of the sprite.
+  static const int kQuality = 80;
+
+  /// Header at the start of a thumbnail cache file, followed by the
+  /// sprite encoded as JPEG.
+  struct FileHeader {
+    char magic[4]; ///< Always kMagic.
+    quint32 version; ///< Always kVersion.
+    double interval; ///< Time between thumbnails in seconds.
+    qint32 count; ///< Number of thumbnails.
+    qint32 columns; ///< Number of thumbnails per sprite row.
+    qint32 width; ///< Thumbnail width.
+    qint32 height; ///< Thumbnail height.
+  };
+}
+
+ThumbnailStrip::ThumbnailStrip()
+  : lock_()
+  , interval_(1.0)
+  , thumbnails_() {
+}
+
+void ThumbnailStrip::reset(double interval) {
+  QWriteLocker locker(&lock_);
+  interval_ = interval;
+  thumbnails_.clear();
+}
+
+void ThumbnailStrip::append(const QImage &thumbnail) {
+  QWriteLocker locker(&lock_);
+  thumbnails_.push_back(thumbnail);
+}
+
+int ThumbnailStrip::size() const {
+  QReadLocker locker(&lock_);
+  return static_cast<int>(thumbnails_.size());
+}
+
+QImage ThumbnailStrip::at(double seconds) const {
+  QReadLocker locker(&lock_);
+  if(thumbnails_.empty()) {
+    return QImage();
+  }
+  int index = static_cast<int>(seconds / interval_);
+  index = index < 0 ? 0 : index;
+  if(index >= static_cast<int>(thumbnails_.size())) {
+    index = static_cast<int>(thumbnails_.size()) - 1;
+  }
+  return thumbnails_[index];
+}
+
+bool ThumbnailStrip::save(const QString &path) const {
+  QReadLocker locker(&lock_);
+  if(thumbnails_.empty()) {
+    return false;
+  }
+  const int count = static_cast<int>(thumbnails_.size());
+  const int width = thumbnails_.front().width();
+  const int height = thumbnails_.front().height();
+  const int columns = count < kColumns ? count : kColumns;
+  const int rows = (count + columns - 1) / columns;
+  QImage sprite(columns * width, rows * height, QImage::Format_RGB32);
+  sprite.fill(Qt::black);
+  QPainter painter(&sprite);
+  for(int i = 0; i < count; ++i) {
+    painter.drawImage(
+        (i % columns) * width,
+        (i / columns) * height,
+        thumbnails_[i]);
+  }
+  painter.end();
+  QByteArray jpeg;
+  QBuffer buffer(&jpeg);
+  buffer.open(QIODevice::WriteOnly);
+  if(sprite.save(&buffer, "JPG", kQuality) == false) {
+    return false;
+  }
+  QDir().mkpath(QFileInfo(path).absolutePath());
+  QSaveFile file(path);
+  if(file.open(QIODevice::WriteOnly) == false) {
+    return false;
+  }
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.interval = interval_;
+  header.count = count;
+  header.columns = columns;
+  header.width = width;
+  header.height = height;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(jpeg);
+  return file.commit();
+}
+
+bool ThumbnailStrip::load(const QString &path) {
+  QFile file(path);
+  if(file.open(QIODevice::ReadOnly) == false) {
+    return false;
+  }
+  FileHeader header;
+  if(file.read(reinterpret_cast<char*>(&header), sizeof(header)) !=
+      static_cast<qint64>(sizeof(header))) {
+    return false;
+  }
+  if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      header.interval <= 0.0 ||
+      header.count <= 0 ||
+      header.columns <= 0 ||
+      header.width <= 0 ||
+      header.height <= 0) {
+    return false;
+  }
+  QImage sprite;
+  if(sprite.loadFromData(file.readAll(), "JPG") == false) {
+    return false;
+  }
+  const int rows = (header.count + header.columns - 1) / header.columns;
+  if(sprite.width() != header.columns * header.width ||
+      sprite.height() != rows * header.height) {
+    return false;
+  }
+  std::vector<QImage> thumbnails;
+  thumbnails.reserve(header.count);
+  for(int i = 0; i < header.count; ++i) {
+    thumbnails.push_back(sprite.copy(
+        (i % header.columns) * header.width,
+        (i / header.columns) * header.height,
+        header.width,
+        header.height));
+  }
+  QWriteLocker locker(&lock_);
+  interval_ = header.interval;
+  thumbnails_.swap(thumbnails);
+  return true;
+}
+
+QString ThumbnailStrip::cachePath(const QString &video_path) {
+  QString path = FrameIndex::cachePath(video_path);
+  return path.left(path.lastIndexOf('.')) + QStringLiteral(".thm");
+}
+
+}} // namespace tator::video_annotator
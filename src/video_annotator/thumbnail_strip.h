@@ -0,0 +1,73 @@
+/// @file
+/// @brief Defines class for storing thumbnails sampled along a video.
+
+#ifndef VIDEO_ANNOTATOR_THUMBNAIL_STRIP_H
+#define VIDEO_ANNOTATOR_THUMBNAIL_STRIP_H
+
+#include <vector>
+
+#include <QImage>
+#include <QReadWriteLock>
+#include <QString>
+
+namespace tator { namespace video_annotator {
+
+/// Thumbnails taken at a fixed time interval along a video.
+///
+/// Thumbnail i shows the keyframe at or before i times the interval.
+/// Thumbnails may be appended on one thread while they are read on
+/// another.  On disk, all thumbnails are stored as a single JPEG sprite
+/// next to the frame index cache.
+class ThumbnailStrip {
+public:
+  /// Constructor.
+  ThumbnailStrip();
+
+  /// Removes all thumbnails and sets the interval for new ones.
+  ///
+  /// @param interval Time between thumbnails in seconds.
+  void reset(double interval);
+
+  /// Appends a thumbnail.
+  ///
+  /// @param thumbnail Thumbnail for the next interval.
+  void append(const QImage &thumbnail);
+
+  /// Returns the number of thumbnails.
+  int size() const;
+
+  /// Returns the thumbnail nearest to a time, null image if empty.
+  ///
+  /// @param seconds Time from start of video.
+  QImage at(double seconds) const;
+
+  /// Saves thumbnails to a file.
+  ///
+  /// @param path Path to file.
+  /// @return True if successful, false otherwise.
+  bool save(const QString &path) const;
+
+  /// Loads thumbnails from a file.
+  ///
+  /// @param path Path to file.
+  /// @return True if successful, false otherwise.
+  bool load(const QString &path);
+
+  /// Returns path of the thumbnail cache for a video.
+  ///
+  /// @param video_path Path to video.
+  static QString cachePath(const QString &video_path);
+private:
+  /// Guards all other members.
+  mutable QReadWriteLock lock_;
+
+  /// Time between thumbnails in seconds.
+  double interval_;
+
+  /// Thumbnails in time order.
+  std::vector<QImage> thumbnails_;
+};
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_THUMBNAIL_STRIP_H
@@ -1,10 +1,21 @@
-#include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <set>
+
 #include <boost/algorithm/string.hpp>
 
+#include <QFile>
+#include <QSaveFile>
 #include <QProgressDialog>
 #include <QMessageBox>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 
 #include "video_annotation.h"
+#include "json_reader.h"
+#include "json_writer.h"
 
 namespace tator { namespace video_annotator {
 
@@ -19,6 +30,126 @@ namespace {
       {kIgnore, "ignore"},
       {kEntering, "entering"},
       {kExiting, "exiting"}});
+
+  /// Approximate size of the detections parsed by one task.
+  static const std::ptrdiff_t kChunkBytes = 1 << 20;
+
+  /// Number of annotations saved between progress updates.
+  static const int kProgressStep = 1 << 16;
+
+  /// Required fields of a detection.
+  static const char *kRequiredDetectionFields[] = {
+    "frame", "id", "x", "y", "w", "h"};
+
+  /// Starts reading an array, which property tree writes as an empty
+  /// string when it has no elements.
+  ///
+  /// @param reader Reader positioned at the array.
+  /// @param empty Set to true if the array is an empty string.
+  /// @return True if successful, false if the JSON is invalid.
+  bool beginArrayOrEmpty(JsonReader &reader, bool &empty) {
+    empty = false;
+    if(reader.peek() == '"') {
+      std::string value;
+      empty = reader.readString(value) == true && value.empty() == true;
+      return empty;
+    }
+    return reader.beginArray();
+  }
+
+  /// Maps a file to parse it in place, or reads it if it cannot be
+  /// mapped.
+  ///
+  /// @param file Open file.
+  /// @param contents Receives the contents if the file is not mapped.
+  /// @param begin Receives the start of the contents.
+  /// @param end Receives the end of the contents.
+  void mapContents(
+      QFile &file,
+      QByteArray &contents,
+      const char *&begin,
+      const char *&end) {
+    uchar *mapped = file.size() > 0 ? file.map(0, file.size()) : nullptr;
+    if(mapped != nullptr) {
+      begin = reinterpret_cast<const char*>(mapped);
+      end = begin + file.size();
+    }
+    else {
+      contents = file.readAll();
+      begin = contents.constData();
+      end = begin + contents.size();
+    }
+  }
+
+  /// Elements of a detections array parsed by one task.
+  struct DetectionChunk {
+    /// Constructor.
+    ///
+    /// @param begin Start of the first element.
+    /// @param end End of the last element.
+    /// @param legacy True for the legacy format.
+    DetectionChunk(const char *begin, const char *end, bool legacy)
+      : begin(begin)
+      , end(end)
+      , legacy(legacy)
+      , detections()
+      , missing()
+      , ok(false)
+      , done() {
+    }
+
+    const char *begin; ///< Start of the first element.
+    const char *end; ///< End of the last element.
+    bool legacy; ///< True for the legacy format.
+    std::vector<DetectionAnnotation> detections; ///< Parsed detections.
+    std::string missing; ///< A missing required field, if any.
+    bool ok; ///< True if the elements are valid.
+    QSemaphore done; ///< Released when parsed.
+  };
+
+  /// Parses a chunk on the thread pool.
+  class DetectionChunkTask : public QRunnable {
+  public:
+    explicit DetectionChunkTask(DetectionChunk *chunk)
+      : chunk_(chunk) {
+    }
+
+    void run() override {
+      JsonReader reader(chunk_->begin, chunk_->end);
+      reader.resumeArray();
+      std::string name;
+      std::string missing;
+      bool valid = true;
+      while(valid == true && reader.nextElement() == true) {
+        DetectionAnnotation annotation;
+        if(chunk_->legacy == true) {
+          // Legacy elements hold the detection in an annotation field.
+          bool found = false;
+          reader.beginObject();
+          while(reader.nextMember(name) == true) {
+            if(name == "annotation" && found == false) {
+              found = annotation.read(reader, missing);
+            }
+            else {
+              reader.skipValue();
+            }
+          }
+          valid = found;
+        }
+        else {
+          annotation.read(reader, missing);
+        }
+        if(missing.empty() == false && chunk_->missing.empty() == true) {
+          chunk_->missing = missing;
+        }
+        chunk_->detections.push_back(std::move(annotation));
+      }
+      chunk_->ok = valid == true && reader.failed() == false;
+      chunk_->done.release();
+    }
+  private:
+    DetectionChunk *chunk_;
+  };
 } // namespace
 
 namespace fs = boost::filesystem;
@@ -88,6 +219,31 @@ pt::ptree DetectionAnnotation::write() const {
   return tree;
 }
 
+void DetectionAnnotation::write(JsonWriter &writer) const {
+  writer.beginObject();
+  writer.name("frame"); writer.writeUInt(frame_);
+  writer.name("id"); writer.writeUInt(id_);
+  writer.name("x"); writer.writeInt(area_.x);
+  writer.name("y"); writer.writeInt(area_.y);
+  writer.name("w"); writer.writeInt(area_.w);
+  writer.name("h"); writer.writeInt(area_.h);
+  writer.name("type");
+  switch(type_) {
+    case kBox:
+      writer.writeString("box");
+      break;
+    case kLine:
+      writer.writeString("line");
+      break;
+    case kDot:
+      writer.writeString("dot");
+      break;
+  }
+  writer.name("species"); writer.writeString(species_);
+  writer.name("prob"); writer.writeDouble(prob_);
+  writer.endObject();
+}
+
 void DetectionAnnotation::read(const pt::ptree &tree) {
   getRequired(tree, "frame", frame_);
   getRequired(tree, "id", id_);
@@ -122,6 +278,66 @@ void DetectionAnnotation::read(const pt::ptree &tree) {
   }
 }
 
+bool DetectionAnnotation::read(JsonReader &reader, std::string &missing) {
+  bool found[6] = {false, false, false, false, false, false};
+  type_ = kBox; // default
+  species_ = ""; // default
+  prob_ = 0.0; // default
+  if(reader.beginObject() == false) return false;
+  std::string name;
+  std::string type_str;
+  while(reader.nextMember(name) == true) {
+    if(name == "frame") {
+      found[0] = reader.readUInt(frame_);
+    }
+    else if(name == "id") {
+      found[1] = reader.readUInt(id_);
+    }
+    else if(name == "x") {
+      found[2] = reader.readInt(area_.x);
+    }
+    else if(name == "y") {
+      found[3] = reader.readInt(area_.y);
+    }
+    else if(name == "w") {
+      found[4] = reader.readInt(area_.w);
+    }
+    else if(name == "h") {
+      found[5] = reader.readInt(area_.h);
+    }
+    else if(name == "type") {
+      reader.readText(type_str);
+      if(type_str == "box") {
+        type_ = kBox;
+      }
+      else if(type_str == "line") {
+        type_ = kLine;
+      }
+      else if(type_str == "dot") {
+        type_ = kDot;
+      }
+    }
+    else if(name == "species") {
+      reader.readText(species_);
+      boost::algorithm::to_lower(species_);
+    }
+    else if(name == "prob") {
+      reader.readDouble(prob_);
+    }
+    else {
+      reader.skipValue();
+    }
+  }
+  if(reader.failed() == true) return false;
+  for(int i = 0; i < 6; ++i) {
+    if(found[i] == false) {
+      missing = kRequiredDetectionFields[i];
+      break;
+    }
+  }
+  return true;
+}
+
 TrackAnnotation::TrackAnnotation(
   uint64_t id,
   const std::string &species,
@@ -172,6 +388,17 @@ pt::ptree TrackAnnotation::write() const {
   return tree;
 }
 
+void TrackAnnotation::write(JsonWriter &writer) const {
+  writer.beginObject();
+  writer.name("id"); writer.writeUInt(id_);
+  writer.name("species"); writer.writeString(species_);
+  writer.name("subspecies"); writer.writeString(subspecies_);
+  writer.name("frame_added"); writer.writeUInt(frame_added_);
+  writer.name("count_label");
+  writer.writeString(count_label_map.left.at(count_label_));
+  writer.endObject();
+}
+
 void TrackAnnotation::read(const pt::ptree &tree) {
   std::string count_label_str;
   getRequired(tree, "id", id_);
@@ -229,14 +456,17 @@ void TrackAnnotation::read_csv(const std::string &csv_row) {
 }
 
 VideoAnnotation::VideoAnnotation()
-  : detection_list_()
-  , track_list_()
-  , detections_by_frame_()
-  , detections_by_id_()
+  : track_list_()
+  , detections_()
   , tracks_by_id_()
   , tracks_by_species_()
   , tracks_by_frame_added_()
-  , video_length_(0) {
+  , video_length_(0)
+  , file_(nullptr)
+  , loaded_blocks_()
+  , file_tracks_()
+  , file_source_()
+  , incomplete_(false) {
 }
 
 void VideoAnnotation::setVideoLength(uint64_t video_length) {
@@ -244,10 +474,8 @@ void VideoAnnotation::setVideoLength(uint64_t video_length) {
 }
 
 void VideoAnnotation::insert(std::shared_ptr<DetectionAnnotation> annotation) {
-  remove(annotation->frame_, annotation->id_);
-  detection_list_.push_front(annotation);
-  detections_by_frame_.insert({annotation->frame_, detection_list_.begin()});
-  detections_by_id_.insert({annotation->id_, detection_list_.begin()});
+  loadFrames(annotation->frame_, annotation->frame_);
+  detections_.insert(*annotation);
 }
 
 void VideoAnnotation::insert(std::shared_ptr<TrackAnnotation> annotation) {
@@ -260,16 +488,8 @@ void VideoAnnotation::insert(std::shared_ptr<TrackAnnotation> annotation) {
 }
 
 void VideoAnnotation::remove(uint64_t frame, uint64_t id) {
-  auto range = detections_by_frame_.left.equal_range(frame);
-  for(auto it = range.first; it != range.second; ++it) {
-    if((*(it->second))->id_ == id) {
-      detection_list_.erase(it->second);
-      detections_by_id_.right.erase(
-        detections_by_id_.right.find(it->second));
-      detections_by_frame_.left.erase(it);
-      break;
-    }
-  }
+  loadFrames(frame, frame);
+  detections_.remove(frame, id);
 }
 
 void VideoAnnotation::remove(uint64_t id) {
@@ -282,13 +502,8 @@ void VideoAnnotation::remove(uint64_t id) {
           it->second));
     break;
   }
-  auto drange = detections_by_id_.left.equal_range(id);
-  for(auto it = drange.first; it != drange.second; ++it) {
-    detection_list_.erase(it->second);
-    detections_by_frame_.right.erase(
-      detections_by_frame_.right.find(it->second));
-  }
-  detections_by_id_.left.erase(drange.first, drange.second);
+  loadTrack(id);
+  detections_.removeTrack(id);
 }
 
 uint64_t VideoAnnotation::nextId() {
@@ -303,22 +518,15 @@ uint64_t VideoAnnotation::nextId() {
 
 std::vector<std::shared_ptr<DetectionAnnotation>>
 VideoAnnotation::getDetectionAnnotationsByFrame(uint64_t frame) {
-  std::vector<std::shared_ptr<DetectionAnnotation>> annotations;
-  auto range = detections_by_frame_.left.equal_range(frame);
-  for(auto it = range.first; it != range.second; ++it) {
-    annotations.push_back(*(it->second));
-  }
-  return annotations;
+  loadFrames(frame, frame);
+  return detections_.byFrame(frame);
 }
 
 std::vector<std::shared_ptr<DetectionAnnotation>>
-VideoAnnotation::getDetectionAnnotationsById(uint64_t id) {
-  std::vector<std::shared_ptr<DetectionAnnotation>> annotations;
-  auto range = detections_by_id_.left.equal_range(id);
-  for(auto it = range.first; it != range.second; ++it) {
-    annotations.push_back(*(it->second));
-  }
-  return annotations;
+VideoAnnotation::getDetectionAnnotationsById(uint64_t id, uint64_t start,
+  uint64_t stop) {
+  loadTrack(id, start, stop);
+  return detections_.byTrack(id, start, stop);
 }
 
 std::map<std::string, uint64_t> VideoAnnotation::getCounts(uint64_t start, 
@@ -376,23 +584,22 @@ uint64_t VideoAnnotation::getTotal() {
 
 void VideoAnnotation::clear() {
   track_list_.clear();
-  detections_by_frame_.clear();
-  detections_by_id_.clear();
+  detections_.clear();
   tracks_by_id_.clear();
   tracks_by_species_.clear();
   tracks_by_frame_added_.clear();
   global_states_.clear();
+  file_.reset();
+  loaded_blocks_.clear();
+  file_tracks_.clear();
+  file_source_.clear();
+  incomplete_ = false;
 }
 
 std::shared_ptr<DetectionAnnotation>
 VideoAnnotation::findDetection(uint64_t frame, uint64_t id) {
-  auto range = detections_by_frame_.left.equal_range(frame);
-  for(auto it = range.first; it != range.second; ++it) {
-    if((*(it->second))->id_ == id) {
-      return *(it->second);
-    }
-  }
-  return std::shared_ptr<DetectionAnnotation>(nullptr);
+  loadFrames(frame, frame);
+  return detections_.find(frame, id);
 }
 
 std::shared_ptr<TrackAnnotation> VideoAnnotation::findTrack(uint64_t id) {
@@ -432,37 +639,28 @@ std::shared_ptr<TrackAnnotation> VideoAnnotation::prevTrack(uint64_t id) {
 }
 
 uint64_t VideoAnnotation::trackFirstFrame(uint64_t id) {
-  auto it = tracks_by_id_.left.find(id);
-  if(it != tracks_by_id_.left.end()) {
-    auto t = *(it->second);
-    auto first_det = std::find_if(
-      detections_by_frame_.left.begin(),
-      detections_by_frame_.left.end(),
-      [&t](const DetectionsByInteger::left_value_type &d) {
-        return t->id_ == (*(d.second))->id_;
-      });
-    if(first_det != detections_by_frame_.left.end()) {
-      return first_det->first;
-    }
+  uint64_t first = 0;
+  uint64_t last = 0;
+  if(tracks_by_id_.left.find(id) != tracks_by_id_.left.end()) {
+    loadTrack(id);
+    detections_.trackFrames(id, first, last);
   }
-  return 0;
+  return first;
 }
 
 uint64_t VideoAnnotation::trackLastFrame(uint64_t id) {
-  auto it = tracks_by_id_.left.find(id);
-  if(it != tracks_by_id_.left.end()) {
-    auto t = *(it->second);
-    auto last_det = std::find_if(
-      detections_by_frame_.left.rbegin(), 
-      detections_by_frame_.left.rend(),
-      [&t](const DetectionsByInteger::left_value_type &d) {
-        return t->id_ == (*(d.second))->id_;
-      });
-    if(last_det != detections_by_frame_.left.rend()) {
-      return last_det->first;
-    }
+  uint64_t first = 0;
+  uint64_t last = 0;
+  if(tracks_by_id_.left.find(id) != tracks_by_id_.left.end()) {
+    loadTrack(id);
+    detections_.trackFrames(id, first, last);
   }
-  return 0;
+  return last;
+}
+
+uint64_t VideoAnnotation::trackDetectionCount(uint64_t id) {
+  loadTrack(id);
+  return detections_.trackSize(id);
 }
 
 uint64_t VideoAnnotation::earliestTrackID() {
@@ -508,6 +706,8 @@ VideoAnnotation::getGlobalStateAnnotation(const uint64_t frame) {
 }
 
 bool VideoAnnotation::operator==(VideoAnnotation &rhs) {
+  loadAll();
+  rhs.loadAll();
   if(track_list_.size() != rhs.track_list_.size()) return false;
   auto it = tracks_by_id_.left.begin();
   auto it_rhs = rhs.tracks_by_id_.left.begin();
@@ -517,16 +717,7 @@ bool VideoAnnotation::operator==(VideoAnnotation &rhs) {
     ++it, ++it_rhs) {
     if(**(it->second) != **(it_rhs->second)) return false;
   }
-  if(detection_list_.size() != rhs.detection_list_.size()) return false;
-  auto dit = detections_by_frame_.left.begin();
-  auto dit_rhs = rhs.detections_by_frame_.left.begin();
-  for(;
-    dit != detections_by_frame_.left.end() &&
-    dit_rhs != rhs.detections_by_frame_.left.end();
-    ++dit, ++dit_rhs) {
-    if(**(dit->second) != **(dit_rhs->second)) return false;
-  }
-  return true;
+  return detections_ == rhs.detections_;
 }
 
 bool VideoAnnotation::operator!=(VideoAnnotation &rhs) {
@@ -541,61 +732,112 @@ void VideoAnnotation::write(
     const std::string &tow_type,
     double fps,
     bool with_csv) const {
+  loadAll();
+  if(incomplete_ == true) {
+    QMessageBox err;
+    err.setText("Annotations were not saved because some of them could"
+        " not be loaded!");
+    err.exec();
+    return;
+  }
   std::unique_ptr<QProgressDialog> dlg(new QProgressDialog(
     "Saving annotations...", 
     "Abort", 
     0,
-    static_cast<int>(track_list_.size() + detection_list_.size()),
+    static_cast<int>(track_list_.size() + detections_.size()),
     nullptr,
     Qt::Window | Qt::WindowTitleHint | Qt::CustomizeWindowHint));
   dlg->setCancelButton(0);
   dlg->setWindowTitle("Save Annotations");
   dlg->setMinimumDuration(10);
   int iter = 0;
-  // csv file
-  if(with_csv == true) {
-    fs::path csv_path(json_path);
-    csv_path.replace_extension(".csv");
-    std::string meta;
-    meta += trip_id; meta += ",";
-    meta += tow_number; meta += ",";
-    meta += reviewer; meta += ",";
-    meta += tow_type;
-    std::ofstream csv(csv_path.string());
-    csv << "Trip_ID,Tow_Number,Reviewer,Tow_Type,";
-    csv << "Track_Number,Track_Type,Species,Frame,Time_In_Video";
-    csv << std::endl;
-    for(const auto &t : tracks_by_id_.left) {
-      csv << meta;
-      csv << (*(t.second))->write_csv(fps);
-      csv << std::endl;
+  auto progress = [&]() {
+    if(++iter % kProgressStep == 0) {
+      dlg->setValue(iter);
     }
+  };
+  // Both files are written to temporary files, then renamed over the
+  // old files once complete.
+  fs::path csv_path(json_path);
+  csv_path.replace_extension(".csv");
+  QSaveFile json(QString::fromStdString(json_path.string()));
+  QSaveFile csv(QString::fromStdString(csv_path.string()));
+  bool ok = json.open(QIODevice::WriteOnly | QIODevice::Text);
+  if(ok == true && with_csv == true) {
+    ok = csv.open(QIODevice::WriteOnly | QIODevice::Text);
+  }
+  if(ok == false) {
+    QMessageBox err;
+    err.setText(QString("Could not open %1 for writing!").arg(
+          json.isOpen() ? csv.fileName() : json.fileName()));
+    err.exec();
+    return;
+  }
+  // csv file, written along with the tracks
+  std::string meta;
+  meta += trip_id; meta += ",";
+  meta += tow_number; meta += ",";
+  meta += reviewer; meta += ",";
+  meta += tow_type;
+  if(with_csv == true) {
+    csv.write("Trip_ID,Tow_Number,Reviewer,Tow_Type,"
+        "Track_Number,Track_Type,Species,Frame,Time_In_Video\n");
   }
   // json file
-  pt::ptree tree;
-  pt::ptree tracks;
-  pt::ptree detections;
-  pt::ptree global_state;
+  JsonWriter writer(&json);
+  writer.beginObject();
+  writer.name("tracks");
+  writer.beginArray();
   for(const auto &t : tracks_by_id_.left) {
-    tracks.push_back(std::make_pair("", (*(t.second))->write()));
-    dlg->setValue(++iter);
-    if(dlg->wasCanceled()) break;
-  }
-  for(const auto &d : detections_by_frame_.left) {
-    detections.push_back(std::make_pair("", (*(d.second))->write()));
-    dlg->setValue(++iter);
-    if(dlg->wasCanceled()) break;
+    const TrackAnnotation &track = **(t.second);
+    track.write(writer);
+    if(with_csv == true) {
+      std::string row(meta);
+      row += track.write_csv(fps);
+      row += "\n";
+      csv.write(row.data(), static_cast<qint64>(row.size()));
+    }
+    progress();
   }
+  writer.endArray();
+  writer.name("detections");
+  writer.beginArray();
+  detections_.forEach([&](const DetectionAnnotation &d) -> bool {
+    d.write(writer);
+    progress();
+    return true;
+  });
+  writer.endArray();
+  writer.name("global_state");
+  writer.beginArray();
   for(const auto &g : global_states_) {
-    pt::ptree elem;
-    elem.put("frame", g.first);
-    elem.add_child("states", g.second.write());
-    global_state.push_back(std::make_pair("", elem));
-  } 
-  tree.add_child("tracks", tracks);
-  tree.add_child("detections", detections);
-  tree.add_child("global_state", global_state);
-  pt::write_json(json_path.string(), tree);
+    writer.beginObject();
+    writer.name("frame");
+    writer.writeUInt(g.first);
+    writer.name("states");
+    writer.writeTree(g.second.write());
+    writer.endObject();
+  }
+  writer.endArray();
+  writer.endObject();
+  ok = writer.finish();
+  if(ok == true && with_csv == true) {
+    ok = csv.commit();
+  }
+  if(ok == true) {
+    ok = json.commit();
+  }
+  if(ok == false) {
+    QMessageBox err;
+    err.setText(QString("Could not write %1!").arg(json.fileName()));
+    err.exec();
+    return;
+  }
+  // Reopening the file just saved reads this copy instead.
+  writeFile(
+      AnnotationFile::cachePath(json.fileName()),
+      json.fileName(),
+      global_states_);
 }
 
 void VideoAnnotation::read(const boost::filesystem::path &json_path) {
@@ -606,103 +848,414 @@ void VideoAnnotation::read(const boost::filesystem::path &json_path) {
           json_path.string() +
           std::string("!")).c_str());
     err.exec();
+    return;
   }
-  else {
-    pt::ptree tree;
-    pt::read_json(json_path.string(), tree);
-    auto it_trk = tree.find("tracks");
-    auto it_det = tree.find("detections");
-    auto it_gst = tree.find("global_state");
-    if(it_trk == tree.not_found() ||
-        it_det == tree.not_found() ||
-        it_gst == tree.not_found()) {
-      auto it = tree.find("Annotation Array");
-      if(it == tree.not_found()) {
-        // Neither legacy nor new format
-        QMessageBox err;
-        err.setText("Invalid file format! File must be valid JSON and"
-            " contain top level tracks, detections, and global_state"
-            " fields.");
-        err.exec();
-      }
-      else {
-        // Legacy format
-        fs::path csv_path(json_path);
-        csv_path.replace_extension(".csv");
-        std::ifstream f(csv_path.string());
-        int num_lines = std::count(
-            std::istreambuf_iterator<char>(f),
-            std::istreambuf_iterator<char>(),
-            '\n');
-        f.close();
-        std::unique_ptr<QProgressDialog> dlg(new QProgressDialog(
-          "Loading annotations...", 
-          "Abort", 
-          0,
-          2 * num_lines,
-          nullptr,
-          Qt::Window | Qt::WindowTitleHint | Qt::CustomizeWindowHint));
-        dlg->setCancelButton(0);
-        dlg->setWindowTitle("Load Annotations");
-        dlg->setMinimumDuration(10);
-        // Track file
-        int iter = 0;
-        std::ifstream csv(csv_path.string());
-        std::string line;
-        std::getline(csv, line);
-        for(; std::getline(csv, line);) {
-          auto trk = std::make_shared<TrackAnnotation>();
-          trk->read_csv(line);
-          insert(trk);
-          dlg->setValue(++iter);
-          if(dlg->wasCanceled()) break;
-        }
-        // Detections
-        for(auto &val : tree.get_child("Annotation Array")) {
-          auto annotation = std::make_shared<DetectionAnnotation>();
-          annotation->read(val.second.get_child("annotation"));
-          insert(annotation);
-          if(dlg->wasCanceled()) break;
-        }
-        dlg->setValue(2 * num_lines);
-      }
+  const QString json_file = QString::fromStdString(json_path.string());
+  // Read the binary copy in the cache instead, unless the file changed.
+  const QString cache_path = AnnotationFile::cachePath(json_file);
+  std::unique_ptr<AnnotationFile> cached(new AnnotationFile);
+  if(cached->open(cache_path) == true &&
+      cached->isStale(json_file) == false &&
+      readFile(std::move(cached), json_file) == true) {
+    return;
+  }
+  cached.reset();
+  // Annotations that were already loaded are only cached with the file
+  // if there were none.
+  loadAll();
+  const bool cache = track_list_.empty() == true && detections_.size() == 0;
+  QFile file(json_file);
+  if(file.open(QIODevice::ReadOnly) == false) {
+    QMessageBox err;
+    err.setText(QString("Could not open %1!").arg(file.fileName()));
+    err.exec();
+    return;
+  }
+  // The file is parsed in place, mapped if possible.
+  QByteArray contents;
+  const char *begin = nullptr;
+  const char *end = nullptr;
+  mapContents(file, contents, begin, end);
+  // Find the top level fields, skipping over their values.
+  const char *tracks = nullptr;
+  const char *detections = nullptr;
+  const char *global_state = nullptr;
+  const char *legacy = nullptr;
+  JsonReader reader(begin, end);
+  std::string name;
+  if(reader.beginObject() == true) {
+    while(reader.nextMember(name) == true) {
+      if(name == "tracks") tracks = reader.position();
+      else if(name == "detections") detections = reader.position();
+      else if(name == "global_state") global_state = reader.position();
+      else if(name == "Annotation Array") legacy = reader.position();
+      reader.skipValue();
+    }
+  }
+  bool ok = reader.failed() == false;
+  if(ok == true &&
+      (tracks == nullptr || detections == nullptr || global_state == nullptr)) {
+    if(legacy == nullptr) {
+      // Neither legacy nor new format
+      ok = false;
     }
     else {
+      // Legacy format
+      fs::path csv_path(json_path);
+      csv_path.replace_extension(".csv");
+      std::ifstream f(csv_path.string());
+      int num_lines = std::count(
+          std::istreambuf_iterator<char>(f),
+          std::istreambuf_iterator<char>(),
+          '\n');
+      f.close();
       std::unique_ptr<QProgressDialog> dlg(new QProgressDialog(
         "Loading annotations...", 
         "Abort", 
         0,
-        -1,
+        2 * num_lines,
         nullptr,
         Qt::Window | Qt::WindowTitleHint | Qt::CustomizeWindowHint));
       dlg->setCancelButton(0);
       dlg->setWindowTitle("Load Annotations");
       dlg->setMinimumDuration(10);
-      // New format
-      for(auto &trk : tree.get_child("tracks")) {
-        auto track = std::make_shared<TrackAnnotation>();
-        track->read(trk.second.get_child(""));
-        boundFrame(track->frame_added_);
-        insert(track);
+      // Track file
+      int iter = 0;
+      std::ifstream csv(csv_path.string());
+      std::string line;
+      std::getline(csv, line);
+      for(; std::getline(csv, line);) {
+        auto trk = std::make_shared<TrackAnnotation>();
+        trk->read_csv(line);
+        insert(trk);
+        dlg->setValue(++iter);
+        if(dlg->wasCanceled()) break;
       }
-      for(auto &det : tree.get_child("detections")) {
-        auto detection = std::make_shared<DetectionAnnotation>();
-        detection->read(det.second.get_child(""));
-        boundFrame(detection->frame_);
-        insert(detection);
+      // Detections
+      ok = readDetections(legacy, end, true);
+      dlg->setValue(2 * num_lines);
+    }
+  }
+  else if(ok == true) {
+    std::unique_ptr<QProgressDialog> dlg(new QProgressDialog(
+      "Loading annotations...", 
+      "Abort", 
+      0,
+      -1,
+      nullptr,
+      Qt::Window | Qt::WindowTitleHint | Qt::CustomizeWindowHint));
+    dlg->setCancelButton(0);
+    dlg->setWindowTitle("Load Annotations");
+    dlg->setMinimumDuration(10);
+    // New format
+    std::map<uint64_t, GlobalStateAnnotation> states;
+    ok = readTracks(tracks, end) &&
+      readDetections(detections, end, false) &&
+      readGlobalStates(global_state, end, states);
+    if(ok == true && cache == true) {
+      writeFile(cache_path, json_file, states);
+    }
+  }
+  if(ok == false) {
+    QMessageBox err;
+    err.setText("Invalid file format! File must be valid JSON and"
+        " contain top level tracks, detections, and global_state"
+        " fields.");
+    err.exec();
+  }
+}
+
+bool VideoAnnotation::readTracks(const char *begin, const char *end) {
+  JsonReader reader(begin, end);
+  bool empty = false;
+  if(beginArrayOrEmpty(reader, empty) == false) return false;
+  if(empty == true) return true;
+  while(reader.nextElement() == true) {
+    pt::ptree tree;
+    if(reader.readTree(tree) == false) return false;
+    auto track = std::make_shared<TrackAnnotation>();
+    track->read(tree);
+    boundFrame(track->frame_added_);
+    insert(track);
+  }
+  return reader.failed() == false;
+}
+
+bool VideoAnnotation::readDetections(
+    const char *begin,
+    const char *end,
+    bool legacy,
+    const std::function<bool(uint64_t)> &keep) const {
+  JsonReader reader(begin, end);
+  bool empty = false;
+  if(beginArrayOrEmpty(reader, empty) == false) return false;
+  if(empty == true) return true;
+  // Split the array into chunks of whole elements.
+  std::vector<std::unique_ptr<DetectionChunk>> chunks;
+  const char *chunk_begin = nullptr;
+  while(reader.nextElement() == true) {
+    if(chunk_begin == nullptr) {
+      chunk_begin = reader.position();
+    }
+    if(reader.skipValue() == false) return false;
+    if(reader.position() - chunk_begin >= kChunkBytes) {
+      chunks.emplace_back(
+          new DetectionChunk(chunk_begin, reader.position(), legacy));
+      chunk_begin = nullptr;
+    }
+  }
+  if(reader.failed() == true) return false;
+  if(chunk_begin != nullptr) {
+    chunks.emplace_back(
+        new DetectionChunk(chunk_begin, reader.position(), legacy));
+  }
+  // Keep a few chunks per thread in flight and insert them in order.
+  QThreadPool *pool = QThreadPool::globalInstance();
+  const std::size_t window =
+    2 * static_cast<std::size_t>(std::max(pool->maxThreadCount(), 1));
+  std::size_t started = 0;
+  for(; started < std::min(window, chunks.size()); ++started) {
+    pool->start(new DetectionChunkTask(chunks[started].get()));
+  }
+  std::set<std::string> reported;
+  std::size_t current = 0;
+  std::size_t index = 0;
+  bool acquired = false;
+  bool ok = true;
+  detections_.insert([&](DetectionAnnotation &annotation) -> bool {
+    while(current < chunks.size()) {
+      DetectionChunk &chunk = *chunks[current];
+      if(acquired == false) {
+        chunk.done.acquire();
+        acquired = true;
+        if(chunk.missing.empty() == false &&
+            reported.insert(chunk.missing).second == true) {
+          QMessageBox err;
+          err.setText(QString("Could not find required field %1.  A "
+                "default value will be used instead.")
+              .arg(chunk.missing.c_str()));
+          err.exec();
+        }
+        if(chunk.ok == false) {
+          ok = false;
+          return false;
+        }
       }
-      for(auto &gst : tree.get_child("global_state")) {
-        GlobalStateAnnotation state;
-        auto frame = gst.second.get_child("").get<uint64_t>("frame");
-        boundFrame(frame);
-        state.read(gst.second.get_child("").get_child("states"));
-        insertGlobalStateAnnotation(frame, state);
+      if(index < chunk.detections.size()) {
+        annotation = std::move(chunk.detections[index++]);
+        if(legacy == false) {
+          boundFrame(annotation.frame_);
+        }
+        if(keep && keep(annotation.frame_) == false) {
+          continue;
+        }
+        return true;
       }
+      std::vector<DetectionAnnotation>().swap(chunk.detections);
+      ++current;
+      index = 0;
+      acquired = false;
+      if(started < chunks.size()) {
+        pool->start(new DetectionChunkTask(chunks[started++].get()));
+      }
+    }
+    return false;
+  });
+  // After an error, wait for chunks still being parsed.
+  for(std::size_t i = current + 1; i < started; ++i) {
+    chunks[i]->done.acquire();
+  }
+  return ok;
+}
+
+bool VideoAnnotation::readGlobalStates(
+    const char *begin,
+    const char *end,
+    std::map<uint64_t, GlobalStateAnnotation> &states) {
+  JsonReader reader(begin, end);
+  bool empty = false;
+  if(beginArrayOrEmpty(reader, empty) == false) return false;
+  if(empty == true) return true;
+  while(reader.nextElement() == true) {
+    pt::ptree tree;
+    if(reader.readTree(tree) == false) return false;
+    GlobalStateAnnotation state;
+    auto frame = tree.get<uint64_t>("frame");
+    boundFrame(frame);
+    state.read(tree.get_child("states"));
+    insertGlobalStateAnnotation(frame, state);
+    states[frame] = state;
+  }
+  return reader.failed() == false;
+}
+
+bool VideoAnnotation::readFile(
+    std::unique_ptr<AnnotationFile> file,
+    const QString &json_path) {
+  std::vector<AnnotationFile::Track> tracks;
+  std::map<uint64_t, GlobalStateAnnotation> states;
+  if(file->readTracks(tracks) == false ||
+      file->readGlobalStates(states) == false) {
+    return false;
+  }
+  // Detections of a previous file are loaded before they can be
+  // replaced by those of this one.
+  loadAll();
+  for(auto &track : tracks) {
+    if(track.annotation != nullptr) {
+      boundFrame(track.annotation->frame_added_);
+      insert(track.annotation);
+    }
+    if(track.count > 0) {
+      file_tracks_[track.id] = std::make_pair(track.first, track.last);
     }
   }
+  for(auto &state : states) {
+    uint64_t frame = state.first;
+    boundFrame(frame);
+    insertGlobalStateAnnotation(frame, state.second);
+  }
+  if(file->blockCount() > 0) {
+    loaded_blocks_.assign(file->blockCount(), false);
+    file_ = std::move(file);
+    file_source_ = json_path;
+  }
+  return true;
+}
+
+bool VideoAnnotation::writeFile(
+    const QString &path,
+    const QString &json_path,
+    const std::map<uint64_t, GlobalStateAnnotation> &states) const {
+  loadAll();
+  if(incomplete_ == true) {
+    return false;
+  }
+  std::vector<const TrackAnnotation*> tracks;
+  tracks.reserve(tracks_by_id_.size());
+  for(const auto &t : tracks_by_id_.left) {
+    tracks.push_back(t.second->get());
+  }
+  return AnnotationFile::save(path, json_path, tracks, detections_, states);
+}
+
+void VideoAnnotation::loadFrames(uint64_t first, uint64_t last) const {
+  if(file_ == nullptr) {
+    return;
+  }
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  file_->findBlocks(first, last, begin, end);
+  std::vector<std::size_t> blocks;
+  for(std::size_t block = begin; block < end; ++block) {
+    if(loaded_blocks_[block] == false) {
+      loaded_blocks_[block] = true;
+      blocks.push_back(block);
+    }
+  }
+  if(blocks.empty() == true) {
+    return;
+  }
+  // Blocks are decoded one at a time as they are inserted.  Nothing is
+  // inserted from a block that fails to decode.
+  std::vector<DetectionAnnotation> decoded;
+  std::vector<std::pair<uint64_t, uint64_t>> failed;
+  std::size_t next = 0;
+  std::size_t index = 0;
+  detections_.insert([&](DetectionAnnotation &annotation) -> bool {
+    while(index == decoded.size()) {
+      if(next == blocks.size()) {
+        return false;
+      }
+      decoded.clear();
+      index = 0;
+      const std::size_t block = blocks[next++];
+      if(file_->readBlock(block, decoded) == false) {
+        decoded.clear();
+        failed.emplace_back();
+        file_->blockFrames(block, failed.back().first, failed.back().second);
+      }
+    }
+    annotation = std::move(decoded[index++]);
+    boundFrame(annotation.frame_);
+    return true;
+  });
+  if(failed.empty() == false) {
+    // A damaged cache is dropped, so the json file is parsed next time.
+    if(file_source_.isEmpty() == false) {
+      QFile::remove(AnnotationFile::cachePath(file_source_));
+    }
+    if(reloadFrames(failed) == false) {
+      incomplete_ = true;
+      QMessageBox err;
+      err.setText("Some annotations could not be loaded and will not be"
+          " saved!  Open the annotation file again to load them.");
+      err.exec();
+    }
+  }
+  if(std::find(loaded_blocks_.begin(), loaded_blocks_.end(), false) ==
+      loaded_blocks_.end()) {
+    file_.reset();
+    loaded_blocks_.clear();
+    file_tracks_.clear();
+    file_source_.clear();
+  }
+}
+
+bool VideoAnnotation::reloadFrames(
+    const std::vector<std::pair<uint64_t, uint64_t>> &ranges) const {
+  if(file_source_.isEmpty() == true ||
+      file_->isStale(file_source_) == true) {
+    return false;
+  }
+  QFile file(file_source_);
+  if(file.open(QIODevice::ReadOnly) == false) {
+    return false;
+  }
+  QByteArray contents;
+  const char *begin = nullptr;
+  const char *end = nullptr;
+  mapContents(file, contents, begin, end);
+  JsonReader reader(begin, end);
+  std::string name;
+  if(reader.beginObject() == true) {
+    while(reader.nextMember(name) == true) {
+      if(name == "detections") {
+        return readDetections(reader.position(), end, false,
+          [&ranges](uint64_t frame) {
+            for(const auto &range : ranges) {
+              if(frame >= range.first && frame <= range.second) {
+                return true;
+              }
+            }
+            return false;
+          });
+      }
+      reader.skipValue();
+    }
+  }
+  return false;
+}
+
+void VideoAnnotation::loadTrack(
+    uint64_t id,
+    uint64_t first,
+    uint64_t last) const {
+  auto it = file_tracks_.find(id);
+  if(it != file_tracks_.end()) {
+    first = std::max(first, it->second.first);
+    last = std::min(last, it->second.second);
+    if(first <= last) {
+      loadFrames(first, last);
+    }
+  }
+}
+
+void VideoAnnotation::loadAll() const {
+  loadFrames(0, std::numeric_limits<uint64_t>::max());
 }
 
-void VideoAnnotation::boundFrame(uint64_t &frame) {
+void VideoAnnotation::boundFrame(uint64_t &frame) const {
   if(frame >= video_length_) {
     QMessageBox err;
     err.setText(QString("Frame must be less than video length (%1)!"
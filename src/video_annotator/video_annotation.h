@@ -9,6 +9,7 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <functional>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/bimap.hpp>
@@ -20,6 +21,8 @@
 #include "species.h"
 #include "annotation_scene.h"
 #include "global_state_annotation.h"
+#include "detection_store.h"
+#include "annotation_file.h"
 
 #ifndef NO_TESTING
 class TestVideoAnnotation;
@@ -29,6 +32,9 @@ namespace tator { namespace video_annotator {
 
 namespace pt = boost::property_tree;
 
+class JsonReader;
+class JsonWriter;
+
 /// Gets a required field from a property tree.
 ///
 /// This function creates an error message box on failure, and also
@@ -91,11 +97,28 @@ struct DetectionAnnotation : public Serialization {
   /// @return Property tree constructed from the object.
   pt::ptree write() const;
 
+  /// Writes to a JSON object.
+  ///
+  /// Writes the same fields as writing a property tree.
+  ///
+  /// @param writer Writer positioned at the value.
+  void write(JsonWriter &writer) const;
+
   /// Reads from a property tree.
   ///
   /// @param tree Property tree to be read.
   void read(const pt::ptree &tree);
 
+  /// Reads from a JSON object.
+  ///
+  /// Unlike reading a property tree, shows no message for missing
+  /// required fields, so that it may be used off the GUI thread.
+  ///
+  /// @param reader Reader positioned at the object.
+  /// @param missing Receives the name of a missing required field.
+  /// @return True if successful, false if the JSON is invalid.
+  bool read(JsonReader &reader, std::string &missing);
+
   uint64_t frame_; ///< Frame of this annotation.
   uint64_t id_; ///< ID of the individual.
   Rect area_; ///< Rectangle defining the annotation.
@@ -104,21 +127,6 @@ struct DetectionAnnotation : public Serialization {
   double prob_; ///< Detection probability.
 };
 
-/// List of detection annotations.
-typedef std::list<std::shared_ptr<DetectionAnnotation>> DetectionList;
-
-/// Makes iterator sortable so it can be used as key in maps.
-///
-/// Works by converting both iterators to pointers and applying operator<.
-///
-/// @param lhs Left hand side argument.
-/// @param rhs Right hand side argument.
-inline bool operator<(
-  const DetectionList::iterator& lhs,
-  const DetectionList::iterator& rhs) {
-  return &(*lhs) < &(*rhs);
-}
-
 /// Specifies how a track should contribute to overall track count.
 enum CountLabel {
   kIgnore,
@@ -167,6 +175,13 @@ struct TrackAnnotation {
   /// @return Property tree constructed from the object.
   pt::ptree write() const;
 
+  /// Writes to a JSON object.
+  ///
+  /// Writes the same fields as writing a property tree.
+  ///
+  /// @param writer Writer positioned at the value.
+  void write(JsonWriter &writer) const;
+
   /// Reads from a property tree.
   ///
   /// @param tree Property tree to be read.
@@ -257,9 +272,12 @@ public:
   /// Gets annotations for a given ID.
   ///
   /// @param id Track ID.
-  /// @return Annotations for the given frame.
+  /// @param start First frame to include.
+  /// @param stop Last frame to include, -1 means til end of video.
+  /// @return Annotations for the given ID, in order of frame.
   std::vector<std::shared_ptr<DetectionAnnotation>>
-    getDetectionAnnotationsById(uint64_t id);
+    getDetectionAnnotationsById(uint64_t id, uint64_t start = 0,
+    uint64_t stop = -1);
 
   /// Gets counts for each species in a video.
   ///
@@ -320,6 +338,12 @@ public:
   /// @return Frame of last occurrence, zero if not found or no detections.
   uint64_t trackLastFrame(uint64_t id);
 
+  /// Gets number of detections in a track.
+  ///
+  /// @param id Track ID.
+  /// @return Number of detections, zero if not found.
+  uint64_t trackDetectionCount(uint64_t id);
+
   /// Gets ID of earliest track.
   ///
   /// @return ID of earliest track.
@@ -381,15 +405,14 @@ public:
 
   /// Reads annotations from json files.
   ///
+  /// A binary copy of each json file that is read or written is kept in
+  /// the cache directory, and read instead of the json file for as long
+  /// as the json file is unchanged.
+  ///
   /// @param json_path Path to json file.
   void read(const boost::filesystem::path &json_path);
 
 private:
-  /// For mapping integers to detection annotations.
-  typedef boost::bimap<
-    boost::bimaps::multiset_of<uint64_t>,
-    boost::bimaps::multiset_of<DetectionList::iterator>> DetectionsByInteger;
-
   /// For mapping unique integers to track annotations.
   typedef boost::bimap<
     uint64_t,
@@ -405,17 +428,13 @@ private:
     boost::bimaps::multiset_of<std::pair<std::string, std::string>>,
     boost::bimaps::multiset_of<TrackList::iterator>> TracksByStringPair;
 
-  /// List of detection annotations.
-  DetectionList detection_list_;
-
   /// List of track annotations.
   TrackList track_list_;
 
-  /// Map between frame and iterator to detection annotations.
-  DetectionsByInteger detections_by_frame_;
-
-  /// Map between id and iterator to detection annotations.
-  DetectionsByInteger detections_by_id_;
+  /// Detection annotations.
+  ///
+  /// Mutable so that const methods may load detections from file_.
+  mutable DetectionStore detections_;
 
   /// Map between id and iterator to track annotations.
   TracksByUniqueInteger tracks_by_id_;
@@ -432,12 +451,116 @@ private:
   /// Length of the video being annotated.
   uint64_t video_length_;
 
+  /// Binary file with detections not yet loaded, null if none.
+  mutable std::unique_ptr<AnnotationFile> file_;
+
+  /// For each block of detections in file_, true once loaded.
+  mutable std::vector<bool> loaded_blocks_;
+
+  /// First and last frame of each track in file_, by track ID.
+  mutable std::map<uint64_t, std::pair<uint64_t, uint64_t>> file_tracks_;
+
+  /// Path to the json file that file_ is a cached copy of, empty if none.
+  mutable QString file_source_;
+
+  /// True if detections in file_ could not be loaded, so saving would
+  /// lose them.
+  mutable bool incomplete_;
+
+  /// Reads the tracks array of a json file.
+  ///
+  /// @param begin Start of the array.
+  /// @param end End of the file.
+  /// @return True if successful, false if the JSON is invalid.
+  bool readTracks(const char *begin, const char *end);
+
+  /// Reads the detections array of a json file.
+  ///
+  /// Elements are parsed in chunks on the global thread pool and
+  /// inserted in order as the chunks finish.
+  ///
+  /// @param begin Start of the array.
+  /// @param end End of the file.
+  /// @param legacy True for the legacy format, where each element holds
+  ///   the detection in an annotation field.
+  /// @param keep Returns true for the frames of detections to insert,
+  ///   empty to insert all.
+  /// @return True if successful, false if the JSON is invalid.
+  bool readDetections(
+    const char *begin,
+    const char *end,
+    bool legacy,
+    const std::function<bool(uint64_t)> &keep =
+      std::function<bool(uint64_t)>()) const;
+
+  /// Reads the global state array of a json file.
+  ///
+  /// @param begin Start of the array.
+  /// @param end End of the file.
+  /// @param states Receives the global states read, by frame.
+  /// @return True if successful, false if the JSON is invalid.
+  bool readGlobalStates(
+    const char *begin,
+    const char *end,
+    std::map<uint64_t, GlobalStateAnnotation> &states);
+
+  /// Reads tracks and global states from an open binary file and keeps
+  /// it to load detections from later.
+  ///
+  /// @param file Binary file.
+  /// @param json_path Path to the json file the binary file is a cached
+  ///   copy of.
+  /// @return True if successful, false if the file is invalid.
+  bool readFile(
+    std::unique_ptr<AnnotationFile> file,
+    const QString &json_path);
+
+  /// Writes annotations to a binary file.
+  ///
+  /// @param path Path to binary file.
+  /// @param json_path Path to the json file with the same annotations.
+  /// @param states Global states to write.
+  /// @return True if successful, false otherwise.
+  bool writeFile(
+    const QString &path,
+    const QString &json_path,
+    const std::map<uint64_t, GlobalStateAnnotation> &states) const;
+
+  /// Loads detections of a range of frames from file_, if not loaded.
+  ///
+  /// Detections of blocks that fail to decode are read from the json
+  /// file instead.  If that fails too, saving is refused.
+  ///
+  /// @param first First frame of the range.
+  /// @param last Last frame of the range, inclusive.
+  void loadFrames(uint64_t first, uint64_t last) const;
+
+  /// Loads detections of a track in a range of frames from file_, if not
+  /// loaded.
+  ///
+  /// @param id Track ID.
+  /// @param first First frame of the range.
+  /// @param last Last frame of the range, inclusive.
+  void loadTrack(uint64_t id, uint64_t first = 0, uint64_t last = -1) const;
+
+  /// Loads all detections from file_ and releases it.
+  void loadAll() const;
+
+  /// Reads detections in ranges of frames from the json file that file_
+  /// is a cached copy of.
+  ///
+  /// @param ranges First and last frame of each range.
+  /// @return True if successful, false if there is no such json file,
+  ///   it changed or it is invalid.
+  bool reloadFrames(
+    const std::vector<std::pair<uint64_t, uint64_t>> &ranges) const;
+
   /// Verifies that frame number is in bounds.
   ///
   /// If a frame is out of bounds, it is capped so that it is in bounds.
   ///
   /// @param frame Frame number to check.
-  void boundFrame(uint64_t &frame);
+  void boundFrame(uint64_t &frame) const;
 };
 
 }} // namespace tator::video_annotator
@@ -0,0 +1,481 @@
+#include <algorithm>
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include "yuv_convert.h"
+
+// Kernels are compiled for their instruction set with function target
+// attributes, so the rest of the build does not need any flags and the
+// kernel is picked at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YUV_CONVERT_X86 1
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define YUV_CONVERT_X86 1
+#define TARGET_SSE41
+#define TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace tator { namespace video_annotator {
+
+namespace {
+  /// Fixed point coefficients of BT.601 limited range, in units of
+  /// 2^-14.  Applied as the high half of a 16 bit product with values
+  /// shifted left by 7, which leaves 5 fractional bits.
+  static const int kYScale = 19077; ///< 1.164 for luma.
+  static const int kRV = 26149; ///< 1.596 for V to red.
+  static const int kGU = -6419; ///< -0.391 for U to green.
+  static const int kGV = -13320; ///< -0.813 for V to green.
+  static const int kBU = 16525; ///< 2.018 / 2 for U to blue, doubled.
+
+  /// Frames with at least this many pixels are converted in stripes.
+  static const int kParallelPixels = 2560 * 1440;
+
+  /// Maximum number of stripes.
+  static const int kMaxStripes = 8;
+
+  /// Converts rows [first, last) of a frame.
+  typedef void (*RowsFunction)(
+      const AVFrame *frame,
+      int first,
+      int last,
+      uint8_t *dst,
+      int dst_stride);
+
+  /// High half of a 16 bit product, same as _mm_mulhi_epi16.
+  inline int mulhi(int a, int b) {
+    return (a * b) >> 16;
+  }
+
+  /// Clamps to a byte.
+  inline uint8_t clampByte(int value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+  }
+
+  /// Converts pixels [from, to) of a row.  Chroma samples are step bytes
+  /// apart, 1 for planar and 2 for interleaved chroma.
+  void scalarSpan(
+      const uint8_t *y,
+      const uint8_t *u,
+      const uint8_t *v,
+      int step,
+      int from,
+      int to,
+      uint8_t *out) {
+    for(int x = from; x < to; ++x) {
+      const int c = (x / 2) * step;
+      const int yy = mulhi((y[x] - 16) * 128, kYScale);
+      const int du = (u[c] - 128) * 128;
+      const int dv = (v[c] - 128) * 128;
+      out[4 * x + 0] = clampByte((yy + 2 * mulhi(du, kBU) + 16) >> 5);
+      out[4 * x + 1] = clampByte(
+          (yy + mulhi(du, kGU) + mulhi(dv, kGV) + 16) >> 5);
+      out[4 * x + 2] = clampByte((yy + mulhi(dv, kRV) + 16) >> 5);
+      out[4 * x + 3] = 255;
+    }
+  }
+
+  /// Row pointers of a frame.
+  struct RowPointers {
+    const uint8_t *y; ///< Luma row.
+    const uint8_t *u; ///< U samples, or interleaved UV for NV12.
+    const uint8_t *v; ///< V samples.
+    int step; ///< Bytes between chroma samples.
+    bool nv12; ///< True if chroma is interleaved.
+  };
+
+  /// Gets the row pointers of a row of a frame.
+  RowPointers rowPointers(const AVFrame *frame, int row) {
+    RowPointers rows;
+    rows.nv12 = frame->format == AV_PIX_FMT_NV12;
+    rows.y = frame->data[0] + row * frame->linesize[0];
+    rows.u = frame->data[1] + (row / 2) * frame->linesize[1];
+    rows.v = rows.nv12 ?
+      rows.u + 1 :
+      frame->data[2] + (row / 2) * frame->linesize[2];
+    rows.step = rows.nv12 ? 2 : 1;
+    return rows;
+  }
+
+  void scalarRows(
+      const AVFrame *frame,
+      int first,
+      int last,
+      uint8_t *dst,
+      int dst_stride) {
+    for(int row = first; row < last; ++row) {
+      RowPointers rows = rowPointers(frame, row);
+      scalarSpan(rows.y, rows.u, rows.v, rows.step, 0, frame->width,
+          dst + row * dst_stride);
+    }
+  }
+
+#ifdef YUV_CONVERT_X86
+  /// Computes 8 pixels from 16 bit luma and chroma, same math as
+  /// scalarSpan.
+  TARGET_SSE41 inline void pixelsSse41(
+      __m128i y, __m128i u, __m128i v,
+      __m128i &b, __m128i &g, __m128i &r) {
+    const __m128i round = _mm_set1_epi16(16);
+    const __m128i yy = _mm_mulhi_epi16(
+        _mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), 7),
+        _mm_set1_epi16(kYScale));
+    const __m128i du = _mm_slli_epi16(
+        _mm_sub_epi16(u, _mm_set1_epi16(128)), 7);
+    const __m128i dv = _mm_slli_epi16(
+        _mm_sub_epi16(v, _mm_set1_epi16(128)), 7);
+    const __m128i bu = _mm_mulhi_epi16(du, _mm_set1_epi16(kBU));
+    b = _mm_srai_epi16(_mm_add_epi16(
+        _mm_add_epi16(yy, _mm_add_epi16(bu, bu)), round), 5);
+    g = _mm_srai_epi16(_mm_add_epi16(
+        _mm_add_epi16(yy, _mm_mulhi_epi16(du, _mm_set1_epi16(kGU))),
+        _mm_add_epi16(_mm_mulhi_epi16(dv, _mm_set1_epi16(kGV)), round)), 5);
+    r = _mm_srai_epi16(_mm_add_epi16(
+        _mm_add_epi16(yy, _mm_mulhi_epi16(dv, _mm_set1_epi16(kRV))),
+        round), 5);
+  }
+
+  /// Packs and interleaves 16 pixels into BGRA.
+  TARGET_SSE41 inline void storeSse41(
+      __m128i b_lo, __m128i g_lo, __m128i r_lo,
+      __m128i b_hi, __m128i g_hi, __m128i r_hi,
+      uint8_t *out) {
+    const __m128i b = _mm_packus_epi16(b_lo, b_hi);
+    const __m128i g = _mm_packus_epi16(g_lo, g_hi);
+    const __m128i r = _mm_packus_epi16(r_lo, r_hi);
+    const __m128i a = _mm_set1_epi8(-1);
+    const __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+    const __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+    const __m128i ra_lo = _mm_unpacklo_epi8(r, a);
+    const __m128i ra_hi = _mm_unpackhi_epi8(r, a);
+    __m128i *dst = reinterpret_cast<__m128i*>(out);
+    _mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+    _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+    _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+  }
+
+  TARGET_SSE41 void sse41Rows(
+      const AVFrame *frame,
+      int first,
+      int last,
+      uint8_t *dst,
+      int dst_stride) {
+    const int width = frame->width;
+    for(int row = first; row < last; ++row) {
+      RowPointers rows = rowPointers(frame, row);
+      uint8_t *out = dst + row * dst_stride;
+      int x = 0;
+      for(; x + 16 <= width; x += 16) {
+        const __m128i luma = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(rows.y + x));
+        const __m128i y_lo = _mm_cvtepu8_epi16(luma);
+        const __m128i y_hi = _mm_cvtepu8_epi16(_mm_srli_si128(luma, 8));
+        __m128i u_lo, u_hi, v_lo, v_hi;
+        if(rows.nv12 == true) {
+          // U and V alternate, duplicate each for two pixels.
+          const __m128i uv = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(rows.u + x));
+          const __m128i uv_lo = _mm_cvtepu8_epi16(uv);
+          const __m128i uv_hi = _mm_cvtepu8_epi16(_mm_srli_si128(uv, 8));
+          u_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(
+                uv_lo, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+          u_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(
+                uv_hi, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+          v_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(
+                uv_lo, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+          v_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(
+                uv_hi, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+        }
+        else {
+          const __m128i u = _mm_cvtepu8_epi16(_mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(rows.u + x / 2)));
+          const __m128i v = _mm_cvtepu8_epi16(_mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(rows.v + x / 2)));
+          u_lo = _mm_unpacklo_epi16(u, u);
+          u_hi = _mm_unpackhi_epi16(u, u);
+          v_lo = _mm_unpacklo_epi16(v, v);
+          v_hi = _mm_unpackhi_epi16(v, v);
+        }
+        __m128i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+        pixelsSse41(y_lo, u_lo, v_lo, b_lo, g_lo, r_lo);
+        pixelsSse41(y_hi, u_hi, v_hi, b_hi, g_hi, r_hi);
+        storeSse41(b_lo, g_lo, r_lo, b_hi, g_hi, r_hi, out + 4 * x);
+      }
+      scalarSpan(rows.y, rows.u, rows.v, rows.step, x, width, out);
+    }
+  }
+
+  /// Computes 16 pixels from 16 bit luma and chroma, same math as
+  /// scalarSpan.
+  TARGET_AVX2 inline void pixelsAvx2(
+      __m256i y, __m256i u, __m256i v,
+      __m256i &b, __m256i &g, __m256i &r) {
+    const __m256i round = _mm256_set1_epi16(16);
+    const __m256i yy = _mm256_mulhi_epi16(
+        _mm256_slli_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), 7),
+        _mm256_set1_epi16(kYScale));
+    const __m256i du = _mm256_slli_epi16(
+        _mm256_sub_epi16(u, _mm256_set1_epi16(128)), 7);
+    const __m256i dv = _mm256_slli_epi16(
+        _mm256_sub_epi16(v, _mm256_set1_epi16(128)), 7);
+    const __m256i bu = _mm256_mulhi_epi16(du, _mm256_set1_epi16(kBU));
+    b = _mm256_srai_epi16(_mm256_add_epi16(
+        _mm256_add_epi16(yy, _mm256_add_epi16(bu, bu)), round), 5);
+    g = _mm256_srai_epi16(_mm256_add_epi16(
+        _mm256_add_epi16(yy, _mm256_mulhi_epi16(du, _mm256_set1_epi16(kGU))),
+        _mm256_add_epi16(
+          _mm256_mulhi_epi16(dv, _mm256_set1_epi16(kGV)), round)), 5);
+    r = _mm256_srai_epi16(_mm256_add_epi16(
+        _mm256_add_epi16(yy, _mm256_mulhi_epi16(dv, _mm256_set1_epi16(kRV))),
+        round), 5);
+  }
+
+  /// Packs and interleaves 32 pixels into BGRA.
+  ///
+  /// Low halves hold pixels 0-7 and 8-15 in their two lanes, high halves
+  /// pixels 16-23 and 24-31.  Packing and unpacking stay within lanes, so
+  /// the lanes are put back in order before storing.
+  TARGET_AVX2 inline void storeAvx2(
+      __m256i b_lo, __m256i g_lo, __m256i r_lo,
+      __m256i b_hi, __m256i g_hi, __m256i r_hi,
+      uint8_t *out) {
+    const __m256i b = _mm256_packus_epi16(b_lo, b_hi);
+    const __m256i g = _mm256_packus_epi16(g_lo, g_hi);
+    const __m256i r = _mm256_packus_epi16(r_lo, r_hi);
+    const __m256i a = _mm256_set1_epi8(-1);
+    const __m256i bg_lo = _mm256_unpacklo_epi8(b, g);
+    const __m256i bg_hi = _mm256_unpackhi_epi8(b, g);
+    const __m256i ra_lo = _mm256_unpacklo_epi8(r, a);
+    const __m256i ra_hi = _mm256_unpackhi_epi8(r, a);
+    const __m256i p0 = _mm256_unpacklo_epi16(bg_lo, ra_lo);
+    const __m256i p1 = _mm256_unpackhi_epi16(bg_lo, ra_lo);
+    const __m256i p2 = _mm256_unpacklo_epi16(bg_hi, ra_hi);
+    const __m256i p3 = _mm256_unpackhi_epi16(bg_hi, ra_hi);
+    __m256i *dst = reinterpret_cast<__m256i*>(out);
+    _mm256_storeu_si256(dst + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256(dst + 2, _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256(dst + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+  }
+
+  TARGET_AVX2 void avx2Rows(
+      const AVFrame *frame,
+      int first,
+      int last,
+      uint8_t *dst,
+      int dst_stride) {
+    const int width = frame->width;
+    for(int row = first; row < last; ++row) {
+      RowPointers rows = rowPointers(frame, row);
+      uint8_t *out = dst + row * dst_stride;
+      int x = 0;
+      for(; x + 32 <= width; x += 32) {
+        const __m256i y_lo = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(rows.y + x)));
+        const __m256i y_hi = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(rows.y + x + 16)));
+        __m256i u_lo, u_hi, v_lo, v_hi;
+        if(rows.nv12 == true) {
+          // Each lane holds four UV pairs for eight pixels.
+          const __m256i uv_lo = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(rows.u + x)));
+          const __m256i uv_hi = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(rows.u + x + 16)));
+          u_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(
+                uv_lo, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+          u_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(
+                uv_hi, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+          v_lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(
+                uv_lo, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+          v_hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(
+                uv_hi, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+        }
+        else {
+          // Reorder 64 bit quarters so in-lane unpacking duplicates
+          // samples 0-3 and 4-7 into the low half, 8-11 and 12-15 into
+          // the high half.
+          const __m256i u = _mm256_permute4x64_epi64(
+              _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                  reinterpret_cast<const __m128i*>(rows.u + x / 2))),
+              _MM_SHUFFLE(3, 1, 2, 0));
+          const __m256i v = _mm256_permute4x64_epi64(
+              _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                  reinterpret_cast<const __m128i*>(rows.v + x / 2))),
+              _MM_SHUFFLE(3, 1, 2, 0));
+          u_lo = _mm256_unpacklo_epi16(u, u);
+          u_hi = _mm256_unpackhi_epi16(u, u);
+          v_lo = _mm256_unpacklo_epi16(v, v);
+          v_hi = _mm256_unpackhi_epi16(v, v);
+        }
+        __m256i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+        pixelsAvx2(y_lo, u_lo, v_lo, b_lo, g_lo, r_lo);
+        pixelsAvx2(y_hi, u_hi, v_hi, b_hi, g_hi, r_hi);
+        storeAvx2(b_lo, g_lo, r_lo, b_hi, g_hi, r_hi, out + 4 * x);
+      }
+      scalarSpan(rows.y, rows.u, rows.v, rows.step, x, width, out);
+    }
+  }
+
+  /// Checks CPU support of SSE4.1 and AVX2.
+  void detectCpu(bool &sse41, bool &avx2) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    sse41 = (info[2] & (1 << 19)) != 0;
+    // AVX state must also be enabled by the operating system.
+    const bool os_avx =
+      (info[2] & (1 << 27)) != 0 &&
+      (info[2] & (1 << 28)) != 0 &&
+      (_xgetbv(0) & 6) == 6;
+    avx2 = false;
+    if(max_leaf >= 7 && os_avx == true) {
+      __cpuidex(info, 7, 0);
+      avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    sse41 = __builtin_cpu_supports("sse4.1") != 0;
+    avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+  }
+#endif // YUV_CONVERT_X86
+
+  /// Returns the rows function of a kernel.
+  RowsFunction rowsFunction(YuvKernel kernel) {
+#ifdef YUV_CONVERT_X86
+    switch(kernel) {
+      case kAvx2Kernel:
+        return avx2Rows;
+      case kSse41Kernel:
+        return sse41Rows;
+      default:
+        break;
+    }
+#endif
+    return scalarRows;
+  }
+
+  /// Converts one stripe on the thread pool.
+  class StripeTask : public QRunnable {
+  public:
+    StripeTask(
+        RowsFunction rows,
+        const AVFrame *frame,
+        int first,
+        int last,
+        uint8_t *dst,
+        int dst_stride,
+        QSemaphore *done)
+      : rows_(rows)
+      , frame_(frame)
+      , first_(first)
+      , last_(last)
+      , dst_(dst)
+      , dst_stride_(dst_stride)
+      , done_(done) {
+    }
+
+    void run() override {
+      rows_(frame_, first_, last_, dst_, dst_stride_);
+      done_->release();
+    }
+  private:
+    RowsFunction rows_;
+    const AVFrame *frame_;
+    int first_;
+    int last_;
+    uint8_t *dst_;
+    int dst_stride_;
+    QSemaphore *done_;
+  };
+}
+
+YuvKernel bestYuvKernel() {
+  if(yuvKernelSupported(kAvx2Kernel) == true) {
+    return kAvx2Kernel;
+  }
+  if(yuvKernelSupported(kSse41Kernel) == true) {
+    return kSse41Kernel;
+  }
+  return kScalarKernel;
+}
+
+bool yuvKernelSupported(YuvKernel kernel) {
+#ifdef YUV_CONVERT_X86
+  static bool sse41 = false;
+  static bool avx2 = false;
+  static const bool detected = (detectCpu(sse41, avx2), true);
+  (void)detected;
+  switch(kernel) {
+    case kAvx2Kernel:
+      return avx2;
+    case kSse41Kernel:
+      return sse41;
+    default:
+      return true;
+  }
+#else
+  return kernel == kScalarKernel;
+#endif
+}
+
+const char *yuvKernelName(YuvKernel kernel) {
+  switch(kernel) {
+    case kAvx2Kernel:
+      return "avx2";
+    case kSse41Kernel:
+      return "sse4.1";
+    default:
+      return "scalar";
+  }
+}
+
+bool yuvKernelSupports(AVPixelFormat format) {
+  return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_NV12;
+}
+
+void convertYuv(
+    const AVFrame *frame,
+    uint8_t *dst,
+    int dst_stride,
+    YuvKernel kernel) {
+  RowsFunction rows = rowsFunction(kernel);
+  const int height = frame->height;
+  int stripes = 1;
+  if(static_cast<qint64>(frame->width) * height >= kParallelPixels) {
+    stripes = std::min(QThread::idealThreadCount(), kMaxStripes);
+  }
+  if(stripes <= 1) {
+    rows(frame, 0, height, dst, dst_stride);
+    return;
+  }
+  // Stripes start on even rows so each chroma row belongs to one stripe.
+  const int stripe_rows = ((height + stripes - 1) / stripes + 1) & ~1;
+  QSemaphore done;
+  int started = 0;
+  for(int first = stripe_rows; first < height; first += stripe_rows) {
+    QThreadPool::globalInstance()->start(new StripeTask(
+        rows,
+        frame,
+        first,
+        std::min(first + stripe_rows, height),
+        dst,
+        dst_stride,
+        &done));
+    ++started;
+  }
+  rows(frame, 0, std::min(stripe_rows, height), dst, dst_stride);
+  done.acquire(started);
+}
+
+}} // namespace tator::video_annotator
@@ -0,0 +1,61 @@
+/// @file
+/// @brief Defines YUV to RGB conversion kernels with runtime dispatch.
+
+#ifndef VIDEO_ANNOTATOR_YUV_CONVERT_H
+#define VIDEO_ANNOTATOR_YUV_CONVERT_H
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+namespace tator { namespace video_annotator {
+
+/// Implementations of the conversion.
+enum YuvKernel {
+  kScalarKernel, ///< Portable C++, used for row tails and as reference.
+  kSse41Kernel, ///< 16 pixels per iteration with SSE4.1.
+  kAvx2Kernel ///< 32 pixels per iteration with AVX2.
+};
+
+/// Returns the fastest kernel supported by the CPU.
+YuvKernel bestYuvKernel();
+
+/// Returns true if the CPU supports a kernel.
+///
+/// @param kernel Kernel to check.
+bool yuvKernelSupported(YuvKernel kernel);
+
+/// Returns a short name for a kernel.
+///
+/// @param kernel Kernel to name.
+const char *yuvKernelName(YuvKernel kernel);
+
+/// Returns true if a pixel format can be converted by the kernels.
+///
+/// Supported formats are YUV420P and NV12, both treated as BT.601
+/// limited range like swscale does by default.
+///
+/// @param format Pixel format.
+bool yuvKernelSupports(AVPixelFormat format);
+
+/// Converts a frame to 32 bit BGRA, the layout of QImage::Format_RGB32.
+///
+/// Frames of 1440p and above are split into horizontal stripes that are
+/// converted in parallel on the global thread pool.
+///
+/// @param frame Frame in a supported pixel format.
+/// @param dst Destination of frame->height rows of 4 * frame->width bytes.
+/// @param dst_stride Bytes between destination rows.
+/// @param kernel Kernel to use, must be supported by the CPU.
+void convertYuv(
+    const AVFrame *frame,
+    uint8_t *dst,
+    int dst_stride,
+    YuvKernel kernel);
+
+}} // namespace tator::video_annotator
+
+#endif // VIDEO_ANNOTATOR_YUV_CONVERT_H